@@ -414,6 +414,8 @@ static int gc(arc *c)
 /* Default root marker */
 static void markroots(arc *c)
 {
+  int i, j;
+
   MARKPROP(c->symtable);
   MARKPROP(c->rsymtable);
   MARKPROP(c->genv);
@@ -422,6 +424,16 @@ static void markroots(arc *c)
   MARKPROP(c->curthread);
   MARKPROP(c->vmthreads);
   MARKPROP(c->declarations);
+  MARKPROP(c->inlined);
+  MARKPROP(c->maccache);
+  MARKPROP(c->macmemo);
+  MARKPROP(c->affs);
+  /* Free stack chunks contain nothing but garbage, so only the chunks
+     themselves are marked, as with thread stacks. */
+  for (i=0; i<ARC_STKSIZES; i++) {
+    for (j=0; j<c->nstkpool[i]; j++)
+      mark(c, c->stkpool[i][j], -1);
+  }
 #ifdef HAVE_TRACING
   MARKPROP(c->tracethread);
 #endif
@@ -120,7 +120,7 @@ value arc_is2(arc *c, value a, value b)
 static AFFDEF(is2)
 {
   AARG(a, b, vh1, vh2);
-  AFBEGIN;
+  AFLBEGIN;
   ((void)vh1);
   ((void)vh2);
   ARETURN(arc_is2(c, AV(a), AV(b)));
@@ -133,7 +133,7 @@ AFFDEF(arc_is)
   ARARG(list);
   AFBEGIN;
   /* Tail call */
-  AFTCALL(arc_mkaff(c, pairwise, CNIL), arc_mkaff(c, is2, CNIL),
+  AFTCALL(ARC_AFF(c, pairwise), ARC_AFF(c, is2),
 	  AV(list), CNIL, CNIL);
   AFEND;
 }
@@ -166,7 +166,7 @@ AFFDEF(arc_iso2)
      iscmp if available.  If neither is available, then they cannot
      be compared.  */
   if (tfn->isocmp != NULL) {
-    AFTCALL(arc_mkaff(c, tfn->isocmp, CNIL), AV(a), AV(b), AV(vh1), AV(vh2));
+    AFTCALL(ARC_AFF(c, tfn->isocmp), AV(a), AV(b), AV(vh1), AV(vh2));
   } else if (tfn->iscmp != NULL) {
     ARETURN(tfn->iscmp(c, AV(a), AV(b)));
   }
@@ -180,8 +180,8 @@ AFFDEF(arc_iso)
   ARARG(list);
   AFBEGIN;
   /* Call pairwise with new visithashes */
-  AFTCALL(arc_mkaff(c, pairwise, CNIL),
-	  arc_mkaff(c, arc_iso2, CNIL),
+  AFTCALL(ARC_AFF(c, pairwise),
+	  ARC_AFF(c, arc_iso2),
 	  AV(list),
 	  arc_mkhash(c, ARC_HASHBITS),
 	  arc_mkhash(c, ARC_HASHBITS));
@@ -193,6 +193,9 @@ typefn_t *__arc_typefn(arc *c, value v)
 {
   value typedesc;
 
+  /* Immediates of no particular type have no type functions */
+  if (TYPE(v) == T_NONE)
+    return(NULL);
   if (TYPE(v) != T_TAGGED)
     return(c->typefns[TYPE(v)]);
   /* For tagged types (custom types), the type descriptor hash should
@@ -281,6 +284,9 @@ value arc_type(arc *c, value obj)
   case T_CHAN:
     return(ARC_BUILTIN(c, S_CHAN));
     break;
+  case T_OMAP:
+    return(ARC_BUILTIN(c, S_OMAP));
+    break;
   default:
     break;
   }
@@ -357,6 +363,9 @@ value arc_type_compat(arc *c, value obj)
   case T_CHAN:
     return(ARC_BUILTIN(c, S_CHAN));
     break;
+  case T_OMAP:
+    return(ARC_BUILTIN(c, S_OMAP));
+    break;
   default:
     break;
   }
@@ -393,12 +402,12 @@ static AFFDEF(tagged_pprint)
   if (!BOUND_P(AV(visithash)))
     WV(visithash, arc_mkhash(c, ARC_HASHBITS));
 
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
   if (!NIL_P(__arc_visit(c, AV(sexpr), AV(visithash)))) {
     /* already visited at some point. Do not recurse further */
     AFTCALL(AV(dw), arc_mkstringc(c, "(...)"), CTRUE, AV(fp), AV(visithash));
   }
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(wc, ARC_AFF(c, arc_writec));
 
   AFCALL(AV(dw), arc_mkstringc(c, "#(tagged "), CTRUE, AV(fp), AV(visithash));
   AFCALL(AV(dw), car(AV(sexpr)), AV(disp), AV(fp), AV(visithash));
@@ -482,6 +491,9 @@ enum arc_types typesym2type(arc *c, value typesym)
   if (typesym == ARC_BUILTIN(c, S_CHAN))
     return(T_CHAN);
 
+  if (typesym == ARC_BUILTIN(c, S_OMAP))
+    return(T_OMAP);
+
   return(T_NONE);
 }
 
@@ -503,7 +515,7 @@ AFFDEF(arc_coerce)
     arc_err_cstrfmt(c, "cannot coerce");
     ARETURN(AV(obj));
   }
-  AFTCALL(arc_mkaff(c, tfn->xcoerce, CNIL), AV(obj),
+  AFTCALL(ARC_AFF(c, tfn->xcoerce), AV(obj),
 	  INT2FIX(typesym2type(c, AV(typesym))), AV(args));
   AFEND;
 }
@@ -576,7 +588,7 @@ AFFDEF(arc_gt)
   ARARG(list);
   AFBEGIN;
   /* tail call */
-  AFTCALL(arc_mkaff(c, pairwise2, CNIL),
+  AFTCALL(ARC_AFF(c, pairwise2),
 	  arc_mkccode(c, 2, gt2, CNIL),
 	  AV(list));
   AFEND;
@@ -588,7 +600,7 @@ AFFDEF(arc_lt)
   ARARG(list);
   AFBEGIN;
   /* tail call */
-  AFTCALL(arc_mkaff(c, pairwise2, CNIL),
+  AFTCALL(ARC_AFF(c, pairwise2),
 	  arc_mkccode(c, 2, lt2, CNIL),
 	  AV(list));
   AFEND;
@@ -602,10 +614,15 @@ AFFDEF(arc_sref)
 
   if (TYPE(AV(com)) == T_TABLE) {
     if (NIL_P(AV(val))) {
-      AFCALL(arc_mkaff(c, arc_xhash_delete, CNIL), AV(com), AV(ind));
+      AFCALL(ARC_AFF(c, arc_xhash_delete), AV(com), AV(ind));
     } else {
-      AFCALL(arc_mkaff(c, arc_xhash_insert, CNIL), AV(com), AV(ind), AV(val));
+      AFCALL(ARC_AFF(c, arc_xhash_insert), AV(com), AV(ind), AV(val));
     }
+  } else if (TYPE(AV(com)) == T_OMAP) {
+    if (NIL_P(AV(val)))
+      arc_omap_delete(c, AV(com), AV(ind));
+    else
+      arc_omap_insert(c, AV(com), AV(ind), AV(val));
   } else if (TYPE(AV(com)) == T_STRING) {
     if (TYPE(AV(val)) != T_CHAR) {
       arc_err_cstrfmt(c, "cannot set string index to non-character");
@@ -673,6 +690,8 @@ value arc_len(arc *c, value obj)
     return(INT2FIX(VECLEN(obj)));
   case T_TABLE:
     return(INT2FIX(arc_hash_length(c, obj)));
+  case T_OMAP:
+    return(INT2FIX(arc_omap_length(c, obj)));
   default:
     /* Note that PG-Arc also allows the length of symbols to be taken,
        but why this should be remains inexplicable to me. */
@@ -695,6 +714,7 @@ extern typefn_t __arc_rational_typefn__;
 
 extern typefn_t __arc_cons_typefn__;
 extern typefn_t __arc_table_typefn__;
+extern typefn_t __arc_omap_typefn__;
 extern typefn_t __arc_tablevec_typefn__;
 extern typefn_t __arc_hb_typefn__;
 extern typefn_t __arc_wtable_typefn__;
@@ -711,6 +731,19 @@ extern typefn_t __arc_chan_typefn__;
 typefn_t __arc_tagged_typefn__;
 extern typefn_t __arc_regexp_typefn__;
 
+/* Type descriptors only hold a copy of some type functions */
+static typefn_t typedesc_typefn = {
+  __arc_null_marker,
+  __arc_null_sweeper,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
 void arc_init_datatypes(arc *c)
 {
   c->typefns[T_FIXNUM] = &__arc_fixnum_typefn__;
@@ -729,6 +762,7 @@ void arc_init_datatypes(arc *c)
   c->typefns[T_TABLE] = &__arc_table_typefn__;
   c->typefns[T_TABLEVEC] = &__arc_tablevec_typefn__;
   c->typefns[T_TBUCKET] = &__arc_hb_typefn__;
+  c->typefns[T_OMAP] = &__arc_omap_typefn__;
   c->typefns[T_INPORT] = &__arc_io_typefn__;
   c->typefns[T_OUTPORT] = &__arc_io_typefn__;
   c->typefns[T_THREAD] = &__arc_thread_typefn__;
@@ -751,6 +785,33 @@ void arc_init_datatypes(arc *c)
   c->typefns[T_CLOS] = &__arc_clos_typefn__;
   c->typefns[T_EXCEPTION] = &__arc_exception_typefn__;
   c->typefns[T_REGEXP] = &__arc_regexp_typefn__;
+  c->typefns[T_TYPEDESC] = &typedesc_typefn;
+}
+
+/* Define the type functions of objects tagged with the symbol tag, as
+   native modules do for the types they provide.  Any that tfn leaves
+   NULL are those of an ordinary tagged object. */
+value arc_deftype(arc *c, value tag, typefn_t *tfn)
+{
+  value typedesc;
+  typefn_t *ntfn;
+
+  typedesc = arc_mkobject(c, sizeof(typefn_t), T_TYPEDESC);
+  ntfn = (typefn_t *)REP(typedesc);
+  *ntfn = *tfn;
+#define DEFTYPEFN(fn) if (ntfn->fn == NULL) ntfn->fn = __arc_tagged_typefn__.fn
+  DEFTYPEFN(marker);
+  DEFTYPEFN(sweeper);
+  DEFTYPEFN(pprint);
+  DEFTYPEFN(hash);
+  DEFTYPEFN(iscmp);
+  DEFTYPEFN(isocmp);
+  DEFTYPEFN(apply);
+  DEFTYPEFN(xcoerce);
+  DEFTYPEFN(xhash);
+#undef DEFTYPEFN
+  arc_hash_insert(c, c->typedesc, tag, typedesc);
+  return(typedesc);
 }
 
 #ifdef HAVE_TRACING
@@ -825,6 +886,14 @@ static struct {
   { "table", -2, arc_newtable },
   { "maptable", -2, arc_xhash_map },
 
+  /* Ordered Map Operations */
+  { "omap", 0, arc_mkomap },
+  { "omap-first", 1, arc_omap_first },
+  { "omap-last", 1, arc_omap_last },
+  { "omap-rank", 2, arc_omap_xrank },
+  { "omap-nth", 2, arc_omap_xnth },
+  { "omap-range", -2, arc_omap_xrange },
+
   /* Evaluation */
   { "eval", -2, arc_eval },
   { "apply", -2, arc_apply },
@@ -898,9 +967,11 @@ static struct {
   /* loader */
   { "loadpath-add", 1, arc_loadpath_add },
   { "load", -2, arc_load },
+  { "load-native", 1, arc_load_native },
 
   /* Error handling and continuations */
   { "ccc", -2, arc_callcc },
+  { "call/ec", -2, arc_callec },
   { "dynamic-wind", -2, arc_dynamic_wind },
   { "details", 1, arc_details },
   { "err", -2, arc_err },
@@ -908,6 +979,7 @@ static struct {
 
   /* strings */
   { "newstring", -2, arc_newstring },
+  { "substring", -2, arc_substring },
   { "regcomp", -2, arc_regcomp },
 
   /* time */
@@ -940,6 +1012,40 @@ value arc_bound(arc *c, value sym)
 
 value arc_bindsym(arc *c, value sym, value binding)
 {
+  /* Code that has inlined the old definition of a global function
+     must no longer use it. */
+  if (!NIL_P(c->inlined)) {
+    value cell = arc_hash_lookup(c, c->inlined, sym);
+
+    if (BOUND_P(cell)) {
+      scar(cell, CNIL);
+      arc_hash_delete(c, c->inlined, sym);
+    }
+  }
+  /* The compiler forwards lazy rest parameters to the builtin apply
+     only (see lazy_apply) */
+  if (sym == ARC_BUILTIN(c, S_APPLY)
+      && BOUND_P(arc_hash_lookup(c, c->genv, sym)))
+    c->applyredef = 1;
+  /* Forget what the compiler knows about it being a macro */
+  if (!NIL_P(c->maccache)) {
+    int i = (SYM2ID(sym) & (ARC_MACCACHE_SIZE-1))*2;
+
+    if (VINDEX(c->maccache, i) == sym)
+      SVINDEX(c->maccache, i, CNIL);
+  }
+  if (!NIL_P(c->macmemo)) {
+    value pure;
+
+    for (pure = arc_hash_lookup(c, c->declarations,
+				ARC_BUILTIN(c, S_PURE_MACROS));
+	 CONS_P(pure); pure = cdr(pure)) {
+      if (car(pure) == sym) {
+	c->macmemo = CNIL;
+	break;
+      }
+    }
+  }
   return(arc_hash_insert(c, c->genv, sym, binding));
 }
 
@@ -961,7 +1067,10 @@ value arc_gbind(arc *c, value sym)
 
 value arc_declare(arc *c, value decl, value val)
 {
-  if (decl != ARC_BUILTIN(c, S_ATSTRINGS)) {
+  if (decl != ARC_BUILTIN(c, S_ATSTRINGS)
+      && decl != ARC_BUILTIN(c, S_OPTIMIZE)
+      && decl != ARC_BUILTIN(c, S_INLINE_GLOBALS)
+      && decl != ARC_BUILTIN(c, S_PURE_MACROS)) {
     arc_err_cstrfmt(c, "unknown declaration");
     return(CNIL);
   }
@@ -969,6 +1078,32 @@ value arc_declare(arc *c, value decl, value val)
     arc_hash_delete(c, c->declarations, decl);
     return(CNIL);
   }
+  /* The pure-macros declaration is the list of the names of macros
+     whose expansions may be memoised */
+  if (decl == ARC_BUILTIN(c, S_PURE_MACROS)) {
+    if (SYMBOL_P(val))
+      val = cons(c, val, CNIL);
+    if (!CONS_P(val)) {
+      arc_err_cstrfmt(c, "pure-macros expects a list of macro names");
+      return(CNIL);
+    }
+    c->macmemo = CNIL;
+    arc_hash_insert(c, c->declarations, decl, val);
+    return(CTRUE);
+  }
+  /* The inline-globals declaration is t, to inline any global
+     function that can be, or the list of the names of the ones that
+     may be inlined */
+  if (decl == ARC_BUILTIN(c, S_INLINE_GLOBALS) && val != CTRUE) {
+    if (SYMBOL_P(val))
+      val = cons(c, val, CNIL);
+    if (!CONS_P(val)) {
+      arc_err_cstrfmt(c, "inline-globals expects t or a list of function names");
+      return(CNIL);
+    }
+    arc_hash_insert(c, c->declarations, decl, val);
+    return(CTRUE);
+  }
   arc_hash_insert(c, c->declarations, decl, CTRUE);
   return(CTRUE);
 }
@@ -1025,10 +1160,19 @@ void arc_init(arc *c)
 
   /* Create declarations table */
   c->declarations = arc_mkhash(c, ARC_HASHBITS);
+  c->inlined = CNIL;
+  c->applyredef = 0;
+  c->maccache = CNIL;
+  c->macmemo = CNIL;
+  c->affs = CNIL;
+  c->modules = NULL;
 
   /* Initialise symbol table and built-in symbols*/
   arc_init_symtable(c);
 
+  /* The compiler optimizes unless told otherwise */
+  arc_declare(c, ARC_BUILTIN(c, S_OPTIMIZE), CTRUE);
+
   /* Initialise thread system */
   arc_init_threads(c);
 
@@ -1052,6 +1196,10 @@ void arc_deinit(arc *c)
   c->curthread = CNIL;
   c->vmthreads = CNIL;
   c->declarations = CNIL;
+  c->inlined = CNIL;
+  c->maccache = CNIL;
+  c->macmemo = CNIL;
+  c->affs = CNIL;
 #ifdef HAVE_TRACING
   c->tracethread = CNIL;
 #endif
@@ -1062,6 +1210,8 @@ void arc_deinit(arc *c)
     ;
   while (c->gc(c) == 0)
     ;
+  /* nothing made by a native module can be left by now */
+  __arc_unload_native(c);
   free(c->alloc_ctx);
   c->alloc_ctx = NULL;
 }
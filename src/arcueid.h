@@ -73,7 +73,8 @@ enum arc_types {
   T_NUM = 29,			/* number -- not a real type */
   T_INT = 30,			/* int -- not a real type */
   T_REGEXP = 31,		/* regular expression */
-  T_MAX = 31,
+  T_OMAP = 32,			/* ordered map */
+  T_MAX = 32,
 
   T_NONE=64
 };
@@ -120,6 +121,15 @@ struct typefn_t {
 
 typedef struct typefn_t typefn_t;
 
+/* Name of the initialisation function of a native module */
+#define ARC_MODULE_INIT "arc_module_init"
+
+/* Maximum number of free stack chunks of each size kept for reuse */
+#define ARC_STKPOOL 16
+/* Free stack chunks are kept by size, which is a power of two less
+   than 1 << ARC_STKSIZES */
+#define ARC_STKSIZES 15
+
 struct arc {
   /* Low-level allocation functions (bypass memory management--use only
      from within an allocator or garbage collector).  The mem_alloc function
@@ -154,15 +164,35 @@ struct arc {
   value vmthrtail;		/* virtual machine thread objects (tail) */
   value curthread;		/* current thread */
   int tid_nonce;		/* nonce for thread IDs */
-  int stksize;			/* default stack size for threads */
+  int stksize;			/* size of a thread stack chunk */
+  value stkpool[ARC_STKSIZES][ARC_STKPOOL]; /* free stack chunks */
+  int nstkpool[ARC_STKSIZES];	/* number of free stack chunks of each size */
   value tracethread;		/* tracing thread */
   unsigned long quantum;	/* default quantum */
   void (*errhandler)(struct arc *, value, value); /* catch-all error handler */
 
   /* declarations */
   value declarations;		/* declarations hash */
+
+  /* global functions inlined by the compiler */
+  value inlined;		/* cells of the functions inlined */
+  int applyredef;		/* set once apply is redefined */
+
+  /* macros */
+  value maccache;		/* macro bindings of operator symbols */
+  value macmemo;		/* memoised expansions of pure macros */
+
+  value affs;			/* shared AFFs of C functions (see ARC_AFF) */
+
+  struct arc_module *modules;	/* native modules loaded (see load.c) */
 };
 
+/* Size of the macro binding cache, a power of two */
+#define ARC_MACCACHE_SIZE 256
+
+/* Size of the table of shared AFFs, a power of two */
+#define ARC_AFFS_SIZE 1024
+
 typedef struct arc arc;
 
 extern const char *__arc_typenames[];
@@ -302,12 +332,16 @@ extern Rune arc_strindex(arc *c, value v, int index);
 extern Rune arc_strsetindex(arc *c, value v, int index, Rune ch);
 extern value arc_strcatc(arc *c, value v1, Rune ch);
 extern value arc_substr(arc *c, value s, int sidx, int eidx);
+extern value arc_substrcpy(arc *c, value s, int sidx, int eidx);
 extern value arc_strcat(arc *c, value v1, value v2);
 extern int arc_strcmp(arc *c, value v1, value v2);
 extern void arc_str2cstr(arc *c, value str, char *ptr);
 extern value arc_strutflen(arc *c, value str);
 extern value arc_strchr(arc *c, value str, Rune ch);
+extern unsigned long __arc_strhash_runes(const Rune *p, int len);
+extern int __arc_streq_runes(arc *c, value str, const Rune *p, int len);
 extern int arc_newstring(arc *c, value thr);
+extern int arc_substring(arc *c, value thr);
 
 /* Definitions for vectors */
 #define VECLEN(x) (FIX2INT(REP(x)[0]))
@@ -343,6 +377,7 @@ extern int arc_xhash_increment(arc *c, value thr);
 /* Type handling functions */
 extern typefn_t *__arc_typefn(arc *c, value v);
 extern void __arc_register_typefn(arc *c, enum arc_types type, typefn_t *tfn);
+extern value arc_deftype(arc *c, value tag, typefn_t *tfn);
 extern value arc_type(arc *c, value obj);
 extern value arc_type_compat(arc *c, value obj);
 extern value arc_rep(arc *c, value obj);
@@ -359,9 +394,18 @@ extern int arc_coerce(arc *c, value thr);
 extern value arc_mkccode(arc *c, int argc, value (*cfunc)(),
 			 value name);
 extern value arc_mkaff(arc *c, int (*aff)(arc *, value), value name);
+extern value __arc_aff(arc *c, int (*aff)(arc *, value));
 extern value arc_mkaff2(arc *c, int (*aff)(arc *, value), value name,
 			value env);
+extern value arc_mkaff_nested(arc *c, int (*aff)(arc *, value), value name,
+			      value thr);
+/* An AFF for the C function aff, for places that only need one in
+   order to call it.  They are shared, so nothing must change them. */
+#define ARC_AFF(c, aff) (__arc_aff((c), (aff)))
 extern int __arc_affapply(arc *c, value thr, value ccont, value func, ...);
+extern int __arc_affcall(arc *c, value thr, int line, value func, ...);
+extern int __arc_afftcall(arc *c, value thr, value func, ...);
+extern void __arc_affnosusp(arc *c, value thr, int envsize);
 extern int __arc_affapply2(arc *c, value thr, value ccont, value func,
 			   value args);
 extern int __arc_affyield(arc *c, value thr, int line);
@@ -384,6 +428,7 @@ extern int arc_disp(arc *c, value thr);
 
 /* The reader */
 extern int arc_sread(arc *c, value thr);
+extern value __arc_get_lineno(arc *c, value lndata, value obj);
 extern value __arc_get_fileline(arc *c, value lndata, value obj);
 extern value __arc_reset_lineno(arc *c, value lndata);
 
@@ -417,6 +462,7 @@ extern value arc_cmp(arc *c, value v1, value v2);
 /* Symbols */
 extern value arc_intern(arc *c, value name);
 extern value arc_intern_cstr(arc *c, const char *name);
+extern value arc_intern_runes(arc *c, const Rune *name, int len);
 extern value arc_sym2name(arc *c, value sym);
 extern value arc_unintern(arc *c, value sym);
 extern value arc_bound(arc *c, value sym);
@@ -444,6 +490,7 @@ extern void arc_deinit(arc *c);
 extern void arc_err_cstrfmt(arc *c, const char *fmt, ...);
 extern void arc_err_cstrfmt_line(arc *c, value fileline, const char *fmt, ...);
 extern int arc_callcc(arc *c, value thr);
+extern int arc_callec(arc *c, value thr);
 extern int arc_dynamic_wind(arc *c, value thr);
 extern int arc_err(arc *c, value thr);
 extern int arc_on_err(arc *c, value thr);
@@ -517,12 +564,26 @@ extern value __arc_disasm_inst(arc *c, value *base, value *inst, int *instlen);
  case 0:;
 #define AFEND }
 
+/* The body of an AFF that never suspends, making no AFCALL, AFTCALL,
+   AYIELD or AIOWAIT of its own, may begin with AFLBEGIN instead.  It
+   can then be called directly from other AFFs (see ccode.c).  AFCALL,
+   AFCALL2, AYIELD, AIOWAITR and AIOWAITW will not compile in such a
+   body.  AFTCALL and AFTCALL2 do compile, but the interpreter aborts
+   if such a tail call has to go through the trampoline. */
+#define AFLBEGIN							\
+  __arc_affenv(c, thr, __nargs__, __optargs__, __localvars__, __restarg__); \
+  __arc_affnosusp(c, thr, __nargs__ + __optargs__ + __localvars__	\
+		  + __restarg__);					\
+  {
+
 #define AV(x) (__arc_getenv0(c, thr, x))
 #define WV(x, y) (__arc_putenv0(c, thr, x, y))
 
 #define AFCALL(func, ...)						\
   do {									\
-    return(__arc_affapply(c, thr, __arc_mkcont(c, thr, __LINE__), func, __VA_ARGS__, CLASTARG)); case __LINE__:; \
+    if (__arc_affcall(c, thr, __LINE__, func, __VA_ARGS__, CLASTARG))	\
+      return(TR_FNAPP);							\
+    case __LINE__:;							\
   } while (0)
 
 /* call giving args as a list */
@@ -535,7 +596,7 @@ extern value __arc_disasm_inst(arc *c, value *base, value *inst, int *instlen);
    back to the caller of the function which invoked it. */
 #define AFTCALL(func, ...)					       \
   do {								       \
-    return(__arc_affapply(c, thr, CNIL, func, __VA_ARGS__, CLASTARG)); \
+    return(__arc_afftcall(c, thr, func, __VA_ARGS__, CLASTARG));       \
   } while (0)
 
 /* tail call giving args as a list */
@@ -135,7 +135,7 @@ static AFFDEF(fixnum_pprint)
   strrep = alloca(sizeof(char)*(len+1));
   snprintf(strrep, len+1, "%ld", FIX2INT(AV(sexpr)));
   vstr = arc_mkstringc(c, strrep);
-  AFTCALL(arc_mkaff(c, arc_disp, CNIL), vstr, AV(fp));
+  AFTCALL(ARC_AFF(c, arc_disp), vstr, AV(fp));
   AFEND;
 }
 AFFEND
@@ -194,7 +194,7 @@ static AFFDEF(flonum_pprint)
   outstr = (char *)alloca(sizeof(char)*(len+2));
   snprintf(outstr, len+1, "%g", val);
   vstr = arc_mkstringc(c, outstr);
-  AFTCALL(arc_mkaff(c, arc_disp, CNIL), vstr, AV(fp));
+  AFTCALL(ARC_AFF(c, arc_disp), vstr, AV(fp));
   AFEND;
 }
 AFFEND
@@ -382,7 +382,7 @@ static AFFDEF(complex_pprint)
   outstr = (char *)alloca(sizeof(char)*(len+2));
   snprintf(outstr, len+1, "%g%+gi", creal(val), cimag(val));
   vstr = arc_mkstringc(c, outstr);
-  AFTCALL(arc_mkaff(c, arc_disp, CNIL), vstr, AV(fp));
+  AFTCALL(ARC_AFF(c, arc_disp), vstr, AV(fp));
   AFEND;
 }
 AFFEND
@@ -547,7 +547,7 @@ static AFFDEF(bignum_pprint)
   mpz_get_str(outstr, 10, REPBNUM(AV(n)));
   psv = arc_mkstringc(c, outstr);
   free(outstr);
-  AFTCALL(arc_mkaff(c, arc_disp, CNIL), psv, AV(fp));
+  AFTCALL(ARC_AFF(c, arc_disp), psv, AV(fp));
   AFEND;
 }
 AFFEND
@@ -722,7 +722,7 @@ static AFFDEF(rational_pprint)
   mpq_get_str(outstr, 10, REPRAT(AV(q)));
   psv = arc_mkstringc(c, outstr);
   free(outstr);
-  AFTCALL(arc_mkaff(c, arc_disp, CNIL), psv, AV(fp));
+  AFTCALL(ARC_AFF(c, arc_disp), psv, AV(fp));
   AFEND;
 }
 AFFEND
@@ -1009,18 +1009,6 @@ value arc_mkrationall(arc *c, long num, long den)
 
 #endif
 
-static int hibit(unsigned long n)
-{
-  int ret;
-
-  if (!n)
-    return(0);
-  ret = 1;
-  while (n >>= 1 && n)
-    ret++;
-  return(ret);
-}
-
 value __arc_mul2(arc *c, value arg1, value arg2)
 {
   if (TYPE(arg1) == T_FIXNUM && TYPE(arg2) == T_FIXNUM) {
@@ -1031,7 +1019,7 @@ value __arc_mul2(arc *c, value arg1, value arg2)
 
     /* Check to see if the size of the product will fit in a fixnum.
        Promote to bignum or flonum as needed. */
-    if (hibit(ABS(varg1)) + hibit(ABS(varg2)) >= hibit(FIXNUM_MAX)) {
+    if (!__arc_fixmul_ok(varg1, varg2)) {
 #ifdef HAVE_GMP_H
       return(mul_bignum(c, arc_mkbignuml(c, varg1),
 			arc_mkbignuml(c, varg2)));
@@ -1179,7 +1167,7 @@ AFFDEF(__arc_add2_string)
 {
   AARG(arg1, arg2);
   AFBEGIN;
-  AFCALL(arc_mkaff(c, arc_coerce, CNIL), AV(arg2), ARC_BUILTIN(c, S_STRING));
+  AFCALL(ARC_AFF(c, arc_coerce), AV(arg2), ARC_BUILTIN(c, S_STRING));
   WV(arg2, AFCRV);
   ARETURN(arc_strcat(c, AV(arg1), AV(arg2)));
   AFEND;
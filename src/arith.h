@@ -38,6 +38,19 @@
 #define REPFLO(f) *((double *)REP(f))
 #define REPCPX(z) *((double complex *)REP(z))
 
+/* Fixnums smaller than this in magnitude can always be multiplied
+   together without overflowing a fixnum */
+#define FIXMUL_SMALL (1L << ((sizeof(long)*8 - 2)/2))
+
+/* Tell whether the product of the fixnum values a and b is itself
+   in the range of fixnums */
+static inline int __arc_fixmul_ok(long a, long b)
+{
+  if (ABS(a) < FIXMUL_SMALL && ABS(b) < FIXMUL_SMALL)
+    return(1);
+  return(b == 0 || ABS(a) <= FIXNUM_MAX / ABS(b));
+}
+
 extern value arc_mkflonum(arc *c, double val);
 extern value arc_mkcomplex(arc *c, double complex z);
 extern value arc_mkbignuml(arc *c, long val);
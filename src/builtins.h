@@ -25,7 +25,8 @@ enum {
   BI_io=0,			/* builtin I/O data */
   BI_syms=1,			/* builtin symbols */
   BI_charesc=2,			/* character escapes */
-  BI_last=2
+  BI_tokbuf=3,			/* reader token buffer */
+  BI_last=3
 };
 
 enum builtin_syms {
@@ -92,6 +93,7 @@ enum builtin_syms {
   S_AND,			/* and */
   S_APPLY,			/* apply */
   S_CHAN,			/* chan */
+  S_OMAP,			/* omap */
 
   S_AF_UNIX,			/* AF_UNIX */
   S_AF_INET,			/* AF_INET */
@@ -112,6 +114,12 @@ enum builtin_syms {
   S_SEEK_END,			/* SEEK_END */
   S_LOADPATH,			/* loadpath* */
   S_RXMATCH,			/* regex match */
+  S_LT,				/* < */
+  S_GT,				/* > */
+  S_OPTIMIZE,			/* optimize */
+  S_INLINE_GLOBALS,		/* inline-globals */
+  S_OR,				/* or */
+  S_PURE_MACROS,		/* pure-macros */
 
   S_THE_END			/* end of the line */
 };
@@ -46,6 +46,8 @@ struct cfunc_t {
     } aff_t;
   } cfunc;
   int argc;
+  int nosusp;			/* AFF never suspends (see AFLBEGIN) */
+  int envsize;			/* values in its environment, if so */
 };
 
 static AFFDEF(cfunc_pprint)
@@ -58,8 +60,8 @@ static AFFDEF(cfunc_pprint)
 
   (void)visithash;
   (void)disp;
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
+  WV(wc, ARC_AFF(c, arc_writec));
   AFCALL(AV(dw), arc_mkstringc(c, "#<procedure"), CTRUE, AV(fp), AV(visithash));
   rep = (struct cfunc_t *)REP(AV(sexpr));
   if (!NIL_P(rep->name)) {
@@ -99,6 +101,8 @@ value arc_mkccode(arc *c, int argc, value (*cfunc)(), value name)
   rcfn->name = name;
   rcfn->cfunc.sff = cfunc;
   rcfn->argc = argc;
+  rcfn->nosusp = 0;
+  rcfn->envsize = 0;
   return(cfn);
 }
 
@@ -113,11 +117,49 @@ value arc_mkaff2(arc *c, int (*xaff)(arc *, value), value name, value env)
   return(aff);
 }
 
+/* Make an AFF nested inside the function that thr is running, whose
+   environment becomes the parent environment of the AFF.  As the AFF
+   may well be called after that function returns, or from some other
+   stack chunk, the environment is moved to the heap first. */
+value arc_mkaff_nested(arc *c, int (*xaff)(arc *, value), value name,
+		       value thr)
+{
+  SENVR(thr, __arc_env2heap(c, thr, TENVR(thr)));
+  return(arc_mkaff2(c, xaff, name, TENVR(thr)));
+}
+
 value arc_mkaff(arc *c, int (*xaff)(arc *, value), value name)
 {
   return(arc_mkaff2(c, xaff, name, CNIL));
 }
 
+/* Return the AFF for xaff kept in the table of shared AFFs, making it
+   if it isn't there yet.  The table is an open addressed hash table
+   keyed by the function, which each AFF in it knows.  Should it ever
+   fill up, a new AFF is made each time as by arc_mkaff. */
+value __arc_aff(arc *c, int (*xaff)(arc *, value))
+{
+  unsigned long h;
+  int i, n;
+  value aff;
+
+  if (NIL_P(c->affs))
+    c->affs = arc_mkvector(c, ARC_AFFS_SIZE);
+  h = ((unsigned long)xaff >> 2) * 2654435761UL;
+  for (n=0; n<ARC_AFFS_SIZE; n++) {
+    i = (h + n) & (ARC_AFFS_SIZE-1);
+    aff = XVINDEX(c->affs, i);
+    if (NIL_P(aff)) {
+      aff = arc_mkaff(c, xaff, CNIL);
+      SVINDEX(c->affs, i, aff);
+      return(aff);
+    }
+    if (((struct cfunc_t *)REP(aff))->cfunc.aff_t.aff == xaff)
+      return(aff);
+  }
+  return(arc_mkaff(c, xaff, CNIL));
+}
+
 /* same as below, but with rest arguments */
 static void affenvr(arc *c, value thr, int minenv, int optenv, int dsenv)
 {
@@ -177,17 +219,8 @@ int __arc_affip(arc *c, value thr)
   return(TIP(thr).aff_line);
 }
 
-/* Call a function.  This sets up the thread so that when the AFF returns,
-   the dispatcher will invoke the function that has been set up.  DO NOT
-   USE THIS FUNCTION DIRECTLY.  It should only be used from the AFCALL
-   macro.
-
-   If a null continuation is passed, the function application is processed
-   as a tail call.
- */
-int __arc_affapply(arc *c, value thr, value cont, value func, ...)
+static int affapplyv(arc *c, value thr, value cont, value func, va_list ap)
 {
-  va_list ap;
   value arg;
   int argc=0;
 
@@ -196,14 +229,12 @@ int __arc_affapply(arc *c, value thr, value cont, value func, ...)
      as it is a tail call. */
   if (!NIL_P(cont))
     SCONR(thr, cont);
-  va_start(ap, func);
   /* Push the arguments onto the stack. Look for the CLASTARG sentinel
      value. */
   while ((arg = va_arg(ap, value)) != CLASTARG) {
     argc++;
     CPUSH(thr, arg);
   }
-  va_end(ap);
   /* set the argument count */
   TARGC(thr) = argc;
   /* set the value register to the function to be called */
@@ -214,6 +245,121 @@ int __arc_affapply(arc *c, value thr, value cont, value func, ...)
   return(TR_FNAPP);
 }
 
+/* Call a function.  This sets up the thread so that when the AFF returns,
+   the dispatcher will invoke the function that has been set up.  DO NOT
+   USE THIS FUNCTION DIRECTLY.  It should only be used from the AFCALL
+   macro.
+
+   If a null continuation is passed, the function application is processed
+   as a tail call.
+ */
+int __arc_affapply(arc *c, value thr, value cont, value func, ...)
+{
+  va_list ap;
+  int ret;
+
+  va_start(ap, func);
+  ret = affapplyv(c, thr, cont, func, ap);
+  va_end(ap);
+  return(ret);
+}
+
+/* An AFF whose body begins with AFLBEGIN never suspends, and marks
+   itself as such whenever it is run.  Once it has been, AFCALL and
+   AFTCALL call it directly, as any other C function, with the
+   registers of the caller kept in C variables rather than in a
+   continuation, and without going back to the trampoline.  Nothing
+   may move the caller's stack environment meanwhile, so this is only
+   done if the callee's arguments and environment fit in the current
+   stack chunk.  The size of the environment, as declared by the AFF,
+   is recorded along with the mark. */
+void __arc_affnosusp(arc *c, value thr, int envsize)
+{
+  struct cfunc_t *rcfn = (struct cfunc_t *)REP(TFUNR(thr));
+
+  rcfn->nosusp = 1;
+  rcfn->envsize = envsize;
+}
+
+static int leaf_p(arc *c, value thr, value func, va_list ap)
+{
+  va_list aq;
+  int argc = 0;
+
+  if (TYPE(func) != T_CCODE || !((struct cfunc_t *)REP(func))->nosusp)
+    return(0);
+  va_copy(aq, ap);
+  while (va_arg(aq, value) != CLASTARG)
+    argc++;
+  va_end(aq);
+  /* __arc_mkenv needs two more for the count and the parent */
+  return(TSP(thr) - TSBASE(thr)
+	 >= argc + ((struct cfunc_t *)REP(func))->envsize + 2);
+}
+
+static void leafcall(arc *c, value thr, value func, va_list ap)
+{
+  struct cfunc_t *rcfn = (struct cfunc_t *)REP(func);
+  value funr, envr, *sp, *sfn, arg;
+  int argc, line, n;
+
+  funr = TFUNR(thr);
+  envr = TENVR(thr);
+  sp = TSP(thr);
+  sfn = TSFN(thr);
+  argc = TARGC(thr);
+  line = TIP(thr).aff_line;
+  for (n=0; (arg = va_arg(ap, value)) != CLASTARG; n++)
+    CPUSH(thr, arg);
+  TARGC(thr) = n;
+  SFUNR(thr, func);
+  SENVR(thr, rcfn->cfunc.aff_t.env);
+  TIP(thr).aff_line = 0;
+  TSFN(thr) = TSP(thr) + n;
+  /* An AFLBEGIN body that makes a tail call would leave it pending,
+     and nothing here could ever run it */
+  if (rcfn->cfunc.aff_t.aff(c, thr) != TR_RC)
+    abort();
+  TSP(thr) = sp;
+  TSFN(thr) = sfn;
+  TARGC(thr) = argc;
+  TIP(thr).aff_line = line;
+  SFUNR(thr, funr);
+  SENVR(thr, envr);
+}
+
+/* Used by AFCALL.  Returns zero if func was called directly, with its
+   value in the value register.  Otherwise it sets up the application
+   just as __arc_affapply, with a continuation returning to line. */
+int __arc_affcall(arc *c, value thr, int line, value func, ...)
+{
+  va_list ap;
+  int ret = 0;
+
+  va_start(ap, func);
+  if (leaf_p(c, thr, func, ap))
+    leafcall(c, thr, func, ap);
+  else
+    ret = affapplyv(c, thr, __arc_mkcont(c, thr, line), func, ap);
+  va_end(ap);
+  return(ret);
+}
+
+/* Used by AFTCALL.  Returns the state the trampoline is to go to. */
+int __arc_afftcall(arc *c, value thr, value func, ...)
+{
+  va_list ap;
+  int ret = TR_RC;
+
+  va_start(ap, func);
+  if (leaf_p(c, thr, func, ap))
+    leafcall(c, thr, func, ap);
+  else
+    ret = affapplyv(c, thr, CNIL, func, ap);
+  va_end(ap);
+  return(ret);
+}
+
 int __arc_affapply2(arc *c, value thr, value cont, value func, value argv)
 {
   int argc=0;
@@ -283,6 +429,8 @@ static int cfunc_apply(arc *c, value thr, value cfn)
     TIP(thr).aff_line = 0;	/* start at line 0 (start of function body) */
     SENVR(thr, rcfn->cfunc.aff_t.env); /* parent env */
     SFUNR(thr, cfn);
+    /* the arguments are part of the AFF's stack until __arc_affenv */
+    TSFN(thr) = TSP(thr) + argc;
     /* return to the trampoline and make it resume from the beginning
        of the function now that everything is ready */
     return(TR_RESUME);
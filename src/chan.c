@@ -70,7 +70,7 @@ static AFFDEF(chan_pprint)
   AFBEGIN;
   (void)disp;
   (void)sexpr;
-  AFTCALL(arc_mkaff(c, __arc_disp_write, CNIL), arc_mkstringc(c, "#<chan>"),
+  AFTCALL(ARC_AFF(c, __arc_disp_write), arc_mkstringc(c, "#<chan>"),
 	  CTRUE, AV(fp), AV(visithash));
   AFEND;
 }
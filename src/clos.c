@@ -33,7 +33,7 @@ static AFFDEF(clos_pprint)
   AOARG(visithash);
   AFBEGIN;
 
-  AFTCALL(arc_mkaff(c, __arc_disp_write, CNIL), CLOS_CODE(AV(sexpr)),
+  AFTCALL(ARC_AFF(c, __arc_disp_write), CLOS_CODE(AV(sexpr)),
 	  AV(disp), AV(fp), AV(visithash));
   AFEND;
 }
@@ -50,14 +50,8 @@ value arc_mkclos(arc *c, value code, value env)
 
 static int clos_apply(arc *c, value thr, value clos)
 {
-  value code, env;
-
-  code = CLOS_CODE(clos);
-  env = CLOS_ENV(clos);
   /* Set up the registers to make this code execute */
-  TIPP(thr) = &XVINDEX(CODE_CODE(code), 0);
-  SENVR(thr, env);
-  SFUNR(thr, clos);
+  __arc_clos_enter(thr, clos);
   /* Return to the trampoline to make it resume */
   return(TR_RESUME);
 }
@@ -36,12 +36,21 @@ value arc_mkcctx(arc *c)
   SCCTX_VCPTR(cctx, SCCTX_LITS(cctx, INT2FIX(0)));
   SCCTX_VCODE(cctx, SCCTX_LITS(cctx, CNIL));
   SCCTX_SRC(cctx, CNIL);
+  SCCTX_FRMIN(cctx, CNIL);
+  SCCTX_SELF(cctx, CNIL);
+  SCCTX_INLINING(cctx, CNIL);
+  SCCTX_LITIDX(cctx, CNIL);
+  SCCTX_SCAN(cctx, CNIL);
   return(cctx);
 }
 
-value arc_cctx_mksrc(arc *c, value cctx)
+value arc_cctx_mksrc(arc *c, value cctx, value file)
 {
-  SCCTX_SRC(cctx, arc_mkhash(c, ARC_HASHBITS));
+  value src = arc_mkvector(c, 16);
+
+  SVINDEX(src, 0, INT2FIX(SRC_LINES));
+  SVINDEX(src, SRC_FILENAME, file);
+  SCCTX_SRC(cctx, src);
   return(cctx);
 }
 
@@ -81,16 +90,28 @@ static value __resize_literals(arc *c, value cctx)
 
 #define VMCODEP(cctx) ((Inst *)(&VINDEX(VINDEX(cctx, 1), FIX2INT(VINDEX(cctx, 0)))))
 
-/* Add line number information */
+/* Add line number information.  A new entry is only needed where the
+   line number changes. */
 static void add_lninfo(arc *c, value cctx, value lineno)
 {
-  value src, vptr;
+  value src, vptr, nsrc;
+  int n;
 
   src = CCTX_SRC(cctx);
-  if (NIL_P(src) || !BOUND_P(lineno) || NIL_P(lineno))
+  if (NIL_P(src) || !FIXNUM_P(lineno))
     return;
   vptr = CCTX_VCPTR(cctx);
-  arc_hash_insert(c, src, vptr, lineno);
+  n = FIX2INT(VINDEX(src, 0));
+  if (n > SRC_LINES && VINDEX(src, n-1) == lineno)
+    return;
+  if (n+2 > VECLEN(src)) {
+    nsrc = arc_mkvector(c, 2*VECLEN(src));
+    memcpy(&XVINDEX(nsrc, 0), &XVINDEX(src, 0), n*sizeof(value));
+    SCCTX_SRC(cctx, src = nsrc);
+  }
+  SVINDEX(src, n, vptr);
+  SVINDEX(src, n+1, lineno);
+  SVINDEX(src, 0, INT2FIX(n+2));
 }
 
 void arc_emit(arc *c, value cctx, int inst, value fl)
@@ -177,6 +198,11 @@ int arc_literal(arc *c, value cctx, value literal)
   lidx = lptr;
   SVINDEX(lits, lptr++, (value)literal);
   SCCTX_LPTR(cctx, INT2FIX(lptr));
+  if (LITIDX_P(literal)) {
+    if (NIL_P(CCTX_LITIDX(cctx)))
+      SCCTX_LITIDX(cctx, arc_mkhash(c, ARC_HASHBITS));
+    arc_hash_insert(c, CCTX_LITIDX(cctx), literal, INT2FIX(lidx));
+  }
   return(lidx);
 }
 
@@ -189,18 +215,16 @@ static AFFDEF(code_pprint)
   AFBEGIN;
   (void)visithash;
   (void)disp;
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
+  WV(wc, ARC_AFF(c, arc_writec));
   AFCALL(AV(dw), arc_mkstringc(c, "#<procedure"), CTRUE, AV(fp), AV(visithash));
   src = CODE_SRC(AV(sexpr));
-  if (!NIL_P(src)) {
-    value fname;
-
+  if (!NIL_P(src) && !NIL_P(VINDEX(src, SRC_FUNCNAME))) {
     AFCALL(AV(wc), arc_mkchar(c, ':'), AV(fp));
     AFCALL(AV(wc), arc_mkchar(c, ' '), AV(fp));
     src = CODE_SRC(AV(sexpr));
-    fname = arc_hash_lookup(c, src, INT2FIX(SRC_FUNCNAME));
-    AFCALL(AV(dw), fname, CTRUE, AV(fp), AV(visithash));
+    AFCALL(AV(dw), VINDEX(src, SRC_FUNCNAME), CTRUE, AV(fp),
+	   AV(visithash));
   }
   AFCALL(AV(wc), arc_mkchar(c, '>'), AV(fp));
   ARETURN(CNIL);
@@ -210,10 +234,11 @@ AFFEND
 
 value arc_mkcode(arc *c, int ncodes, int nlits)
 {
-  value code = arc_mkvector(c, nlits+2);
+  value code = arc_mkvector(c, nlits+3);
 
   SCODE_CODE(code, arc_mkvector(c, ncodes));
   SCODE_SRC(code, CNIL);
+  SCODE_INLINE(code, CNIL);
   ((struct cell *)code)->_type = T_CODE;
   return(code);
 }
@@ -243,24 +268,40 @@ value arc_code_setname(arc *c, value code, value name)
     return(CNIL);
   }
   if (NIL_P(CODE_SRC(code))) {
-    SCODE_SRC(code, arc_mkhash(c, ARC_HASHBITS));
+    SCODE_SRC(code, arc_mkvector(c, SRC_LINES));
   }
-  arc_hash_insert(c, CODE_SRC(code), INT2FIX(SRC_FUNCNAME), name);
+  SVINDEX(CODE_SRC(code), SRC_FUNCNAME, name);
   return(orgcode);
 }
 
+/* Get the file and line number of the instruction at ipptr in the
+   closure fun, by binary search of its line number table */
 value __arc_code_lineno(arc *c, value fun, value *ipptr)
 {
-  int vptr;
-  value code;
+  int vptr, lo, hi, mid;
+  value code, src;
 
   if (TYPE(fun) != T_CLOS)
     return(CUNBOUND);
   code = CLOS_CODE(fun);
-  if (TYPE(CODE_SRC(code)) != T_TABLE)
+  src = CODE_SRC(code);
+  if (NIL_P(src) || VECLEN(src) <= SRC_LINES)
     return(CUNBOUND);
   vptr = ipptr - &XVINDEX(CODE_CODE(code), 0);
-  return(arc_hash_lookup(c, CODE_SRC(code), INT2FIX(vptr)));
+  /* find the last pair whose offset is not past vptr */
+  lo = 0;
+  hi = (VECLEN(src) - SRC_LINES)/2;
+  while (hi - lo > 1) {
+    mid = (lo + hi)/2;
+    if (FIX2INT(VINDEX(src, SRC_LINES + 2*mid)) <= vptr)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  if (FIX2INT(VINDEX(src, SRC_LINES + 2*lo)) > vptr)
+    return(CUNBOUND);
+  return(cons(c, VINDEX(src, SRC_FILENAME),
+	      VINDEX(src, SRC_LINES + 2*lo + 1)));
 }
 
 value arc_cctx2code(arc *c, value cctx)
@@ -272,7 +313,17 @@ value arc_cctx2code(arc *c, value cctx)
 	 FIX2INT(CCTX_VCPTR(cctx))*sizeof(value));
   memcpy(&XCODE_LITERAL(func, 0), &XVINDEX(CCTX_LITS(cctx), 0),
 	 FIX2INT(CCTX_LPTR(cctx))*sizeof(value));
-  SCODE_SRC(func, CCTX_SRC(cctx));
+  /* Without any line numbers, the file name alone is of no use */
+  if (!NIL_P(CCTX_SRC(cctx))
+      && FIX2INT(VINDEX(CCTX_SRC(cctx), 0)) > SRC_LINES) {
+    value src = CCTX_SRC(cctx), nsrc;
+    int n = FIX2INT(VINDEX(src, 0));
+
+    nsrc = arc_mkvector(c, n);
+    memcpy(&XVINDEX(nsrc, SRC_FILENAME), &XVINDEX(src, SRC_FILENAME),
+	   (n - SRC_FILENAME)*sizeof(value));
+    SCODE_SRC(func, nsrc);
+  }
   return(func);
 }
 
@@ -21,12 +21,24 @@
 #include "vmengine.h"
 #include "compiler.h"
 #include "hash.h"
+#include "arith.h"
 
 /* Get the closest line number for obj */
 static value get_lineno(arc *c, value obj)
 {
   value lndata;
 
+  lndata = arc_cmark(c, ARC_BUILTIN(c, S_LNDATA));
+  if (NIL_P(lndata))
+    return(CUNBOUND);
+  return(__arc_get_lineno(c, lndata, obj));
+}
+
+/* Get the file and the closest line number for obj, for error messages */
+static value get_fileline(arc *c, value obj)
+{
+  value lndata;
+
   lndata = arc_cmark(c, ARC_BUILTIN(c, S_LNDATA));
   if (NIL_P(lndata))
     return(CUNBOUND);
@@ -34,16 +46,122 @@ static value get_lineno(arc *c, value obj)
 }
 
 /* Given a symbol op, return the macro corresponding to it, if any.  If
-   it is not a macro, return nil. */
-static int ismacro(arc *c, value op)
+   it is not a macro, return nil.  What is found is kept in a cache
+   indexed by the symbol, and arc_bindsym removes the symbol from the
+   cache whenever it is bound to something else. */
+static value ismacro(arc *c, value op)
 {
-  while (arc_type(c, op = arc_hash_lookup(c, c->genv, op)) == T_SYMBOL)
-    ;
-  if (arc_type(c, op) == ARC_BUILTIN(c, S_MAC))
-    return(op);
-  return(CNIL);
+  value mac;
+  int i;
+
+  i = (SYM2ID(op) & (ARC_MACCACHE_SIZE-1))*2;
+  if (NIL_P(c->maccache))
+    c->maccache = arc_mkvector(c, ARC_MACCACHE_SIZE*2);
+  else if (VINDEX(c->maccache, i) == op)
+    return(VINDEX(c->maccache, i+1));
+  mac = arc_hash_lookup(c, c->genv, op);
+  if (arc_type(c, mac) != ARC_BUILTIN(c, S_MAC))
+    mac = CNIL;
+  SVINDEX(c->maccache, i, op);
+  SVINDEX(c->maccache, i+1, mac);
+  return(mac);
+}
+
+/* Expansions of the macros named by the pure-macros declaration are
+   memoised.  Such macros promise to always expand equal forms into
+   equal expansions, and that nothing modifies their expansions.  The
+   memo is a hash table from a hash of a form to a list of the forms
+   with that hash and their expansions.  Only forms with no more than
+   MEMO_MAXSIZE conses and atoms, all of them atoms that can be hashed,
+   are memoised.  The memo is dropped whenever one of the macros is
+   redefined (see arc_bindsym) or the declaration is changed, and
+   when it grows past MEMO_MAXFORMS forms. */
+#define MEMO_MAXSIZE 256
+#define MEMO_MAXFORMS 4096
+
+static int pure_macro(arc *c, value op)
+{
+  value pure;
+
+  for (pure = arc_hash_lookup(c, c->declarations,
+			      ARC_BUILTIN(c, S_PURE_MACROS));
+       CONS_P(pure); pure = cdr(pure)) {
+    if (car(pure) == op)
+      return(1);
+  }
+  return(0);
 }
 
+static int form_hash(arc *c, value form, unsigned long *hv, int *size)
+{
+  if (++*size > MEMO_MAXSIZE)
+    return(0);
+  if (CONS_P(form)) {
+    *hv = *hv * 31 + 1;
+    return(form_hash(c, car(form), hv, size)
+	   && form_hash(c, cdr(form), hv, size));
+  }
+  if (NIL_P(form) || form == CTRUE) {
+    *hv = *hv * 31 + form;
+    return(1);
+  }
+  if (!FIXNUM_P(form) && !LITIDX_P(form))
+    return(0);
+  *hv = *hv * 31 + arc_hash(c, form);
+  return(1);
+}
+
+static int form_equal(arc *c, value f1, value f2)
+{
+  while (CONS_P(f1) && CONS_P(f2)) {
+    if (!form_equal(c, car(f1), car(f2)))
+      return(0);
+    f1 = cdr(f1);
+    f2 = cdr(f2);
+  }
+  return(arc_is2(c, f1, f2) == CTRUE);
+}
+
+/* Return the key of the form e in the memo, or CUNBOUND if its
+   expansion is not to be memoised */
+static value memo_key(arc *c, value e)
+{
+  unsigned long hv = 0;
+  int size = 0;
+
+  if (!pure_macro(c, car(e)) || !form_hash(c, e, &hv, &size))
+    return(CUNBOUND);
+  return(INT2FIX(hv >> 2));
+}
+
+/* Expand the form e by applying the macro mac to its arguments, unless
+   its expansion is in the memo */
+static AFFDEF(expand)
+{
+  AARG(mac, e);
+  AVAR(key);
+  value x;
+  AFBEGIN;
+  WV(key, memo_key(c, AV(e)));
+  if (BOUND_P(AV(key)) && !NIL_P(c->macmemo)) {
+    for (x = arc_hash_lookup(c, c->macmemo, AV(key)); CONS_P(x); x = cdr(x)) {
+      if (form_equal(c, car(car(x)), AV(e)))
+	ARETURN(cdr(car(x)));
+    }
+  }
+  AFCALL2(arc_rep(c, AV(mac)), cdr(AV(e)));
+  if (BOUND_P(AV(key))) {
+    if (NIL_P(c->macmemo) || arc_hash_length(c, c->macmemo) >= MEMO_MAXFORMS)
+      c->macmemo = arc_mkhash(c, ARC_HASHBITS);
+    x = arc_hash_lookup(c, c->macmemo, AV(key));
+    x = cons(c, cons(c, AV(e), AFCRV), (BOUND_P(x)) ? x : CNIL);
+    arc_hash_insert(c, c->macmemo, AV(key), x);
+  }
+  ARETURN(AFCRV);
+  AFEND;
+}
+AFFEND
+
 /* Macro expansion.  This will look for any macro applications in e
    and attempt to expand them.
 
@@ -80,7 +198,7 @@ static AFFDEF(macex)
     if (NIL_P(AV(op)))
       ARETURN(AV(e));		/* not a macro */
 
-    AFCALL2(arc_rep(c, AV(op)), cdr(AV(e)));
+    AFCALL(ARC_AFF(c, expand), AV(op), AV(e));
     WV(expansion, AFCRV);
     WV(e, AV(expansion));
   } while (AV(once) == CTRUE);
@@ -98,12 +216,21 @@ static value compile_continuation(arc *c, value ctx, value cont)
 extern void __arc_print_string(arc *c, value ppstr);
 
 /* Find a literal lit in ctx.  If not found, create it and add it to the
-   literals in the ctx. */
+   literals in the ctx.  Most literals can be found in the literal index
+   of the ctx, and only those of other types are searched for among all
+   the literals. */
 static value find_literal(arc *c, value ctx, value lit)
 {
-  value lits;
+  value lits, lidx;
   int i;
 
+  if (LITIDX_P(lit)) {
+    if (!NIL_P(CCTX_LITIDX(ctx))
+	&& BOUND_P(lidx = arc_hash_lookup(c, CCTX_LITIDX(ctx), lit)))
+      return(lidx);
+    return(INT2FIX(arc_literal(c, ctx, lit)));
+  }
+
   lits = CCTX_LITS(ctx);
   if (!NIL_P(lits)) {
     for (i=0; i<VECLEN(lits); i++) {
@@ -130,16 +257,103 @@ static value compile_literal(arc *c, value lit, value ctx, value cont)
   return(compile_continuation(c, ctx, cont));
 }
 
+/* Flat closures.  A fn none of whose variables from outside it are
+   ever assigned need not share the environments it was made in: its
+   closure may instead be given a heap environment of its own holding
+   just the values of the variables it references, made by an iclsf
+   instruction, so that the environments it was made in stay on the
+   stack.  Whether any variable is ever assigned is found out by
+   scan_fn before the outermost fn around it is compiled.
+
+   Such a fn is compiled in an environment whose last frame is a flat
+   frame, mapping FLAT_ENV to (env . scan), where env is the
+   environment the fn is made in and scan what scan_fn found.  A
+   variable of env is captured, i.e. given the next index in the flat
+   frame, the first time it is looked up, after which compile_fn loads
+   the captured variables for iclsf in the order of their indices.
+   Should a variable turn out not to be capturable after all, the
+   flat frame maps FLAT_FAIL to t, and compile_fn compiles the fn
+   again, this time to be made with icls. */
+#define FLAT_ENV INT2FIX(-2)
+#define FLAT_FAIL INT2FIX(-3)
+
+/* A rest parameter that a fn does nothing with but pass on as the
+   last argument of apply is not made into a list.  The envl
+   instruction leaves the extra arguments in the environment of the
+   fn, and the applications of apply become iapplyr instructions that
+   push them straight back onto the stack.  The compiler frame of such
+   a fn maps LAZY_REST to the name of the rest parameter.  Whether the
+   parameter may be lazy is decided before any code for the fn is
+   generated (see lazy_rest), so that decision has to be a
+   conservative one. */
+#define LAZY_REST INT2FIX(-1)
+
+/* The parts of what scan_fn finds out */
+#define SCAN_ASSIGNED 0		/* variables ever assigned */
+#define SCAN_BOUND 1		/* variables bound by fns scanned */
+#define SCAN_FNS 2		/* fns, and their variables from outside */
+#define SCAN_EXPS 3		/* macro forms, and their expansions */
+#define SCAN_SIZE 4
+
+/* Forms are keyed by their address in SCAN_FNS and SCAN_EXPS, and
+   kept along with what is found about them, i.e. (form . data), to
+   tell them apart from forms that have since been collected. */
+static value scan_lookup(arc *c, value scan, int part, value form)
+{
+  value x;
+
+  x = arc_hash_lookup(c, VINDEX(scan, part), INT2FIX(form >> 3));
+  return((CONS_P(x) && car(x) == form) ? cdr(x) : CUNBOUND);
+}
+
+static void scan_insert(arc *c, value scan, int part, value form,
+			value data)
+{
+  arc_hash_insert(c, VINDEX(scan, part), INT2FIX(form >> 3),
+		  cons(c, form, data));
+}
+
+/* Tell whether var, bound by the compiler frame frame, may be
+   captured by a flat closure.  It has to have been bound by a fn
+   that was scanned, and never assigned, and not be a lazy rest
+   parameter, the values of which are not kept in the variable. */
+static int capturable(arc *c, value scan, value var, value frame)
+{
+  return(arc_hash_lookup(c, VINDEX(scan, SCAN_BOUND), var) == CTRUE
+	 && !BOUND_P(arc_hash_lookup(c, VINDEX(scan, SCAN_ASSIGNED), var))
+	 && arc_hash_lookup(c, frame, LAZY_REST) != var);
+}
+
+/* Capture var, bound by the compiler frame owner, in the flat frame
+   frame, and return its index there */
+static int capture(arc *c, value frame, value var, value owner)
+{
+  int n;
+
+  if (!capturable(c, cdr(arc_hash_lookup(c, frame, FLAT_ENV)), var,
+		  owner)) {
+    arc_hash_insert(c, frame, FLAT_FAIL, CTRUE);
+    return(0);
+  }
+  for (n=0; BOUND_P(arc_hash_lookup(c, frame, INT2FIX(n))); n++)
+    ;
+  arc_hash_insert(c, frame, var, INT2FIX(n));
+  arc_hash_insert(c, frame, INT2FIX(n), var);
+  return(n);
+}
+
 /* Find the symbol var in the environment env.  Each environment frame
    as represented by the compiler is simply a list of hash tables, each
    hash table key being a symbol name, and each value being the index
    inside the environment frame.  Returns CNIL if var is a name unbound
    in the current set of environments.  Returns CTRUE otherwise, and sets
    frameno to the frame number of the environment, and idx to the index in
-   that environment.  */
+   that environment.  A variable from outside a flat frame is captured
+   in it, even if it is only being asked whether var is local, which
+   at worst captures a variable needlessly. */
 static value find_var(arc *c, value var, value env, int *frameno, int *idx)
 {
-  value vidx;
+  value vidx, outer;
   int fnum;
 
   for (fnum=0; env; env = cdr(env), fnum++) {
@@ -148,10 +362,51 @@ static value find_var(arc *c, value var, value env, int *frameno, int *idx)
       *idx = FIX2INT(vidx);
       return(CTRUE);
     }
+    outer = arc_hash_lookup(c, car(env), FLAT_ENV);
+    if (BOUND_P(outer)) {
+      if (find_var(c, var, car(outer), frameno, idx) == CNIL)
+	return(CNIL);
+      for (outer = car(outer); *frameno > 0; (*frameno)--)
+	outer = cdr(outer);
+      *frameno = fnum;
+      *idx = capture(c, car(env), var, car(outer));
+      return(CTRUE);
+    }
   }
   return(CNIL);
 }
 
+/* Return the frame of env in which var is bound, or nil if it is a
+   global variable */
+static value var_frame(arc *c, value var, value env)
+{
+  int frameno, idx;
+
+  if (find_var(c, var, env, &frameno, &idx) == CNIL)
+    return(CNIL);
+  while (frameno-- > 0)
+    env = cdr(env);
+  return(car(env));
+}
+
+/* Record that the code being compiled in ctx references frame number
+   frameno of env.  The frame is stored counting from the outermost
+   frame of env so that compile_fn can compare it against the depth
+   at which the fn was defined and tell whether the closure it makes
+   needs the enclosing environment or not. */
+static void note_frame(arc *c, value ctx, value env, int frameno)
+{
+  int depth;
+  value frmin;
+
+  for (depth=0; env; env = cdr(env))
+    depth++;
+  depth -= frameno + 1;
+  frmin = CCTX_FRMIN(ctx);
+  if (NIL_P(frmin) || depth < FIX2INT(frmin))
+    SCCTX_FRMIN(ctx, INT2FIX(depth));
+}
+
 static value compile_ident(arc *c, value ident, value ctx, value env,
 			   value cont)
 {
@@ -160,6 +415,7 @@ static value compile_ident(arc *c, value ident, value ctx, value env,
   /* look for the variable in the environment first */
   level = offset = 0;
   if (find_var(c, ident, env, &level, &offset) == CTRUE) {
+    note_frame(c, ctx, env, level);
     if (level == 0) {
       arc_emit1(c, ctx, ilde0, INT2FIX(offset),
 		get_lineno(c, CNIL));
@@ -176,6 +432,134 @@ static value compile_ident(arc *c, value ident, value ctx, value env,
 
 }
 
+/* The optimizer.  Unless the optimize declaration is turned off
+   (which the --no-opt switch of the REPL does), the compiler folds
+   arithmetic and comparisons whose operands are all numeric
+   constants, does not generate code for the arms of an if that can
+   never be reached, and drops pushes that are immediately popped. */
+static int optimizing(arc *c)
+{
+  return(arc_declared(c, ARC_BUILTIN(c, S_OPTIMIZE)) == CTRUE);
+}
+
+/* Tell whether op is one of the builtin operators that can be folded
+   at compile time.  It cannot be folded if it has been shadowed by a
+   local variable, and the comparisons, which are not inlined, cannot
+   be folded if they have been redefined. */
+static int foldable_op(arc *c, value op, value env)
+{
+  int frameno, idx;
+
+  if (!SYMBOL_P(op) || find_var(c, op, env, &frameno, &idx) == CTRUE)
+    return(0);
+  if (op == ARC_BUILTIN(c, S_PLUS) || op == ARC_BUILTIN(c, S_MINUS)
+      || op == ARC_BUILTIN(c, S_TIMES) || op == ARC_BUILTIN(c, S_DIV))
+    return(1);
+  if (op == ARC_BUILTIN(c, S_LT) || op == ARC_BUILTIN(c, S_GT)
+      || op == ARC_BUILTIN(c, S_IS))
+    return(TYPE(arc_gbind(c, op)) == T_CCODE);
+  return(0);
+}
+
+#define REAL_P(x) (NUMERIC_P(x) && TYPE(x) != T_COMPLEX)
+
+/* Apply the foldable operator op to the list of numeric constants
+   args.  Returns CUNBOUND if the application should rather be left
+   for run time, e.g. because it would raise an error. */
+static value fold_op(arc *c, value op, value args)
+{
+  value acc, x;
+
+  if (op == ARC_BUILTIN(c, S_PLUS) || op == ARC_BUILTIN(c, S_TIMES)) {
+    int plus = (op == ARC_BUILTIN(c, S_PLUS));
+
+    acc = INT2FIX(plus ? 0 : 1);
+    for (; args; args = cdr(args))
+      acc = (plus) ? __arc_add2(c, acc, car(args))
+	: __arc_mul2(c, acc, car(args));
+    return(acc);
+  }
+
+  if (op == ARC_BUILTIN(c, S_MINUS) || op == ARC_BUILTIN(c, S_DIV)) {
+    if (NIL_P(args))
+      return(CUNBOUND);
+    if (op == ARC_BUILTIN(c, S_MINUS)) {
+      if (NIL_P(cdr(args)))
+	return(__arc_neg(c, car(args)));
+      for (acc = car(args), args = cdr(args); args; args = cdr(args))
+	acc = __arc_sub2(c, acc, car(args));
+      return(acc);
+    }
+    acc = (NIL_P(cdr(args))) ? INT2FIX(1) : car(args);
+    for (x = (NIL_P(cdr(args))) ? args : cdr(args); x; x = cdr(x)) {
+      if (!REAL_P(car(x)) || FIX2INT(arc_numcmp(c, car(x), INT2FIX(0))) == 0)
+	return(CUNBOUND);
+      acc = __arc_div2(c, acc, car(x));
+    }
+    return(acc);
+  }
+
+  /* comparisons */
+  if (NIL_P(args) || NIL_P(cdr(args)))
+    return(CUNBOUND);
+  for (; cdr(args); args = cdr(args)) {
+    if (op == ARC_BUILTIN(c, S_IS)) {
+      if (NIL_P(arc_is2(c, car(args), cadr(args))))
+	return(CNIL);
+      continue;
+    }
+    if (!REAL_P(car(args)) || !REAL_P(cadr(args)))
+      return(CUNBOUND);
+    x = arc_cmp(c, car(args), cadr(args));
+    if ((op == ARC_BUILTIN(c, S_LT) && FIX2INT(x) >= 0)
+	|| (op == ARC_BUILTIN(c, S_GT) && FIX2INT(x) <= 0))
+      return(CNIL);
+  }
+  return(CTRUE);
+}
+
+/* Fold the constant parts of expr, an expression whose macros and
+   ssyntax have already been expanded.  Returns a numeric constant or
+   t or nil if all of expr could be folded, a new expression if only
+   some of its arguments could be, or expr itself otherwise. */
+static value fold_consts(arc *c, value expr, value env)
+{
+  value args, nargs, arg, folded;
+  int changed = 0, allconst = 1;
+
+  if (!CONS_P(expr) || !foldable_op(c, car(expr), env))
+    return(expr);
+  nargs = CNIL;
+  for (args = cdr(expr); CONS_P(args); args = cdr(args)) {
+    arg = fold_consts(c, car(args), env);
+    changed |= (arg != car(args));
+    allconst &= NUMERIC_P(arg);
+    nargs = cons(c, arg, nargs);
+  }
+  if (!NIL_P(args))
+    return(expr);
+  nargs = arc_list_reverse(c, nargs);
+  if (allconst && BOUND_P(folded = fold_op(c, car(expr), nargs)))
+    return(folded);
+  return((changed) ? cons(c, car(expr), nargs) : expr);
+}
+
+/* Tell whether the test expr of an if is constant.  Returns CTRUE
+   if it is always true, CNIL if it is always false, and CUNBOUND if
+   it cannot be known until run time. */
+static value const_test(arc *c, value expr, value env)
+{
+  expr = fold_consts(c, expr, env);
+  if (NIL_P(expr) || expr == ARC_BUILTIN(c, S_NIL))
+    return(CNIL);
+  if (LITERAL_P(expr))
+    return(CTRUE);
+  if (CONS_P(expr) && car(expr) == ARC_BUILTIN(c, S_QUOTE)
+      && CONS_P(cdr(expr)))
+    return(NIL_P(cadr(expr)) ? CNIL : CTRUE);
+  return(CUNBOUND);
+}
+
 static AFFDEF(compile_if)
 {
   AARG(args, ctx, env, cont);
@@ -190,22 +574,46 @@ static AFFDEF(compile_if)
   /* If the next is the end of the line, compile the tail end if no
      additional */
   if (NIL_P(cdr(AV(args)))) {
-    AFTCALL(arc_mkaff(c, arc_compile, CNIL), car(AV(args)), AV(ctx),
+    AFTCALL(ARC_AFF(c, arc_compile), car(AV(args)), AV(ctx),
 	    AV(env), AV(cont));
   }
 
+  /* If the conditional is a constant, only one of the portions can
+     ever be reached, so compile only that one. */
+  if (optimizing(c)) {
+    value test = const_test(c, car(AV(args)), AV(env));
+
+    if (test == CTRUE)
+      AFTCALL(ARC_AFF(c, arc_compile), cadr(AV(args)), AV(ctx),
+	      AV(env), AV(cont));
+    if (NIL_P(test))
+      AFTCALL(ARC_AFF(c, compile_if), cddr(AV(args)), AV(ctx),
+	      AV(env), AV(cont));
+  }
+
   /* In the final case, we have the conditional (car), the then portion
      (cadr), and the else portion (cddr). */
   /* First, compile the conditional */
-  AFCALL(arc_mkaff(c, arc_compile, CNIL), car(AV(args)), AV(ctx),
+  AFCALL(ARC_AFF(c, arc_compile), car(AV(args)), AV(ctx),
 	 AV(env), CNIL);
   /* this jump address will be the address of the jf instruction
      which we are about to generate.  We have to patch it with the
      address of the start of the else portion once we know it. */
   WV(jumpaddr, CCTX_VCPTR(AV(ctx)));
   arc_emit1(c, AV(ctx), ijf, INT2FIX(0), get_lineno(c, AV(args)));
+  /* In tail position, the then portion can return by itself (and
+     any call it ends in is a tail call) instead of jumping to the
+     return at the end. */
+  if (optimizing(c) && !NIL_P(AV(cont))) {
+    AFCALL(ARC_AFF(c, arc_compile), cadr(AV(args)), AV(ctx),
+	   AV(env), AV(cont));
+    arc_jmpoffset(c, AV(ctx), FIX2INT(AV(jumpaddr)),
+		  FIX2INT(CCTX_VCPTR(AV(ctx))));
+    AFTCALL(ARC_AFF(c, compile_if), cddr(AV(args)), AV(ctx),
+	    AV(env), AV(cont));
+  }
   /* compile the then portion */
-  AFCALL(arc_mkaff(c, arc_compile, CNIL), cadr(AV(args)), AV(ctx),
+  AFCALL(ARC_AFF(c, arc_compile), cadr(AV(args)), AV(ctx),
 	 AV(env), CNIL);
   /* This second jump target should be patched with the address of the
      unconditional jump at the end.  It should be patched after the else
@@ -218,7 +626,7 @@ static AFFDEF(compile_if)
 		FIX2INT(CCTX_VCPTR(AV(ctx))));
   /* compile the else portion, which should be treated as though it were
      an if as well */
-  AFCALL(arc_mkaff(c, compile_if, CNIL), cddr(AV(args)), AV(ctx),
+  AFCALL(ARC_AFF(c, compile_if), cddr(AV(args)), AV(ctx),
 	 AV(env), AV(cont));
   /* Fix the target address of the conditional jump at the end of the
      then portion (jumpaddr2) */
@@ -272,7 +680,7 @@ static AFFDEF(destructure)
   }
 
   if (TYPE(AV(arg)) != T_CONS) {
-    arc_err_cstrfmt_line(c, get_lineno(c, AV(arg)), "invalid fn arg");
+    arc_err_cstrfmt_line(c, get_fileline(c, AV(arg)), "invalid fn arg");
     ARETURN(AV(idx));
   }
 
@@ -284,7 +692,7 @@ static AFFDEF(destructure)
       value oargname, oargdef;
       oargname = cadr(AV(arg));
       if (!SYMBOL_P(oargname)) {
-	arc_err_cstrfmt_line(c, get_lineno(c, car(AV(arg))),
+	arc_err_cstrfmt_line(c, get_fileline(c, car(AV(arg))),
 			     "optional arg is not an identifier");
 	ARETURN(AV(idx));
       }
@@ -292,7 +700,7 @@ static AFFDEF(destructure)
       WV(jumpaddr, CCTX_VCPTR(AV(ctx)));
       arc_emit1(c, AV(ctx), ijbnd, INT2FIX(0), get_lineno(c, AV(arg)));
       /* compile the optional argument's definition */
-      AFCALL(arc_mkaff(c, arc_compile, CNIL), oargdef, AV(ctx), AV(env), CNIL);
+      AFCALL(ARC_AFF(c, arc_compile), oargdef, AV(ctx), AV(env), CNIL);
       arc_jmpoffset(c, AV(ctx), FIX2INT(AV(jumpaddr)), 
 		    FIX2INT(CCTX_VCPTR(AV(ctx))));
       arc_emit1(c, AV(ctx), iste0, AV(idx), get_lineno(c, AV(arg)));
@@ -307,20 +715,20 @@ static AFFDEF(destructure)
   if (!NIL_P(car(AV(arg))) && !NIL_P(cdr(AV(arg)))) {
     arc_emit(c, AV(ctx), ipush, get_lineno(c, AV(arg)));
     arc_emit(c, AV(ctx), idcar, get_lineno(c, AV(arg)));
-    AFCALL(arc_mkaff(c, destructure, CNIL), car(AV(arg)), AV(ctx),
+    AFCALL(ARC_AFF(c, destructure), car(AV(arg)), AV(ctx),
 	   AV(env), AV(idx), CTRUE);
     WV(idx, AFCRV);
     arc_emit(c, AV(ctx), ipop, get_lineno(c, AV(arg)));
     arc_emit(c, AV(ctx), idcdr, get_lineno(c, AV(arg)));
-    AFTCALL(arc_mkaff(c, destructure, CNIL), cdr(AV(arg)), AV(ctx),
+    AFTCALL(ARC_AFF(c, destructure), cdr(AV(arg)), AV(ctx),
 	    AV(env), AV(idx), CNIL);
   } else if (!NIL_P(car(AV(arg))) && NIL_P(cdr(AV(arg)))) {
     arc_emit(c, AV(ctx), idcar, get_lineno(c, AV(arg)));
-    AFTCALL(arc_mkaff(c, destructure, CNIL), car(AV(arg)), AV(ctx),
+    AFTCALL(ARC_AFF(c, destructure), car(AV(arg)), AV(ctx),
 	    AV(env), AV(idx), CTRUE);
   } else if (NIL_P(car(AV(arg))) && !NIL_P(cdr(AV(arg)))) {
     arc_emit(c, AV(ctx), idcdr, get_lineno(c, AV(arg)));
-    AFTCALL(arc_mkaff(c, destructure, CNIL), cdr(AV(arg)), AV(ctx),
+    AFTCALL(ARC_AFF(c, destructure), cdr(AV(arg)), AV(ctx),
 	    AV(env), AV(idx));
   }
   ARETURN(AV(idx));
@@ -343,6 +751,7 @@ AFFEND
 static AFFDEF(compile_args)
 {
   AARG(args, ctx, env);
+  AOARG(lazy);
   AVAR(nframe, envptr, jumpaddr, dsb, oldidx);
   AVAR(regargs, dsbargs, optargs, idx, optargbegin);
   AFBEGIN;
@@ -356,14 +765,20 @@ static AFFDEF(compile_args)
        name and a list containing the name of the sole argument. */
     WV(nframe, arc_mkhash(c, ARC_HASHBITS));
     add_env_name(c, AV(nframe), AV(args), INT2FIX(0));
-    arc_emit3(c, AV(ctx), ienvr, INT2FIX(0), INT2FIX(0), INT2FIX(0),
-	      get_lineno(c, AV(args)));
+    if (BOUND_P(AV(lazy)) && !NIL_P(AV(lazy))) {
+      arc_hash_insert(c, AV(nframe), LAZY_REST, AV(args));
+      arc_emit3(c, AV(ctx), ienvl, INT2FIX(0), INT2FIX(0), INT2FIX(0),
+		get_lineno(c, AV(args)));
+    } else {
+      arc_emit3(c, AV(ctx), ienvr, INT2FIX(0), INT2FIX(0), INT2FIX(0),
+		get_lineno(c, AV(args)));
+    }
     WV(env, cons(c, AV(nframe), AV(env)));
     ARETURN(AV(env));
   }
 
   if (!CONS_P(AV(args))) {
-    arc_err_cstrfmt_line(c, get_lineno(c, AV(args)), "invalid fn arg");
+    arc_err_cstrfmt_line(c, get_fileline(c, AV(args)), "invalid fn arg");
     ARETURN(AV(env));
   }
 
@@ -381,7 +796,7 @@ static AFFDEF(compile_args)
   for (;;) {
     if (SYMBOL_P(car(AV(args)))) {
       if (AV(optargbegin) == CTRUE) {
-	arc_err_cstrfmt_line(c, get_lineno(c, AV(args)),
+	arc_err_cstrfmt_line(c, get_fileline(c, AV(args)),
 			     "non-optional arg found after optional args");
 	ARETURN(AV(env));
       }
@@ -398,7 +813,7 @@ static AFFDEF(compile_args)
       oarg = car(AV(args));
       oargname = cadr(oarg);
       if (!SYMBOL_P(oargname)) {
-	arc_err_cstrfmt_line(c, get_lineno(c, oarg),
+	arc_err_cstrfmt_line(c, get_fileline(c, oarg),
 			     "optional arg is not an identifier");
 	ARETURN(AV(env));
       }
@@ -409,7 +824,7 @@ static AFFDEF(compile_args)
       WV(jumpaddr, CCTX_VCPTR(AV(ctx)));
       arc_emit1(c, AV(ctx), ijbnd, INT2FIX(0), get_lineno(c, oarg));
       /* compile the optional argument's definition */
-      AFCALL(arc_mkaff(c, arc_compile, CNIL), oargdef, AV(ctx), AV(env), CNIL);
+      AFCALL(ARC_AFF(c, arc_compile), oargdef, AV(ctx), AV(env), CNIL);
       arc_emit1(c, AV(ctx), iste0, AV(idx),
 		get_lineno(c, car(AV(args))));
       arc_jmpoffset(c, AV(ctx), FIX2INT(AV(jumpaddr)), 
@@ -430,15 +845,20 @@ static AFFDEF(compile_args)
       FIXINC(idx);
       FIXINC(regargs);
     } else {
-      arc_err_cstrfmt_line(c, get_lineno(c, AV(args)), "invalid fn arg");
+      arc_err_cstrfmt_line(c, get_fileline(c, AV(args)), "invalid fn arg");
       ARETURN(AV(env));
     }
 
     if (SYMBOL_P(cdr(AV(args)))) {
       /* rest arg */
       add_env_name(c, AV(nframe), cdr(AV(args)), AV(idx));
-      /* change to envr instr. */
-      SVINDEX(CCTX_VCODE(AV(ctx)), FIX2INT(AV(envptr)), INT2FIX(ienvr));
+      /* change to envr instr., or envl if the rest arg may be lazy */
+      if (BOUND_P(AV(lazy)) && !NIL_P(AV(lazy))) {
+	arc_hash_insert(c, AV(nframe), LAZY_REST, cdr(AV(args)));
+	SVINDEX(CCTX_VCODE(AV(ctx)), FIX2INT(AV(envptr)), INT2FIX(ienvl));
+      } else {
+	SVINDEX(CCTX_VCODE(AV(ctx)), FIX2INT(AV(envptr)), INT2FIX(ienvr));
+      }
       FIXINC(idx);
       break;
     } else if (NIL_P(cdr(AV(args)))) {
@@ -457,7 +877,7 @@ static AFFDEF(compile_args)
     arc_emit1(c, AV(ctx), ilde0, cdr(elem), get_lineno(c, AV(args)));
     /* ... then we generate car and cdr instructions to reach each of
        the names to which we do the destructuring. */
-    AFCALL(arc_mkaff(c, destructure, CNIL),
+    AFCALL(ARC_AFF(c, destructure),
 	   car(elem), AV(ctx), AV(env), AV(idx));
     WV(idx, AFCRV);
     WV(dsb, cdr(AV(dsb)));
@@ -474,43 +894,418 @@ static AFFDEF(compile_args)
 }
 AFFEND
 
+/* Tell whether the argument list args has only ordinary arguments */
+static int simple_args(arc *c, value args)
+{
+  for (; CONS_P(args); args = cdr(args)) {
+    if (!SYMBOL_P(car(args)))
+      return(0);
+  }
+  return(NIL_P(args));
+}
+
+/* Inlining of global functions.  The code object of a fn with only
+   ordinary arguments whose body is a single small expression keeps
+   the (args body) of the fn.  When the inline-globals declaration is
+   t, or a list that includes the name of the function, a call of a
+   global function bound to a closure of such code has the body
+   substituted for it, with the arguments of the call in
+   place of the parameters.  The arguments have to be constants or
+   local variables, so that substituting them neither changes how
+   many times nor when they are evaluated, save that a local variable
+   may only be substituted where it is used before any call is made,
+   as a call might assign to it.
+
+   The inlined code is preceded by an ijinl instruction, which skips
+   it in favour of an ordinary call once that function has been
+   redefined.  c->inlined maps the name of each function inlined to a
+   cell whose car is true until then, and which ijinl is given as a
+   literal (see arc_bindsym). */
+#define INLINE_MAXSIZE 16
+
+static int (*spform(arc *c, value ident))(arc *, value);
+
+static int memq(value x, value list)
+{
+  for (; CONS_P(list); list = cdr(list)) {
+    if (car(list) == x)
+      return(1);
+  }
+  return(0);
+}
+
+/* Return the size of expr if it may be the body of an inlined
+   function with the parameters params, or -1 if it may not. */
+static int inline_size(arc *c, value expr, value params)
+{
+  value op;
+  int size, n;
+
+  if (LITERAL_P(expr))
+    return(1);
+  if (SYMBOL_P(expr))
+    return((NIL_P(arc_ssyntax(c, expr))) ? 1 : -1);
+  if (!CONS_P(expr))
+    return(-1);
+  op = car(expr);
+  if (op == ARC_BUILTIN(c, S_QUOTE))
+    return(1);
+  if (!SYMBOL_P(op) || !NIL_P(arc_ssyntax(c, op))
+      || memq(op, params))
+    return(-1);
+  /* if, and and or evaluate their arguments, and so may be walked
+     just like a function call, but no other special form or macro
+     can */
+  if (op != ARC_BUILTIN(c, S_IF) && op != ARC_BUILTIN(c, S_AND)
+      && op != ARC_BUILTIN(c, S_OR)
+      && (spform(c, op) != NULL || !NIL_P(ismacro(c, op))))
+    return(-1);
+  for (size = 1, expr = cdr(expr); CONS_P(expr); expr = cdr(expr)) {
+    if ((n = inline_size(c, car(expr), params)) < 0)
+      return(-1);
+    size += n;
+  }
+  return((NIL_P(expr)) ? size : -1);
+}
+
+/* Tell whether the body expr of an inlined function with parameters
+   params may have the arguments args substituted into it in the
+   environment env.  None of its free variables may be shadowed by a
+   local variable in env, and no parameter for which a local variable
+   is passed may be used after a call has been made.  called is set
+   once the code of expr, in the order it is evaluated, makes a call. */
+static int inline_safe(arc *c, value expr, value params, value args,
+		       value env, int *called)
+{
+  int frameno, idx;
+  value op;
+
+  if (SYMBOL_P(expr) && !LITERAL_P(expr)) {
+    for (; params; params = cdr(params), args = cdr(args)) {
+      if (car(params) == expr)
+	return(!(*called && SYMBOL_P(car(args))));
+    }
+    return(find_var(c, expr, env, &frameno, &idx) == CNIL);
+  }
+  if (!CONS_P(expr) || car(expr) == ARC_BUILTIN(c, S_QUOTE))
+    return(1);
+  op = car(expr);
+  if (op != ARC_BUILTIN(c, S_IF)
+      && find_var(c, op, env, &frameno, &idx) == CTRUE)
+    return(0);
+  for (expr = cdr(expr); expr; expr = cdr(expr)) {
+    if (!inline_safe(c, car(expr), params, args, env, called))
+      return(0);
+  }
+  if (op != ARC_BUILTIN(c, S_IF) && op != ARC_BUILTIN(c, S_AND)
+      && op != ARC_BUILTIN(c, S_OR))
+    *called = 1;
+  return(1);
+}
+
+/* Substitute args for params in expr */
+static value inline_subst(arc *c, value expr, value params, value args)
+{
+  value nexpr;
+
+  if (SYMBOL_P(expr)) {
+    for (; params; params = cdr(params), args = cdr(args)) {
+      if (car(params) == expr)
+	return(car(args));
+    }
+    return(expr);
+  }
+  if (!CONS_P(expr) || car(expr) == ARC_BUILTIN(c, S_QUOTE))
+    return(expr);
+  for (nexpr = CNIL; expr; expr = cdr(expr))
+    nexpr = cons(c, inline_subst(c, car(expr), params, args), nexpr);
+  return(arc_list_reverse(c, nexpr));
+}
+
+/* If the application of fname to args can be inlined in ctx, return
+   the code to be compiled in its place.  Otherwise return CUNBOUND. */
+static value inline_global(arc *c, value fname, value args, value ctx,
+			   value env)
+{
+  value fn, inl, xs, decl;
+  int frameno, idx, called;
+
+  if (!optimizing(c) || !SYMBOL_P(fname))
+    return(CUNBOUND);
+  decl = arc_hash_lookup(c, c->declarations,
+			 ARC_BUILTIN(c, S_INLINE_GLOBALS));
+  if ((decl != CTRUE && !memq(fname, decl))
+      || find_var(c, fname, env, &frameno, &idx) == CTRUE
+      || memq(fname, CCTX_INLINING(ctx)))
+    return(CUNBOUND);
+  fn = arc_hash_lookup(c, c->genv, fname);
+  if (TYPE(fn) != T_CLOS || !NIL_P(CLOS_ENV(fn))
+      || NIL_P(inl = CODE_INLINE(CLOS_CODE(fn))))
+    return(CUNBOUND);
+  if (arc_list_length(c, car(inl)) != arc_list_length(c, args))
+    return(CUNBOUND);
+  for (xs = args; xs; xs = cdr(xs)) {
+    if (LITERAL_P(car(xs))
+	|| (CONS_P(car(xs)) && car(car(xs)) == ARC_BUILTIN(c, S_QUOTE)))
+      continue;
+    if (!SYMBOL_P(car(xs))
+	|| find_var(c, car(xs), env, &frameno, &idx) == CNIL)
+      return(CUNBOUND);
+  }
+  called = 0;
+  if (!inline_safe(c, cadr(inl), car(inl), args, env, &called))
+    return(CUNBOUND);
+  return(inline_subst(c, cadr(inl), car(inl), args));
+}
+
+/* Return the cell recording that the present definition of the global
+   function fname has been inlined */
+static value inline_cell(arc *c, value fname)
+{
+  value cell;
+
+  if (NIL_P(c->inlined))
+    c->inlined = arc_mkhash(c, ARC_HASHBITS);
+  cell = arc_hash_lookup(c, c->inlined, fname);
+  if (!BOUND_P(cell)) {
+    cell = cons(c, CTRUE, CNIL);
+    arc_hash_insert(c, c->inlined, fname, cell);
+  }
+  return(cell);
+}
+
+/* Tell whether expr can be evaluated with no side effects */
+static int simple_expr(arc *c, value expr)
+{
+  if (SYMBOL_P(expr))
+    return(NIL_P(arc_ssyntax(c, expr)));
+  return(!CONS_P(expr) || car(expr) == ARC_BUILTIN(c, S_QUOTE));
+}
+
+/* Tell whether the arguments args of an apply are such that it may
+   be made by an iapplyr, if their last is a lazy rest parameter.  The
+   function applied is evaluated after the other arguments to apply
+   (see compile_apply), so unless there are no others, it and they
+   have to be such that the order of evaluation does not matter. */
+static int forwarding_args(arc *c, value args)
+{
+  value xs;
+  int n;
+
+  if (!CONS_P(args) || !CONS_P(cdr(args)))
+    return(0);
+  for (xs = cdr(args), n = 0; CONS_P(cdr(xs)); xs = cdr(xs), n++) {
+    if (!simple_expr(c, car(xs)))
+      return(0);
+  }
+  return(NIL_P(cdr(xs)) && SYMBOL_P(car(xs))
+	 && (n == 0 || simple_expr(c, car(args))));
+}
+
+/* Tell whether sym occurs anywhere in expr */
+static int occurs(value sym, value expr)
+{
+  for (; CONS_P(expr); expr = cdr(expr)) {
+    if (occurs(sym, car(expr)))
+      return(1);
+  }
+  return(expr == sym);
+}
+
+/* Tell whether every use of the rest parameter rest in expr is as
+   the last argument of an apply that compile_apply will turn into an
+   iapplyr.  This is done before expr is compiled, so anything that
+   might turn out otherwise when it is, i.e. the application of a
+   macro, a symbol with ssyntax, or a fn that binds apply, counts as
+   another use. */
+static int rest_forwarded(arc *c, value expr, value rest)
+{
+  value op;
+
+  if (SYMBOL_P(expr))
+    return(expr != rest && NIL_P(arc_ssyntax(c, expr)));
+  if (!CONS_P(expr) || car(expr) == ARC_BUILTIN(c, S_QUOTE))
+    return(1);
+  op = car(expr);
+  if (SYMBOL_P(op) && !NIL_P(ismacro(c, op)))
+    return(0);
+  if (op == ARC_BUILTIN(c, S_FN) && CONS_P(cdr(expr))
+      && occurs(ARC_BUILTIN(c, S_APPLY), cadr(expr)))
+    return(0);
+  if (op == ARC_BUILTIN(c, S_APPLY) && forwarding_args(c, cdr(expr))) {
+    for (expr = cdr(expr); CONS_P(cdr(expr)); expr = cdr(expr)) {
+      if (!rest_forwarded(c, car(expr), rest))
+	return(0);
+    }
+    if (car(expr) == rest)
+      return(1);
+    return(rest_forwarded(c, car(expr), rest));
+  }
+  for (; CONS_P(expr); expr = cdr(expr)) {
+    if (!rest_forwarded(c, car(expr), rest))
+      return(0);
+  }
+  return(NIL_P(expr) || rest_forwarded(c, expr, rest));
+}
+
+/* Tell whether the rest parameter of a fn with args and body, in env,
+   may be lazy */
+static value lazy_rest(arc *c, value args, value body, value env)
+{
+  value rest;
+  int frameno, idx;
+
+  for (rest = args; CONS_P(rest); rest = cdr(rest))
+    ;
+  if (!optimizing(c) || c->applyredef || NIL_P(rest) || !SYMBOL_P(rest)
+      || occurs(ARC_BUILTIN(c, S_APPLY), args)
+      || find_var(c, ARC_BUILTIN(c, S_APPLY), env, &frameno, &idx) == CTRUE)
+    return(CNIL);
+  for (; CONS_P(body); body = cdr(body)) {
+    if (!rest_forwarded(c, car(body), rest))
+      return(CNIL);
+  }
+  return(CTRUE);
+}
+
+static int scan_fn(arc *c, value thr);
+
+/* Return a new flat frame for the fn with (args . body) expr made in
+   env if it may be a flat closure, or nil if it may not */
+static value flat_frame(arc *c, value expr, value scan, value env)
+{
+  value refs, frame;
+
+  if (NIL_P(scan) || NIL_P(env))
+    return(CNIL);
+  refs = scan_lookup(c, scan, SCAN_FNS, expr);
+  if (!BOUND_P(refs))
+    return(CNIL);
+  for (; refs; refs = cdr(refs)) {
+    frame = var_frame(c, car(refs), env);
+    if (!NIL_P(frame) && !capturable(c, scan, car(refs), frame))
+      return(CNIL);
+  }
+  frame = arc_mkhash(c, ARC_HASHBITS);
+  arc_hash_insert(c, frame, FLAT_ENV, cons(c, env, scan));
+  return(frame);
+}
+
+/* If the fn is being assigned to a variable, self is the binding of
+   that variable (see compile_assign), which is how calls of the fn by
+   itself are recognised. */
 static AFFDEF(compile_fn)
 {
   AARG(expr, ctx, env, cont);
+  AOARG(self);
   AVAR(args, body, nctx, nenv, newcode, stmts);
+  AVAR(frmin, scan, flat);
+  int i;
   AFBEGIN;
 
-  WV(stmts, INT2FIX(0));
+  if (!BOUND_P(AV(self)))
+    WV(self, CNIL);
   WV(args, car(AV(expr)));
-  WV(body, cdr(AV(expr)));
-  WV(nctx, arc_mkcctx(c));
-  /* copy the CODE_SRC from the original ctx to this one */
-  SCCTX_SRC(AV(nctx), CCTX_SRC(AV(ctx)));
-  AFCALL(arc_mkaff(c, compile_args, CNIL),
-	 AV(args), AV(nctx), AV(env));
-  WV(nenv, AFCRV);
-  /* the body of a fn works as an implicit do/progn */
-  for (; AV(body); WV(body, cdr(AV(body)))) {
-    /* The last statement in the body gets compiled with the 
-       continuation flag set true. */
-    AFCALL(arc_mkaff(c, arc_compile, CNIL),
-	   car(AV(body)), AV(nctx), AV(nenv),
-	   (NIL_P(cdr(AV(body)))) ? CTRUE : CNIL);
-    WV(stmts, INT2FIX(FIX2INT(AV(stmts)) + 1));
-  }
-  /* if we have an empty list of statements add a nil instruction */
-  if (AV(stmts) == INT2FIX(0)) {
-    arc_emit(c, AV(nctx), inil, get_lineno(c, cdr(AV(expr))));
-    arc_emit(c, AV(nctx), iret, get_lineno(c, cdr(AV(expr))));
+  /* Scan the outermost fn before compiling it */
+  WV(scan, CCTX_SCAN(AV(ctx)));
+  if (optimizing(c) && NIL_P(AV(scan)) && NIL_P(AV(env))) {
+    WV(scan, arc_mkvector(c, SCAN_SIZE));
+    for (i=0; i<SCAN_SIZE; i++)
+      SVINDEX(AV(scan), i, arc_mkhash(c, ARC_HASHBITS));
+    AFCALL(ARC_AFF(c, scan_fn), AV(expr), AV(scan), CNIL);
+  }
+  WV(flat, (optimizing(c)) ? flat_frame(c, AV(expr), AV(scan), AV(env))
+     : CNIL);
+  for (;;) {
+    WV(stmts, INT2FIX(0));
+    WV(body, cdr(AV(expr)));
+    WV(nctx, arc_mkcctx(c));
+    /* record line numbers here too if the original ctx does */
+    if (!NIL_P(CCTX_SRC(AV(ctx))))
+      arc_cctx_mksrc(c, AV(nctx), VINDEX(CCTX_SRC(AV(ctx)), SRC_FILENAME));
+    SCCTX_INLINING(AV(nctx), CCTX_INLINING(AV(ctx)));
+    SCCTX_SCAN(AV(nctx), AV(scan));
+    /* A flat closure sees nothing but its own frames and the
+       variables it captures */
+    WV(nenv, (NIL_P(AV(flat))) ? AV(env) : cons(c, AV(flat), CNIL));
+    AFCALL(ARC_AFF(c, compile_args),
+	   AV(args), AV(nctx), AV(nenv),
+	   lazy_rest(c, AV(args), AV(body), AV(nenv)));
+    WV(nenv, AFCRV);
+    /* A tail call of the fn by itself may jump back here instead */
+    if (optimizing(c) && !NIL_P(AV(self)) && simple_args(c, AV(args)))
+      SCCTX_SELF(AV(nctx), cons(c, AV(self),
+				cons(c, arc_list_length(c, AV(args)),
+				     CCTX_VCPTR(AV(nctx)))));
+    /* the body of a fn works as an implicit do/progn */
+    for (; AV(body); WV(body, cdr(AV(body)))) {
+      /* The last statement in the body gets compiled with the 
+	 continuation flag set true. */
+      AFCALL(ARC_AFF(c, arc_compile),
+	     car(AV(body)), AV(nctx), AV(nenv),
+	     (NIL_P(cdr(AV(body)))) ? CTRUE : CNIL);
+      WV(stmts, INT2FIX(FIX2INT(AV(stmts)) + 1));
+    }
+    /* if we have an empty list of statements add a nil instruction */
+    if (AV(stmts) == INT2FIX(0)) {
+      arc_emit(c, AV(nctx), inil, get_lineno(c, cdr(AV(expr))));
+      arc_emit(c, AV(nctx), iret, get_lineno(c, cdr(AV(expr))));
+    }
+    if (NIL_P(AV(flat))
+	|| !BOUND_P(arc_hash_lookup(c, AV(flat), FLAT_FAIL)))
+      break;
+    WV(flat, CNIL);
   }
   /* convert the new context into a code object and generate an
      instruction in the present context to load it as a literal,
-     then create a closure using the code object and the current
-     environment. */
+     then create a closure using the code object.
+
+     A flat closure is made by iclsf from the values of the variables
+     it captures, pushed in the order of their indices.  Any other fn
+     that references no variables from the environments enclosing it
+     (i.e. the outermost frame it references is one of its own, or it
+     references none at all) does not need to capture the current
+     environment either, and we use iclsn, which leaves the current
+     environment on the stack instead of moving the whole environment
+     chain to the heap as icls must.  Otherwise the frame reference is
+     passed up to the enclosing fn, since it must then keep that frame
+     for us. */
   WV(newcode, arc_cctx2code(c, AV(nctx)));
+  if (optimizing(c) && simple_args(c, AV(args))
+      && CONS_P(cdr(AV(expr))) && NIL_P(cddr(AV(expr)))) {
+    int size = inline_size(c, cadr(AV(expr)), AV(args));
+
+    if (size >= 0 && size <= INLINE_MAXSIZE)
+      SCODE_INLINE(AV(newcode), AV(expr));
+  }
+  if (!NIL_P(AV(flat))) {
+    value var;
+    int n;
+
+    for (n=0; BOUND_P(var = arc_hash_lookup(c, AV(flat), INT2FIX(n))); n++) {
+      compile_ident(c, var, AV(ctx), AV(env), CNIL);
+      arc_emit(c, AV(ctx), ipush, get_lineno(c, AV(expr)));
+    }
+    arc_emit1(c, AV(ctx), ildl, find_literal(c, AV(ctx), AV(newcode)),
+	      get_lineno(c, AV(expr)));
+    if (n == 0)
+      arc_emit(c, AV(ctx), iclsn, get_lineno(c, AV(expr)));
+    else
+      arc_emit1(c, AV(ctx), iclsf, INT2FIX(n), get_lineno(c, AV(expr)));
+    ARETURN(compile_continuation(c, AV(ctx), AV(cont)));
+  }
   arc_emit1(c, AV(ctx), ildl, find_literal(c, AV(ctx), AV(newcode)),
 	    get_lineno(c, AV(expr)));
-  arc_emit(c, AV(ctx), icls, get_lineno(c, AV(expr)));
+  WV(frmin, CCTX_FRMIN(AV(nctx)));
+  if (NIL_P(AV(frmin))
+      || FIX2INT(AV(frmin)) >= FIX2INT(arc_list_length(c, AV(env)))) {
+    arc_emit(c, AV(ctx), iclsn, get_lineno(c, AV(expr)));
+  } else {
+    if (NIL_P(CCTX_FRMIN(AV(ctx)))
+	|| FIX2INT(AV(frmin)) < FIX2INT(CCTX_FRMIN(AV(ctx))))
+      SCCTX_FRMIN(AV(ctx), AV(frmin));
+    arc_emit(c, AV(ctx), icls, get_lineno(c, AV(expr)));
+  }
 
   ARETURN(compile_continuation(c, AV(ctx), AV(cont)));
   AFEND;
@@ -549,20 +1344,84 @@ static AFFDEF(splicing)
   if (car(AV(expr)) == ARC_BUILTIN(c, S_UNQUOTESP))
     ARETURN(CTRUE);
   if (car(AV(expr)) == ARC_BUILTIN(c, S_UNQUOTE))
-    AFTCALL(arc_mkaff(c, splicing, CNIL), cadr(AV(expr)));
+    AFTCALL(ARC_AFF(c, splicing), cadr(AV(expr)));
   ARETURN(CNIL);
   AFEND;
 }
 AFFEND
 
+/* The forms built by the expander are simplified as they are built,
+   following the optimisations CLtL2 describes for backquote.  A form
+   that is nil or quoted is constant, and consing two constants
+   together gives another constant, so constant parts of a template
+   are left as quoted literal structure that is shared between
+   evaluations.  Only the cells on the way to an unquote are built at
+   run time, with cons, which the compiler inlines.  A list spliced in
+   at the end of a template is not copied. */
+static int qqconst(arc *c, value expr)
+{
+  return(NIL_P(expr)
+	 || (CONS_P(expr) && car(expr) == ARC_BUILTIN(c, S_QUOTE)));
+}
+
+static value qqquote(arc *c, value x)
+{
+  return(cons(c, ARC_BUILTIN(c, S_QUOTE), cons(c, x, CNIL)));
+}
+
+/* Cons together the forms expr1 and expr2, where expr1 does not
+   splice */
+static value qqmkcons(arc *c, value expr1, value expr2)
+{
+  if (qqconst(c, expr1) && qqconst(c, expr2))
+    return(qqquote(c, cons(c, (NIL_P(expr1)) ? CNIL : cadr(expr1),
+			   (NIL_P(expr2)) ? CNIL : cadr(expr2))));
+  return(cons(c, ARC_BUILTIN(c, S_CONS),
+	      cons(c, expr1, cons(c, expr2, CNIL))));
+}
+
+/* If expr1 is a form that makes a proper list of known length, either
+   a constant or a chain of conses ending in nil, return the form that
+   makes the same list with expr2 for its tail.  Otherwise return
+   CUNBOUND. */
+static value qqprepend(arc *c, value expr1, value expr2)
+{
+  value x, rest;
+
+  if (qqconst(c, expr1)) {
+    x = (NIL_P(expr1)) ? CNIL : cadr(expr1);
+    if (NIL_P(x))
+      return(expr2);
+    if (!CONS_P(x))
+      return(CUNBOUND);
+    rest = qqprepend(c, qqquote(c, cdr(x)), expr2);
+    return((BOUND_P(rest)) ? qqmkcons(c, qqquote(c, car(x)), rest) : rest);
+  }
+  if (CONS_P(expr1) && car(expr1) == ARC_BUILTIN(c, S_CONS)
+      && CONS_P(cdr(expr1)) && CONS_P(cddr(expr1))
+      && NIL_P(cdr(cddr(expr1)))) {
+    rest = qqprepend(c, caddr(expr1), expr2);
+    return((BOUND_P(rest)) ? qqmkcons(c, cadr(expr1), rest) : rest);
+  }
+  return(CUNBOUND);
+}
+
 static AFFDEF(qqappend)
 {
   AARG(expr1);
   AOARG(expr2);
+  value x;
   AFBEGIN;
   if (!BOUND_P(AV(expr2)))
     WV(expr2, CNIL);
-  /* XXX unoptimized version as before */
+  AFCALL(ARC_AFF(c, splicing), AV(expr1));
+  if (NIL_P(AFCRV)) {
+    x = qqprepend(c, AV(expr1), AV(expr2));
+    if (BOUND_P(x))
+      ARETURN(x);
+    if (qqconst(c, AV(expr2)) && (NIL_P(AV(expr2)) || NIL_P(cadr(AV(expr2)))))
+      ARETURN(AV(expr1));
+  }
   ARETURN(cons(c, ARC_BUILTIN(c, S_APPEND),
 	       cons(c, AV(expr1), cons(c, AV(expr2), CNIL))));
   AFEND;
@@ -573,11 +1432,11 @@ static AFFDEF(qqappends)
 {
   AARG(exprs);
   AFBEGIN;
-  AFCALL(arc_mkaff(c, arc_rreduce, CNIL),
-	 arc_mkaff(c, qqappend, CNIL),
+  AFCALL(ARC_AFF(c, arc_rreduce),
+	 ARC_AFF(c, qqappend),
 	 AV(exprs));
   WV(exprs, AFCRV);
-  AFCALL(arc_mkaff(c, splicing, CNIL), AFCRV);
+  AFCALL(ARC_AFF(c, splicing), AFCRV);
   if (NIL_P(AFCRV))
     ARETURN(AV(exprs));
   ARETURN(cons(c, ARC_BUILTIN(c, S_APPEND), cons(c, AV(exprs), CNIL)));
@@ -588,13 +1447,12 @@ AFFEND
 static AFFDEF(qqcons)
 {
   AARG(expr1, expr2);
-  value operator;
   AFBEGIN;
-  AFCALL(arc_mkaff(c, splicing, CNIL), AV(expr1));
-  operator = (NIL_P(AFCRV)) ? ARC_BUILTIN(c, S_CONS) :  ARC_BUILTIN(c, S_DLIST);
-  /* XXX unoptimised version -- this results in the list being evaluated at
-     runtime, well, more or less in the same way as the old code had... */
-  ARETURN(cons(c, operator, cons(c, AV(expr1), cons(c, AV(expr2), CNIL))));
+  AFCALL(ARC_AFF(c, splicing), AV(expr1));
+  if (NIL_P(AFCRV))
+    ARETURN(qqmkcons(c, AV(expr1), AV(expr2)));
+  ARETURN(cons(c, ARC_BUILTIN(c, S_DLIST),
+	       cons(c, AV(expr1), cons(c, AV(expr2), CNIL))));
   AFEND;
 }
 AFFEND
@@ -603,7 +1461,7 @@ static AFFDEF(qqlist)
 {
   AARG(expr);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, qqcons, CNIL), AV(expr), CNIL);
+  AFTCALL(ARC_AFF(c, qqcons), AV(expr), CNIL);
   AFEND;
 }
 AFFEND
@@ -616,18 +1474,18 @@ static AFFDEF(qqtransform)
   AVAR(expansion);
   AFBEGIN;
   if (CONS_P(AV(expr)) && car(AV(expr)) == ARC_BUILTIN(c, S_UNQUOTE))
-    AFTCALL(arc_mkaff(c, qqlist, CNIL), cadr(AV(expr)));
+    AFTCALL(ARC_AFF(c, qqlist), cadr(AV(expr)));
   if (CONS_P(AV(expr)) && car(AV(expr)) == ARC_BUILTIN(c, S_UNQUOTESP))
     ARETURN(cadr(AV(expr)));
   if (CONS_P(AV(expr)) && car(AV(expr)) == ARC_BUILTIN(c, S_QQUOTE)) {
-    AFCALL(arc_mkaff(c, qqexpand, CNIL), cadr(AV(expr)));
+    AFCALL(ARC_AFF(c, qqexpand), cadr(AV(expr)));
     WV(expansion, AFCRV);
-    AFTCALL(arc_mkaff(c, qqlist, CNIL),
+    AFTCALL(ARC_AFF(c, qqlist),
 	    cons(c, ARC_BUILTIN(c, S_QQUOTE),
 		 cons(c, AV(expansion), CNIL)));
   }
-  AFCALL(arc_mkaff(c, qqexpand, CNIL), AV(expr));
-  AFTCALL(arc_mkaff(c, qqlist, CNIL), AFCRV);
+  AFCALL(ARC_AFF(c, qqexpand), AV(expr));
+  AFTCALL(ARC_AFF(c, qqlist), AFCRV);
   AFEND;
 }
 AFFEND
@@ -652,12 +1510,12 @@ static AFFDEF(qqexpandlist)
     ARETURN(cons(c, cadr(AV(expr)), CNIL));
 
   if (car(AV(expr)) == ARC_BUILTIN(c, S_UNQUOTESP)) {
-    arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)), "invalid use of unquote-splicing");
+    arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)), "invalid use of unquote-splicing");
     ARETURN(CNIL);
   }
-  AFCALL(arc_mkaff(c, qqtransform, CNIL), car(AV(expr)));
+  AFCALL(ARC_AFF(c, qqtransform), car(AV(expr)));
   WV(trans, AFCRV);
-  AFCALL(arc_mkaff(c, qqexpandlist, CNIL), cdr(AV(expr)));
+  AFCALL(ARC_AFF(c, qqexpandlist), cdr(AV(expr)));
   ARETURN(cons(c, AV(trans), AFCRV));
   AFEND;
 }
@@ -685,17 +1543,17 @@ static AFFDEF(qqexpand)
   if (car(AV(expr)) == ARC_BUILTIN(c, S_UNQUOTE))
     ARETURN(cadr(AV(expr)));
   if (car(AV(expr)) == ARC_BUILTIN(c, S_UNQUOTESP)) {
-    arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)), "invalid use of unquote-splicing");
+    arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)), "invalid use of unquote-splicing");
     ARETURN(CNIL);
   }
   if (car(AV(expr)) == ARC_BUILTIN(c, S_QQUOTE)) {
-    AFCALL(arc_mkaff(c, qqexpand, CNIL), cadr(AV(expr)));
+    AFCALL(ARC_AFF(c, qqexpand), cadr(AV(expr)));
     ARETURN(cons(c, ARC_BUILTIN(c, S_EVAL),
 		 cons(c, cons(c, ARC_BUILTIN(c, S_QQUOTE),
 			      cons(c, AFCRV, CNIL)), CNIL)));
   }
-  AFCALL(arc_mkaff(c, qqexpandlist, CNIL), AV(expr));
-  AFTCALL(arc_mkaff(c, qqappends, CNIL), AFCRV);
+  AFCALL(ARC_AFF(c, qqexpandlist), AV(expr));
+  AFTCALL(ARC_AFF(c, qqappends), AFCRV);
   AFEND;
 }
 AFFEND
@@ -704,7 +1562,7 @@ AFFDEF(arc_quasiquote)
 {
   AARG(expr);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, qqexpand, CNIL), AV(expr));
+  AFTCALL(ARC_AFF(c, qqexpand), AV(expr));
   AFEND;
 }
 AFFEND
@@ -716,19 +1574,27 @@ static AFFDEF(compile_assign)
   AVAR(a, val, envvar);
   AFBEGIN;
   while (AV(expr) != CNIL) {
-    AFCALL(arc_mkaff(c, macex, CNIL), car(AV(expr)), CTRUE);
+    AFCALL(ARC_AFF(c, macex), car(AV(expr)), CTRUE);
     WV(a, AFCRV);
     WV(val, cadr(AV(expr)));
     if (AV(a) == CNIL) {
-      arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)), "can't rebind nil");
+      arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)), "can't rebind nil");
     } else if (AV(a) == ARC_BUILTIN(c, S_T)) {
-      arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)), "Can't rebind t");
+      arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)), "Can't rebind t");
+    } else if (CONS_P(AV(val)) && car(AV(val)) == ARC_BUILTIN(c, S_FN)) {
+      /* A fn assigned to a variable is compiled knowing the binding
+	 of the variable, so that it can tell when it calls itself */
+      AFCALL(ARC_AFF(c, compile_fn), cdr(AV(val)), AV(ctx), AV(env),
+	     CNIL, cons(c, AV(a), var_frame(c, AV(a), AV(env))));
     } else {
-      AFCALL(arc_mkaff(c, arc_compile, CNIL), AV(val), AV(ctx),
+      AFCALL(ARC_AFF(c, arc_compile), AV(val), AV(ctx),
 	     AV(env), CNIL);
+    }
+    if (AV(a) != CNIL && AV(a) != ARC_BUILTIN(c, S_T)) {
       idx = frameno = 0;
       WV(envvar, find_var(c, AV(a), AV(env), &frameno, &idx));
       if (AV(envvar) == CTRUE) {
+	note_frame(c, AV(ctx), AV(env), frameno);
 	if (frameno == 0) {
 	  arc_emit1(c, AV(ctx), iste0, INT2FIX(idx), get_lineno(c, AV(expr)));
 	} else {
@@ -771,13 +1637,13 @@ static int (*spform(arc *c, value ident))(arc *, value)
     WV(expr, cdr(AV(expr)));						\
     for (WV(count, FIX2INT(0)); AV(expr); WV(expr, cdr(AV(expr))),	\
 	   FIXINC(count)) {						\
-      AFCALL(arc_mkaff(c, arc_compile, CNIL), car(AV(expr)),	        \
+      AFCALL(ARC_AFF(c, arc_compile), car(AV(expr)),	        \
 	     AV(ctx), AV(env), CNIL);					\
       if (cdr(AV(expr)) != CNIL)					\
 	arc_emit(c, AV(ctx), ipush, get_lineno(c, AV(expr)));		\
     }									\
     if (AV(count) != INT2FIX(nargs)) {					\
-      arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)),			\
+      arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)),		\
 			   "inline procedure expects %d arguments (%d passed)", \
 			   nargs, FIX2INT(AV(count)));			\
     } else {								\
@@ -796,10 +1662,17 @@ static AFFDEF(compile_inlinen)
 {
   AARG(inst, expr, ctx, env, cont, base);
   AFBEGIN;
-  AFCALL(arc_mkaff(c, arc_compile, CNIL), AV(base), AV(ctx), AV(env), CNIL);
+  AFCALL(ARC_AFF(c, arc_compile), AV(base), AV(ctx), AV(env), CNIL);
   for (WV(expr, cdr(AV(expr))); AV(expr); WV(expr,cdr(AV(expr)))) {
+    /* Adding or subtracting a fixnum constant needs no push */
+    if (optimizing(c) && FIXNUM_P(car(AV(expr)))
+	&& (AV(inst) == iadd || AV(inst) == isub)) {
+      arc_emit1(c, AV(ctx), (AV(inst) == iadd) ? iaddi : isubi,
+		car(AV(expr)), get_lineno(c, AV(expr)));
+      continue;
+    }
     arc_emit(c, AV(ctx), ipush, get_lineno(c, AV(expr)));
-    AFCALL(arc_mkaff(c, arc_compile, CNIL), car(AV(expr)), AV(ctx),
+    AFCALL(ARC_AFF(c, arc_compile), car(AV(expr)), AV(ctx),
 	   AV(env), CNIL);
     arc_emit(c, AV(ctx), AV(inst), get_lineno(c, AV(expr)));
   }
@@ -816,14 +1689,14 @@ static AFFDEF(compile_inlinen2)
   WV(xexpr, cdr(AV(expr)));
   WV(xelen, arc_list_length(c, AV(xexpr)));
   if (AV(xelen) == INT2FIX(0)) {
-    arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)),
+    arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)),
 			 "operator requires at least one argument");
     ARETURN(CNIL);
   } else if (AV(xelen) == INT2FIX(1)) {
-    AFTCALL(arc_mkaff(c, compile_inlinen, CNIL), AV(inst),
+    AFTCALL(ARC_AFF(c, compile_inlinen), AV(inst),
 	    AV(expr), AV(ctx), AV(env), AV(cont), AV(base));
   }
-  AFTCALL(arc_mkaff(c, compile_inlinen, CNIL), AV(inst),
+  AFTCALL(ARC_AFF(c, compile_inlinen), AV(inst),
 	  cons(c, car(AV(expr)), cdr(AV(xexpr))), AV(ctx),
 	  AV(env), AV(cont), car(AV(xexpr)));
   AFEND;
@@ -838,12 +1711,12 @@ static AFFDEF(inline_plus)
   xexpr = cdr(AV(expr));
   xelen = arc_list_length(c, xexpr);
   if (xelen == INT2FIX(0))
-    AFTCALL(arc_mkaff(c, arc_compile, CNIL), INT2FIX(0), AV(ctx),
+    AFTCALL(ARC_AFF(c, arc_compile), INT2FIX(0), AV(ctx),
 	    AV(env), AV(cont));
   if (xelen == INT2FIX(1))
-    AFTCALL(arc_mkaff(c, arc_compile, CNIL), car(xexpr), AV(ctx),
+    AFTCALL(ARC_AFF(c, arc_compile), car(xexpr), AV(ctx),
 	    AV(env), AV(cont));
-  AFTCALL(arc_mkaff(c, compile_inlinen2, CNIL), iadd,
+  AFTCALL(ARC_AFF(c, compile_inlinen2), iadd,
 	  AV(expr), AV(ctx), AV(env), AV(cont), INT2FIX(0));
   AFEND;
 }
@@ -853,7 +1726,13 @@ static AFFDEF(inline_times)
 {
   AARG(expr, ctx, env, cont);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, compile_inlinen, CNIL), imul,
+  /* Start from the first factor rather than from 1.  The identity is
+     still used for a single factor, so that (* x) fails just as it
+     does when not optimizing if x is not a number. */
+  if (optimizing(c) && FIX2INT(arc_list_length(c, cdr(AV(expr)))) > 1)
+    AFTCALL(ARC_AFF(c, compile_inlinen2), imul,
+	    AV(expr), AV(ctx), AV(env), AV(cont), INT2FIX(1));
+  AFTCALL(ARC_AFF(c, compile_inlinen), imul,
 	  AV(expr), AV(ctx), AV(env), AV(cont), INT2FIX(1));
   AFEND;
 }
@@ -863,7 +1742,7 @@ static AFFDEF(inline_minus)
 {
   AARG(expr, ctx, env, cont);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, compile_inlinen2, CNIL), isub,
+  AFTCALL(ARC_AFF(c, compile_inlinen2), isub,
 	  AV(expr), AV(ctx), AV(env), AV(cont), INT2FIX(0));
   AFEND;
 }
@@ -873,7 +1752,7 @@ static AFFDEF(inline_div)
 {
   AARG(expr, ctx, env, cont);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, compile_inlinen2, CNIL), idiv,
+  AFTCALL(ARC_AFF(c, compile_inlinen2), idiv,
 	  AV(expr), AV(ctx), AV(env), AV(cont), INT2FIX(1));
   AFEND;
 }
@@ -914,7 +1793,7 @@ static AFFDEF(compile_compose)
 
   composer = cdr(car(AV(expr)));
   cargs = cdr(AV(expr));
-  AFTCALL(arc_mkaff(c, arc_compile, CNIL), fold(c, composer, cargs),
+  AFTCALL(ARC_AFF(c, arc_compile), fold(c, composer, cargs),
 	  AV(ctx), AV(env), AV(cont));
   AFEND;
 }
@@ -930,23 +1809,49 @@ static AFFDEF(compile_complement)
   cargs = cdr(AV(expr));
 
   if (!NIL_P(cdr(complemented))) {
-    arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)),
+    arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)),
 			 "complement: wrong number of arguments (1 required)");
     return(CNIL);
   }
   complemented = car(complemented);
   result = cons(c, ARC_BUILTIN(c, S_NO),
 		cons(c, cons(c, complemented, cargs), CNIL));
-  AFTCALL(arc_mkaff(c, arc_compile, CNIL), result,
+  AFTCALL(ARC_AFF(c, arc_compile), result,
 	  AV(ctx), AV(env), AV(cont));
   AFEND;
 }
 AFFEND
 
+/* If the application of fname to args in env is one of apply to a
+   lazy rest parameter, return a list of the frame number and index of
+   the parameter.  Otherwise return CUNBOUND. */
+static value lazy_apply(arc *c, value fname, value args, value ctx,
+			value env)
+{
+  value xs, frame;
+  int frameno, idx, n;
+
+  if (fname != ARC_BUILTIN(c, S_APPLY) || c->applyredef
+      || find_var(c, fname, env, &frameno, &idx) == CTRUE
+      || !forwarding_args(c, args))
+    return(CUNBOUND);
+  for (xs = args; CONS_P(cdr(xs)); xs = cdr(xs))
+    ;
+  if (find_var(c, car(xs), env, &frameno, &idx) == CNIL)
+    return(CUNBOUND);
+  for (frame = env, n = frameno; n > 0; n--)
+    frame = cdr(frame);
+  if (arc_hash_lookup(c, car(frame), LAZY_REST) != car(xs))
+    return(CUNBOUND);
+  note_frame(c, ctx, env, frameno);
+  return(cons(c, INT2FIX(frameno), cons(c, INT2FIX(idx), CNIL)));
+}
+
 static AFFDEF(compile_apply)
 {
   AARG(expr, ctx, env, cont);
-  AVAR(fname, args, nahd, contaddr, nargs);
+  AVAR(fname, args, nahd, contaddr, nargs, inl, inladdr, skipaddr);
+  AVAR(lazy);
   value mac;
   AFBEGIN;
 
@@ -955,13 +1860,70 @@ static AFFDEF(compile_apply)
 
   /* Check to see if this is a macro application */
   if (SYMBOL_P(AV(fname)) && !NIL_P(mac = ismacro(c, AV(fname)))) {
+    /* Compile the expansion made when the fn around it was scanned,
+       if there was one */
+    if (!NIL_P(CCTX_SCAN(AV(ctx)))) {
+      value x = scan_lookup(c, CCTX_SCAN(AV(ctx)), SCAN_EXPS, AV(expr));
+
+      if (BOUND_P(x))
+	AFTCALL(ARC_AFF(c, arc_compile), x, AV(ctx), AV(env), AV(cont));
+    }
     /* Apply the macro by calling it.  Compile the results. */
-    AFCALL2(arc_rep(c, mac), AV(args));
-    AFTCALL(arc_mkaff(c, arc_compile, CNIL), AFCRV, AV(ctx), AV(env), AV(cont));
+    AFCALL(ARC_AFF(c, expand), mac, AV(expr));
+    AFTCALL(ARC_AFF(c, arc_compile), AFCRV, AV(ctx), AV(env), AV(cont));
     /* tail call: doesn't return -- never gets here */
     ARETURN(AFCRV);
   }
 
+  /* Apply to a lazy rest parameter pushes the arguments other than
+     the last and evaluates the function to be applied, and then
+     leaves it to an iapplyr to push the arguments in the rest
+     parameter and make the application. */
+  WV(lazy, lazy_apply(c, AV(fname), AV(args), AV(ctx), AV(env)));
+  if (BOUND_P(AV(lazy))) {
+    if (NIL_P(AV(cont))) {
+      WV(contaddr, CCTX_VCPTR(AV(ctx)));
+      arc_emit1(c, AV(ctx), icont, INT2FIX(0), get_lineno(c, AV(expr)));
+    }
+    for (WV(nahd, cdr(AV(args))), WV(nargs, INT2FIX(0));
+	 CONS_P(cdr(AV(nahd))); WV(nahd, cdr(AV(nahd))),
+	   WV(nargs, INT2FIX(FIX2INT(AV(nargs)) + 1))) {
+      AFCALL(ARC_AFF(c, arc_compile), car(AV(nahd)),
+	     AV(ctx), AV(env), CNIL);
+      arc_emit(c, AV(ctx), ipush, get_lineno(c, AV(expr)));
+    }
+    AFCALL(ARC_AFF(c, arc_compile), car(AV(args)), AV(ctx),
+	   AV(env), CNIL);
+    arc_emit3(c, AV(ctx), (NIL_P(AV(cont))) ? iapplyr : itapplyr,
+	      AV(nargs), car(AV(lazy)), cadr(AV(lazy)),
+	      get_lineno(c, AV(expr)));
+    if (NIL_P(AV(cont))) {
+      arc_jmpoffset(c, AV(ctx), FIX2INT(AV(contaddr)),
+		    FIX2INT(CCTX_VCPTR(AV(ctx))));
+    }
+    ARETURN(AV(ctx));
+  }
+
+  /* Inline the body of a small global function if we may, falling
+     back on an ordinary call if it should be redefined. */
+  WV(inl, inline_global(c, AV(fname), AV(args), AV(ctx), AV(env)));
+  if (BOUND_P(AV(inl))) {
+    WV(inladdr, CCTX_VCPTR(AV(ctx)));
+    arc_emit2(c, AV(ctx), ijinl, INT2FIX(0),
+	      find_literal(c, AV(ctx), inline_cell(c, AV(fname))),
+	      get_lineno(c, AV(expr)));
+    SCCTX_INLINING(AV(ctx), cons(c, AV(fname), CCTX_INLINING(AV(ctx))));
+    AFCALL(ARC_AFF(c, arc_compile), AV(inl), AV(ctx), AV(env),
+	   AV(cont));
+    SCCTX_INLINING(AV(ctx), cdr(CCTX_INLINING(AV(ctx))));
+    if (NIL_P(AV(cont))) {
+      WV(skipaddr, CCTX_VCPTR(AV(ctx)));
+      arc_emit1(c, AV(ctx), ijmp, INT2FIX(0), get_lineno(c, AV(expr)));
+    }
+    arc_jmpoffset(c, AV(ctx), FIX2INT(AV(inladdr)),
+		  FIX2INT(CCTX_VCPTR(AV(ctx))));
+  }
+
   /* There are two possible cases here.  If this is not a tail call,
      cont will be nil, so we need to make a continuation. */
   if (NIL_P(AV(cont))) {
@@ -972,16 +1934,32 @@ static AFFDEF(compile_apply)
   /* Traverse the arguments, compiling each and pushing them on the stack */
   for (WV(nargs, INT2FIX(0)); AV(nahd); WV(nahd, cdr(AV(nahd))),
 	 WV(nargs, INT2FIX(FIX2INT(AV(nargs)) + 1))) {
-    AFCALL(arc_mkaff(c, arc_compile, CNIL), car(AV(nahd)),
+    AFCALL(ARC_AFF(c, arc_compile), car(AV(nahd)),
 	   AV(ctx), AV(env), CNIL);
     arc_emit(c, AV(ctx), ipush, get_lineno(c, AV(expr)));
   }
   /* compile the function name, which should load it into the value register */
-  AFCALL(arc_mkaff(c, arc_compile, CNIL), AV(fname), AV(ctx), AV(env), CNIL);
+  AFCALL(ARC_AFF(c, arc_compile), AV(fname), AV(ctx), AV(env), CNIL);
 
   /* If this is a tail call, create a menv instruction to overwrite the
-     current environment just before performing the application */
+     current environment just before performing the application.  If
+     it is made through the same binding of the same variable that the
+     fn being compiled is assigned to, it is a tail call of the fn by
+     itself unless that variable has since been assigned something
+     else, so try to jump back to the start of the fn first.  The
+     ijself instruction checks that the function really is the same. */
   if (!NIL_P(AV(cont))) {
+    value self = CCTX_SELF(AV(ctx));
+
+    if (!NIL_P(self) && car(car(self)) == AV(fname)
+	&& cdr(car(self)) == var_frame(c, AV(fname), AV(env))
+	&& cadr(self) == AV(nargs)) {
+      int jmpaddr = FIX2INT(CCTX_VCPTR(AV(ctx)));
+
+      arc_emit2(c, AV(ctx), ijself, INT2FIX(0), AV(nargs),
+		get_lineno(c, AV(expr)));
+      arc_jmpoffset(c, AV(ctx), jmpaddr, FIX2INT(cddr(self)));
+    }
     arc_emit1(c, AV(ctx), imenv, AV(nargs), get_lineno(c, AV(expr)));
   }
   /* create the apply instruction that will perform the application */
@@ -991,6 +1969,11 @@ static AFFDEF(compile_apply)
     arc_jmpoffset(c, AV(ctx), FIX2INT(AV(contaddr)),
 		  FIX2INT(CCTX_VCPTR(AV(ctx))));
   }
+  /* jump past the ordinary call after inlined code */
+  if (BOUND_P(AV(inl)) && NIL_P(AV(cont))) {
+    arc_jmpoffset(c, AV(ctx), FIX2INT(AV(skipaddr)),
+		  FIX2INT(CCTX_VCPTR(AV(ctx))));
+  }
   /* done */
   /* XXX - this emits a ret instruction that is never reached
      if this compiles a tail call.  If it isn't a tail call, then
@@ -1018,45 +2001,301 @@ static AFFDEF(compile_andf)
   body = cons(c, cons(c, ARC_BUILTIN(c, S_AND), body), CNIL);
   body = cons(c, cons(c, ARC_BUILTIN(c, S_FN),
 		      cons(c, uniqs, body)), andargs);
-  AFTCALL(arc_mkaff(c, arc_compile, CNIL), body, AV(ctx),
+  AFTCALL(ARC_AFF(c, arc_compile), body, AV(ctx),
 	  AV(env), AV(cont));
   AFEND;
 }
 AFFEND
 
+/* Compile the expressions in body one after the other, as the body
+   of a fn with no arguments */
+static AFFDEF(compile_body)
+{
+  AARG(body, ctx, env, cont);
+  AFBEGIN;
+  if (NIL_P(AV(body))) {
+    arc_emit(c, AV(ctx), inil, get_lineno(c, AV(body)));
+    ARETURN(compile_continuation(c, AV(ctx), AV(cont)));
+  }
+  for (; !NIL_P(cdr(AV(body))); WV(body, cdr(AV(body))))
+    AFCALL(ARC_AFF(c, arc_compile), car(AV(body)), AV(ctx),
+	   AV(env), CNIL);
+  AFTCALL(ARC_AFF(c, arc_compile), car(AV(body)), AV(ctx),
+	  AV(env), AV(cont));
+  AFEND;
+}
+AFFEND
+
+/* Scanning.  Before the outermost fn of a piece of code is compiled,
+   it is walked much as it will be compiled, to find out which variables
+   are ever assigned, and, for each fn in it, which variables from
+   outside the fn it references, so that compile_fn can tell which fns
+   may be made into flat closures.  The expansions of the macros in it
+   are kept for compile_apply, so that every macro is still expanded
+   only once.  The variables referenced are found with the compiler
+   frames of the fns in scope, in which every variable has index 0.
+   All that has to be exact is which variables are ever assigned:
+   anything else scanning gets wrong may at worst make for a fn that is
+   compiled twice, or a closure that is not flat. */
+static value scan_union(arc *c, value xs, value ys)
+{
+  for (; xs; xs = cdr(xs)) {
+    if (!memq(car(xs), ys))
+      ys = cons(c, car(xs), ys);
+  }
+  return(ys);
+}
+
+/* Enter the names bound by the fn arguments args in frame, and return
+   the expressions giving the defaults of its optional arguments
+   added to defs. */
+static value scan_args(arc *c, value scan, value frame, value args,
+		       value defs)
+{
+  value x;
+
+  if (SYMBOL_P(args)) {
+    arc_hash_insert(c, frame, args, INT2FIX(0));
+    arc_hash_insert(c, VINDEX(scan, SCAN_BOUND), args, CTRUE);
+    return(defs);
+  }
+  for (; CONS_P(args); args = cdr(args)) {
+    x = car(args);
+    if (CONS_P(x) && car(x) == ARC_BUILTIN(c, S_O) && CONS_P(cdr(x))
+	&& SYMBOL_P(cadr(x))) {
+      defs = scan_args(c, scan, frame, cadr(x), defs);
+      if (CONS_P(cddr(x)))
+	defs = cons(c, car(cddr(x)), defs);
+      continue;
+    }
+    defs = scan_args(c, scan, frame, x, defs);
+  }
+  return((SYMBOL_P(args)) ? scan_args(c, scan, frame, args, defs) : defs);
+}
+
+static int scan_expr(arc *c, value thr);
+
+static AFFDEF(scan_body)
+{
+  AARG(body, scan, scope);
+  AVAR(refs);
+  AFBEGIN;
+  WV(refs, CNIL);
+  for (; CONS_P(AV(body)); WV(body, cdr(AV(body)))) {
+    AFCALL(ARC_AFF(c, scan_expr), car(AV(body)), AV(scan), AV(scope));
+    WV(refs, scan_union(c, AFCRV, AV(refs)));
+  }
+  ARETURN(AV(refs));
+  AFEND;
+}
+AFFEND
+
+/* Scan the (args . body) of a fn, and return the variables from
+   outside it that it references */
+static AFFDEF(scan_fn)
+{
+  AARG(expr, scan, scope);
+  AVAR(frame, refs);
+  value xs, free;
+  AFBEGIN;
+  if (!CONS_P(AV(expr)))
+    ARETURN(CNIL);
+  WV(frame, arc_mkhash(c, ARC_HASHBITS));
+  WV(refs, scan_args(c, AV(scan), AV(frame), car(AV(expr)), CNIL));
+  WV(scope, cons(c, AV(frame), AV(scope)));
+  AFCALL(ARC_AFF(c, scan_body), AV(refs), AV(scan), AV(scope));
+  WV(refs, AFCRV);
+  AFCALL(ARC_AFF(c, scan_body), cdr(AV(expr)), AV(scan), AV(scope));
+  free = CNIL;
+  for (xs = scan_union(c, AFCRV, AV(refs)); xs; xs = cdr(xs)) {
+    if (!BOUND_P(arc_hash_lookup(c, AV(frame), car(xs))))
+      free = cons(c, car(xs), free);
+  }
+  scan_insert(c, AV(scan), SCAN_FNS, AV(expr), free);
+  ARETURN(free);
+  AFEND;
+}
+AFFEND
+
+/* Only the parts of an if that compile_if compiles are scanned */
+static AFFDEF(scan_if)
+{
+  AARG(args, scan, scope);
+  AVAR(refs);
+  value test;
+  AFBEGIN;
+  if (!CONS_P(AV(args)))
+    ARETURN(CNIL);
+  if (!CONS_P(cdr(AV(args))))
+    AFTCALL(ARC_AFF(c, scan_expr), car(AV(args)), AV(scan), AV(scope));
+  test = const_test(c, car(AV(args)), AV(scope));
+  if (test == CTRUE)
+    AFTCALL(ARC_AFF(c, scan_expr), cadr(AV(args)), AV(scan), AV(scope));
+  if (NIL_P(test))
+    AFTCALL(ARC_AFF(c, scan_if), cddr(AV(args)), AV(scan), AV(scope));
+  AFCALL(ARC_AFF(c, scan_body), cons(c, car(AV(args)),
+				     cons(c, cadr(AV(args)), CNIL)),
+	 AV(scan), AV(scope));
+  WV(refs, AFCRV);
+  AFCALL(ARC_AFF(c, scan_if), cddr(AV(args)), AV(scan), AV(scope));
+  ARETURN(scan_union(c, AFCRV, AV(refs)));
+  AFEND;
+}
+AFFEND
+
+static AFFDEF(scan_assign)
+{
+  AARG(expr, scan, scope);
+  AVAR(refs, a);
+  int frameno, idx;
+  AFBEGIN;
+  WV(refs, CNIL);
+  for (; CONS_P(AV(expr)); WV(expr, cdr(AV(expr)))) {
+    AFCALL(ARC_AFF(c, macex), car(AV(expr)), CTRUE);
+    WV(a, AFCRV);
+    if (SYMBOL_P(AV(a))) {
+      arc_hash_insert(c, VINDEX(AV(scan), SCAN_ASSIGNED), AV(a), CTRUE);
+      if (find_var(c, AV(a), AV(scope), &frameno, &idx) == CTRUE)
+	WV(refs, scan_union(c, cons(c, AV(a), CNIL), AV(refs)));
+    }
+    WV(expr, cdr(AV(expr)));
+    if (!CONS_P(AV(expr)))
+      break;
+    AFCALL(ARC_AFF(c, scan_expr), car(AV(expr)), AV(scan), AV(scope));
+    WV(refs, scan_union(c, AFCRV, AV(refs)));
+  }
+  ARETURN(AV(refs));
+  AFEND;
+}
+AFFEND
+
+/* Scan expr in scope, a list of the frames of the fns around it, and
+   return the variables it references that are bound in scope */
+static AFFDEF(scan_expr)
+{
+  AARG(expr, scan, scope);
+  AVAR(op, refs);
+  value x;
+  int frameno, idx;
+  AFBEGIN;
+  if (SYMBOL_P(AV(expr))) {
+    if (!NIL_P(arc_ssyntax(c, AV(expr)))) {
+      AFCALL(ARC_AFF(c, arc_ssexpand), AV(expr));
+      AFTCALL(ARC_AFF(c, scan_expr), AFCRV, AV(scan), AV(scope));
+    }
+    if (find_var(c, AV(expr), AV(scope), &frameno, &idx) == CTRUE)
+      ARETURN(cons(c, AV(expr), CNIL));
+    ARETURN(CNIL);
+  }
+  if (!CONS_P(AV(expr)))
+    ARETURN(CNIL);
+  WV(op, car(AV(expr)));
+  if (AV(op) == ARC_BUILTIN(c, S_QUOTE))
+    ARETURN(CNIL);
+  if (AV(op) == ARC_BUILTIN(c, S_FN))
+    AFTCALL(ARC_AFF(c, scan_fn), cdr(AV(expr)), AV(scan), AV(scope));
+  if (AV(op) == ARC_BUILTIN(c, S_IF))
+    AFTCALL(ARC_AFF(c, scan_if), cdr(AV(expr)), AV(scan), AV(scope));
+  if (AV(op) == ARC_BUILTIN(c, S_ASSIGN))
+    AFTCALL(ARC_AFF(c, scan_assign), cdr(AV(expr)), AV(scan), AV(scope));
+
+  if (SYMBOL_P(AV(op)) && NIL_P(arc_ssyntax(c, AV(op)))
+      && !NIL_P(x = ismacro(c, AV(op)))) {
+    if (!BOUND_P(scan_lookup(c, AV(scan), SCAN_EXPS, AV(expr)))) {
+      AFCALL(ARC_AFF(c, expand), x, AV(expr));
+      scan_insert(c, AV(scan), SCAN_EXPS, AV(expr), AFCRV);
+    }
+    AFTCALL(ARC_AFF(c, scan_expr),
+	    scan_lookup(c, AV(scan), SCAN_EXPS, AV(expr)),
+	    AV(scan), AV(scope));
+  }
+
+  /* compose, complement and andf in a functional position are
+     scanned as compile_list would rewrite them */
+  if (SYMBOL_P(AV(op)) && !NIL_P(arc_ssyntax(c, AV(op)))) {
+    AFCALL(ARC_AFF(c, arc_ssexpand), AV(op));
+    WV(op, AFCRV);
+  }
+  if (CONS_P(AV(op)) && car(AV(op)) == ARC_BUILTIN(c, S_COMPOSE)) {
+    AFTCALL(ARC_AFF(c, scan_expr), fold(c, cdr(AV(op)), cdr(AV(expr))),
+	    AV(scan), AV(scope));
+  }
+  if (CONS_P(AV(op)) && car(AV(op)) == ARC_BUILTIN(c, S_COMPLEMENT)
+      && CONS_P(cdr(AV(op))) && NIL_P(cddr(AV(op)))) {
+    x = cons(c, cadr(AV(op)), cdr(AV(expr)));
+    AFTCALL(ARC_AFF(c, scan_expr),
+	    cons(c, ARC_BUILTIN(c, S_NO), cons(c, x, CNIL)),
+	    AV(scan), AV(scope));
+  }
+  if (CONS_P(AV(op)) && car(AV(op)) == ARC_BUILTIN(c, S_ANDF)) {
+    AFCALL(ARC_AFF(c, scan_body), cdr(AV(op)), AV(scan), AV(scope));
+    WV(refs, AFCRV);
+    AFCALL(ARC_AFF(c, scan_body), cdr(AV(expr)), AV(scan), AV(scope));
+    ARETURN(scan_union(c, AFCRV, AV(refs)));
+  }
+  AFCALL(ARC_AFF(c, scan_expr), AV(op), AV(scan), AV(scope));
+  WV(refs, AFCRV);
+  AFCALL(ARC_AFF(c, scan_body), cdr(AV(expr)), AV(scan), AV(scope));
+  ARETURN(scan_union(c, AFCRV, AV(refs)));
+  AFEND;
+}
+AFFEND
+
 static AFFDEF(compile_list)
 {
   AARG(nexpr, ctx, env, cont);
-  AVAR(expr, xs);
+  AVAR(expr, xs, changed);
   int (*fun)(arc *, value) = NULL;
   AFBEGIN;
 
   /* Special forms: if/fn/quote/quasiquote/assign */
   if ((fun = spform(c, car(AV(nexpr)))) != NULL) {
-    AFTCALL(arc_mkaff(c, fun, CNIL), cdr(AV(nexpr)), AV(ctx), AV(env),
+    AFTCALL(ARC_AFF(c, fun), cdr(AV(nexpr)), AV(ctx), AV(env),
 	    AV(cont));
   }
 
-  /* expand all ssyntax within the expression if it isn't a special form */
+  /* expand all ssyntax within the expression if it isn't a special
+     form, keeping the expression itself if there is none, so that any
+     expansion of it that scan_expr made is found (see compile_apply) */
   WV(expr, CNIL);
   WV(xs, AV(nexpr));
+  WV(changed, CNIL);
   while (!NIL_P(AV(xs))) {
     value result = CNIL;
 
     if (SYMBOL_P(car(AV(xs)))) {
-      AFCALL(arc_mkaff(c, arc_ssexpand, CNIL), car(AV(xs)));
+      AFCALL(ARC_AFF(c, arc_ssexpand), car(AV(xs)));
       result = AFCRV;
     }
     if (NIL_P(result))
       result = car(AV(xs));
+    else
+      WV(changed, CTRUE);
     WV(expr, cons(c, result, AV(expr)));
     WV(xs, cdr(AV(xs)));
   }
-  WV(expr, arc_list_reverse(c, AV(expr)));
+  WV(expr, (NIL_P(AV(changed))) ? AV(nexpr)
+     : arc_list_reverse(c, AV(expr)));
+
+  if (optimizing(c)) {
+    WV(expr, fold_consts(c, AV(expr), AV(env)));
+    if (!CONS_P(AV(expr)))
+      ARETURN(compile_literal(c, AV(expr), AV(ctx), AV(cont)));
+  }
 
   /* Inline functions (cons, car, cdr, +, -, *, /) */
   if ((fun = inline_func(c, car(AV(expr)))) != NULL) {
-    AFTCALL(arc_mkaff(c, fun, CNIL), AV(expr), AV(ctx), AV(env), AV(cont));
+    AFTCALL(ARC_AFF(c, fun), AV(expr), AV(ctx), AV(env), AV(cont));
+  }
+
+  /* A fn with no arguments applied to nothing, which is what do
+     expands into, is just its body, and need not be made into a
+     closure and called. */
+  if (optimizing(c) && CONS_P(car(AV(expr))) && NIL_P(cdr(AV(expr)))
+      && car(car(AV(expr))) == ARC_BUILTIN(c, S_FN)
+      && CONS_P(cdr(car(AV(expr)))) && NIL_P(cadr(car(AV(expr))))) {
+    AFTCALL(ARC_AFF(c, compile_body), cddr(car(AV(expr))),
+	    AV(ctx), AV(env), AV(cont));
   }
 
   /*  the next three clauses could be removed without changing semantics
@@ -1068,24 +2307,24 @@ static AFFDEF(compile_list)
   /* compose in a functional position */
   if (CONS_P(car(AV(expr)))
       && car(car(AV(expr))) == ARC_BUILTIN(c, S_COMPOSE)) {
-    AFTCALL(arc_mkaff(c, compile_compose, CNIL), AV(expr), AV(ctx), AV(env),
+    AFTCALL(ARC_AFF(c, compile_compose), AV(expr), AV(ctx), AV(env),
 	    AV(cont));
   }
 
   /* complement in a functional position */
   if (CONS_P(car(AV(expr)))
       && car(car(AV(expr))) == ARC_BUILTIN(c, S_COMPLEMENT)) {
-    AFTCALL(arc_mkaff(c, compile_complement, CNIL), AV(expr), AV(ctx),
+    AFTCALL(ARC_AFF(c, compile_complement), AV(expr), AV(ctx),
 	    AV(env), AV(cont));
   }
 
   /* andf in a functional position */
   if (CONS_P(car(AV(expr))) && car(car(AV(expr))) == ARC_BUILTIN(c, S_ANDF)) {
-    AFTCALL(arc_mkaff(c, compile_andf, CNIL), AV(expr), AV(ctx),
+    AFTCALL(ARC_AFF(c, compile_andf), AV(expr), AV(ctx),
 	    AV(env), AV(cont));
   }
 
-  AFTCALL(arc_mkaff(c, compile_apply, CNIL), AV(expr), AV(ctx), AV(env),
+  AFTCALL(ARC_AFF(c, compile_apply), AV(expr), AV(ctx), AV(env),
 	  AV(cont));
   AFEND;
 }
@@ -1108,20 +2347,20 @@ AFFDEF(arc_compile)
   }
 
   if (SYMBOL_P(AV(expr))) {
-    AFCALL(arc_mkaff(c, arc_ssexpand, CNIL), AV(expr));
+    AFCALL(ARC_AFF(c, arc_ssexpand), AV(expr));
     WV(ssx, AFCRV);
     if (NIL_P(AV(ssx))) {
       ARETURN(compile_ident(c, AV(expr), AV(ctx), AV(env), AV(cont)));
     }
-    AFTCALL(arc_mkaff(c, arc_compile, CNIL), AV(ssx), AV(ctx),
+    AFTCALL(ARC_AFF(c, arc_compile), AV(ssx), AV(ctx),
 	    AV(env), AV(cont));
   }
 
   if (CONS_P(AV(expr))) {
-    AFTCALL(arc_mkaff(c, compile_list, CNIL), AV(expr), AV(ctx),
+    AFTCALL(ARC_AFF(c, compile_list), AV(expr), AV(ctx),
 	    AV(env), AV(cont));
   }
-  arc_err_cstrfmt_line(c, get_lineno(c, AV(expr)), "invalid_expression");
+  arc_err_cstrfmt_line(c, get_fileline(c, AV(expr)), "invalid_expression");
   ARETURN(AV(ctx));
   AFEND;
 }
@@ -1131,7 +2370,7 @@ AFFDEF(arc_macex)
 {
   AARG(e);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, macex, CNIL), AV(e), CTRUE);
+  AFTCALL(ARC_AFF(c, macex), AV(e), CTRUE);
   AFEND;
 }
 AFFEND
@@ -1140,7 +2379,7 @@ AFFDEF(arc_macex1)
 {
   AARG(e);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, macex, CNIL), AV(e), CNIL);
+  AFTCALL(ARC_AFF(c, macex), AV(e), CNIL);
   AFEND;
 }
 AFFEND
@@ -1175,7 +2414,7 @@ AFFEND
 static AFFDEF(duringthunk)
 {
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, arc_compile, CNIL),
+  AFTCALL(ARC_AFF(c, arc_compile),
 	  __arc_getenv(c, thr, 1, 0), /* AV(expr) */
 	  __arc_getenv(c, thr, 1, 2), /* AV(ctx) */
 	  CNIL, CTRUE);
@@ -1205,13 +2444,13 @@ AFFDEF(arc_eval)
   __arc_reset_lineno(c, AV(lndata));
   WV(ctx, arc_mkcctx(c));
   if (BOUND_P(AV(lndata)))
-    arc_cctx_mksrc(c, AV(ctx));
-  AFCALL(arc_mkaff(c, arc_dynamic_wind, CNIL),
-	 arc_mkaff2(c, beforethunk, CNIL, TENVR(thr)),
-	 arc_mkaff2(c, duringthunk, CNIL, TENVR(thr)),
-	 arc_mkaff2(c, afterthunk, CNIL, TENVR(thr)));
+    arc_cctx_mksrc(c, AV(ctx), car(__arc_get_fileline(c, AV(lndata), CNIL)));
+  AFCALL(ARC_AFF(c, arc_dynamic_wind),
+	 arc_mkaff_nested(c, beforethunk, CNIL, thr),
+	 arc_mkaff_nested(c, duringthunk, CNIL, thr),
+	 arc_mkaff_nested(c, afterthunk, CNIL, thr));
   /*
-  AFCALL(arc_mkaff(c, arc_compile, CNIL), AV(expr), AV(ctx), CNIL, CTRUE);
+  AFCALL(ARC_AFF(c, arc_compile), AV(expr), AV(ctx), CNIL, CTRUE);
   */
   code = arc_cctx2code(c, AV(ctx));
   clos = arc_mkclos(c, code, CNIL);
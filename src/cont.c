@@ -29,6 +29,13 @@
    Heap-based continuations are vectors that contain essentially the
    same information.  Since they are visible distinctly they have their
    own data type.
+
+   A third kind of continuation marks the boundary between two chunks
+   of a thread's stack (see thread.c).  It is a heap continuation with
+   no offset, whose stack is the whole of the stack chunk that was in
+   use when the current chunk was started, and whose parent is a stack
+   continuation on that chunk.  Restoring it makes that chunk current
+   again, and goes on to restore its parent.
 */
 #include "arcueid.h"
 #include "vmengine.h"
@@ -49,6 +56,7 @@ value __arc_mkcont(arc *c, value thr, int offset)
 {
   value cont, tsfn;
 
+  __arc_stackreserve(c, thr, CONT_SIZE);
   tsfn = INT2FIX(TSTOP(thr) - TSFN(thr));
   CPUSH(thr, tsfn);
   CPUSH(thr, INT2FIX(offset));
@@ -60,17 +68,36 @@ value __arc_mkcont(arc *c, value thr, int offset)
   return(cont);
 }
 
+/* Make a stack segment boundary for chunk, with cont the last
+   continuation made on it. */
+value __arc_mkcontseg(arc *c, value chunk, value cont)
+{
+  value seg = mkcont(c);
+
+  CONT_OFS(seg) = CNIL;
+  CONT_FUN(seg) = CNIL;
+  CONT_ENV(seg) = CNIL;
+  CONT_ARGC(seg) = INT2FIX(0);
+  CONT_CONT(seg) = cont;
+  CONT_STK(seg) = chunk;
+  return(seg);
+}
+
 void arc_restorecont(arc *c, value thr, value cont)
 {
   int offset, i;
 
+  if (TYPE(cont) == T_CONT && CONT_SEGMENT_P(cont))
+    cont = __arc_stackunderflow(c, thr, cont);
+
   if (TYPE(cont) == T_FIXNUM) {
     /* A continuation on the stack is just an offset into the stack. */
     TSP(thr) = TSTOP(thr) - FIX2INT(cont);
     SCONR(thr, CPOP(thr));
     TARGC(thr) = FIX2INT(CPOP(thr));
     SFUNR(thr, CPOP(thr));
-    SENVR(thr, CPOP(thr));
+    /* the saved environment may have since been moved to the heap */
+    SENVR(thr, __arc_envfwd(c, thr, CPOP(thr)));
     offset = FIX2INT(CPOP(thr));
     TSFN(thr) = TSTOP(thr) - FIX2INT(CPOP(thr));
   } else {
@@ -105,32 +132,6 @@ static value nextcont(arc *c, value thr, value cont)
   return(CONT_CONT(cont));
 }
 
-static value *contenv(arc *c, value thr, value cont)
-{
-  value *sp;
-
-  if (FIXNUM_P(cont)) {
-    sp = TSTOP(thr) - FIX2INT(cont);
-    return(sp + 4);
-  }
-  return(&CONT_ENV(cont));
-}
-
-/* Update environments in the continuations referred to in the continuation
-   register so oldenv always points to nenv */
-void __arc_update_cont_envs(arc *c, value thr, value oldenv, value nenv)
-{
-  value cont, *ce;
-
-  for (cont=TCONR(thr); !NIL_P(cont); cont = nextcont(c, thr, cont)) {
-    ce = contenv(c, thr, cont);
-    if (*ce == oldenv) {
-      __arc_wb(*ce, nenv);
-      *ce = nenv;
-    }
-  }
-}
-
 /* Move a single continuation to the heap.  This will move any environments
    referenced by the continuation to the heap as well. */
 static value heap_cont(arc *c, value thr, value cont)
@@ -159,12 +160,39 @@ static value heap_cont(arc *c, value thr, value cont)
   /* save the stack up to the saved TSFN */
   tsfn = TSTOP(thr) - FIX2INT(*(sp+6));
   sslen = tsfn - (sp + 6);
+  /* Every way of entering a function sets TSFN, so the TSFN saved is
+     never nearer the top of the stack than the continuation */
+  assert(sslen >= 0);
   CONT_STK(ncont) = arc_mkvector(c, sslen);
   for (i=0; i<sslen; i++)
     SVINDEX(CONT_STK(ncont), i, *(tsfn - i));
   return(ncont);
 }
 
+/* Move the continuations sealed in a stack segment boundary into the
+   heap.  This is done with the chunk of the segment temporarily made
+   current, so that the stack continuations and stack environments on
+   it can be found.  The segment itself is then no longer needed. */
+static value seg2heap(arc *c, value thr, value seg)
+{
+  value stack, envr, *sp, *fn, cont;
+
+  if (NIL_P(CONT_STK(seg)))
+    return(__arc_cont2heap(c, thr, CONT_CONT(seg)));
+  stack = TSTACK(thr);
+  envr = TENVR(thr);
+  sp = TSP(thr);
+  fn = TSFN(thr);
+  __arc_stackswitch(thr, CONT_STK(seg));
+  SENVR(thr, CNIL);
+  cont = __arc_cont2heap(c, thr, CONT_CONT(seg));
+  __arc_stackswitch(thr, stack);
+  SENVR(thr, envr);
+  TSP(thr) = sp;
+  TSFN(thr) = fn;
+  return(cont);
+}
+
 /* Move a continuation and all its parent continuations into the heap. */
 value __arc_cont2heap(arc *c, value thr, value cont)
 {
@@ -172,6 +200,8 @@ value __arc_cont2heap(arc *c, value thr, value cont)
 
   oldcont = initcont = CNIL;
   while (!NIL_P(cont)) {
+    if (TYPE(cont) == T_CONT && CONT_SEGMENT_P(cont))
+      cont = seg2heap(c, thr, cont);
     cont = heap_cont(c, thr, cont);
     if (NIL_P(initcont))
       initcont = cont;
@@ -183,6 +213,71 @@ value __arc_cont2heap(arc *c, value thr, value cont)
   return(initcont);
 }
 
+/* Find the continuation made with the environment env in the
+   continuation chain of thr.  This looks through stack segment
+   boundaries without restoring them, and tells which chunk the
+   continuation is in, if it is on the stack at all. */
+static value findcont(arc *c, value thr, value env, value *chunk)
+{
+  value cont, *top, *sp;
+
+  *chunk = TSTACK(thr);
+  top = TSTOP(thr);
+  for (cont = TCONR(thr); !NIL_P(cont);) {
+    if (FIXNUM_P(cont)) {
+      sp = top - FIX2INT(cont);
+      if (*(sp+4) == env)
+	return(cont);
+      cont = *(sp+1);
+    } else if (CONT_SEGMENT_P(cont)) {
+      if (!NIL_P(CONT_STK(cont))) {
+	*chunk = CONT_STK(cont);
+	top = &XVINDEX(*chunk, VECLEN(*chunk)-1);
+      }
+      cont = CONT_CONT(cont);
+    } else {
+      if (CONT_ENV(cont) == env) {
+	*chunk = CNIL;
+	return(cont);
+      }
+      cont = CONT_CONT(cont);
+    }
+  }
+  return(CNIL);
+}
+
+/* Tell whether a continuation made with the heap environment env is
+   still in the continuation chain of thr */
+int __arc_escapable(arc *c, value thr, value env)
+{
+  value chunk;
+
+  return(!NIL_P(findcont(c, thr, env, &chunk)));
+}
+
+/* Make the continuation made with the heap environment env the
+   current continuation of thr, discarding everything that was done
+   since it was made.  No frames are copied to the heap.  Returns zero
+   if there is no such continuation, i.e. the function that made it
+   has already returned. */
+int __arc_escape(arc *c, value thr, value env)
+{
+  value target, chunk, cont;
+
+  target = findcont(c, thr, env, &chunk);
+  if (NIL_P(target))
+    return(0);
+  /* Return through every stack segment boundary in between */
+  cont = TCONR(thr);
+  while (!NIL_P(chunk) && TSTACK(thr) != chunk) {
+    while (FIXNUM_P(cont))
+      cont = *(TSTOP(thr) - FIX2INT(cont) + 1);
+    cont = __arc_stackunderflow(c, thr, cont);
+  }
+  SCONR(thr, target);
+  return(1);
+}
+
 #if 0
 static value cont_pprint(arc *c, value sexpr, value *ppstr, value visithash)
 {
@@ -191,6 +286,25 @@ static value cont_pprint(arc *c, value sexpr, value *ppstr, value visithash)
 }
 #endif
 
+/* A stack segment boundary is responsible for marking the contents of
+   its chunk, as it is not in use by any thread. */
+static void cont_marker(arc *c, value cont, int depth,
+			void (*markfn)(arc *, value, int))
+{
+  value chunk;
+  int i;
+
+  if (!CONT_SEGMENT_P(cont) || NIL_P(CONT_STK(cont))) {
+    __arc_vector_marker(c, cont, depth, markfn);
+    return;
+  }
+  markfn(c, CONT_CONT(cont), depth);
+  chunk = CONT_STK(cont);
+  markfn(c, chunk, -1);
+  for (i=0; i<VECLEN(chunk); i++)
+    markfn(c, XVINDEX(chunk, i), depth);
+}
+
 static int cont_apply(arc *c, value thr, value cont)
 {
   /* Applying a continuation just means it goes on the continuation
@@ -206,7 +320,7 @@ static int cont_apply(arc *c, value thr, value cont)
 }
 
 typefn_t __arc_cont_typefn__ = {
-  __arc_vector_marker,
+  cont_marker,
   __arc_null_sweeper,
   NULL,
   NULL,
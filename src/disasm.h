@@ -75,7 +75,7 @@ static const char *disasm_opcodes[] = {
 	"??",
 	"consr",
 	"??",
-	"??",
+	"clsn",
 	"??",
 	"dcar",
 	"??",
@@ -83,17 +83,17 @@ static const char *disasm_opcodes[] = {
 	"??",
 	"spl",
 	"??",
+	"addfx",
 	"??",
+	"subfx",
 	"??",
+	"mulfx",
 	"??",
+	"addfl",
 	"??",
+	"subfl",
 	"??",
-	"??",
-	"??",
-	"??",
-	"??",
-	"??",
-	"??",
+	"mulfl",
 	"??",
 	"??",
 	"??",
@@ -143,7 +143,7 @@ static const char *disasm_opcodes[] = {
 	"??",
 	"stg",
 	"??",
-	"??",
+	"clsf",
 	"??",
 	"??",
 	"??",
@@ -165,9 +165,9 @@ static const char *disasm_opcodes[] = {
 	"??",
 	"jbnd",
 	"??",
+	"addi",
 	"??",
-	"??",
-	"??",
+	"subi",
 	"??",
 	"??",
 	"??",
@@ -277,9 +277,9 @@ static const char *disasm_opcodes[] = {
 	"??",
 	"cont",
 	"??",
+	"jself",
 	"??",
-	"??",
-	"??",
+	"jinl",
 	"??",
 	"??",
 	"??",
@@ -409,11 +409,11 @@ static const char *disasm_opcodes[] = {
 	"??",
 	"envr",
 	"??",
+	"envl",
 	"??",
+	"applyr",
 	"??",
-	"??",
-	"??",
-	"??",
+	"tapplyr",
 	"??",
 	"??",
 	"??",
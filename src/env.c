@@ -52,6 +52,17 @@
    This strategy is what Clinger et. al. [1] call the stack/heap
    strategy.
 
+   When a stack environment is moved to the heap, the count slot of
+   the environment on the stack is overwritten with the heap copy,
+   which serves as a forwarding pointer.  Continuations and
+   environments on the stack that still refer to the old stack
+   environment are thus not updated when the move happens: the
+   forwarding pointer is instead followed whenever such a reference
+   is used (see __arc_envfwd).  Since the stack environment cannot be
+   popped off the stack before any continuation that refers to it is
+   restored, the forwarding pointer remains valid as long as it is
+   needed.
+
    Environments that have been saved on the heap are Arcueid vectors
    with a specific structure:
 
@@ -74,6 +85,8 @@ void __arc_mkenv(arc *c, value thr, int prevsize, int extrasize)
   value *envstart;
   int i, esofs;
 
+  /* The environment must not straddle two stack chunks */
+  __arc_stackreserve(c, thr, extrasize + 2);
   /* Add the extra environment entries */
   for (i=0; i<extrasize; i++)
     CPUSH(thr, CUNBOUND);
@@ -94,6 +107,22 @@ void __arc_mkenv(arc *c, value thr, int prevsize, int extrasize)
 #define VENV_INDEX(x, i) (XVINDEX((x), (i)+1))
 #define VENV_CREATE(c, count) (arc_mkvector(c, count+1));
 
+#define SENV_FORWARDED(base) (!FIXNUM_P(*(base + 1)))
+#define SENV_FORWARD(base) (*(base + 1))
+
+/* If env is a stack environment that has been moved to the heap,
+   return the heap environment it was moved to.  Otherwise, return
+   env unchanged. */
+value __arc_envfwd(arc *c, value thr, value env)
+{
+  value *senv;
+
+  if (!ENV_P(env))
+    return(env);
+  senv = SENV_PTR(TSTOP(thr), env);
+  return(SENV_FORWARDED(senv) ? SENV_FORWARD(senv) : env);
+}
+
 static value nextenv(arc *c, value thr, value env)
 {
   value *envptr;
@@ -105,9 +134,10 @@ static value nextenv(arc *c, value thr, value env)
     return(VENV_NEXT(env));
 
   /* We have a stack-based environment.  Get the address of the
-     environment pointer from the stack. */
+     environment pointer from the stack.  The parent environment
+     may have since been moved to the heap. */
   envptr = SENV_PTR(TSTOP(thr), env);
-  return(*envptr);
+  return(__arc_envfwd(c, thr, *envptr));
 }
 
 /* Get a value from the environment pointer given. */
@@ -243,22 +273,53 @@ static value heap_env(arc *c, value thr, value env)
   return(henv);
 }
 
+/* Make a heap environment with no parent out of the top n values on
+   the stack, the value pushed last becoming its last element.  This is
+   the environment of a flat closure (see iclsf), which holds only the
+   values of the variables it captures. */
+value __arc_mkflatenv(arc *c, value thr, int n)
+{
+  value henv;
+  int i;
+
+  henv = VENV_CREATE(c, n);
+  for (i=n-1; i>=0; i--)
+    VENV_INDEX(henv, i) = CPOP(thr);
+  return(henv);
+}
+
 /* Move the current environment and all of its parent environments into
-   the heap.  Also adjusts the environment pointers in continuations
-   referring to them accordingly. */
+   the heap.  Each stack environment moved leaves a forwarding pointer
+   to its heap copy behind, so continuations referring to them need not
+   be updated, and the move is linear in the number of environments
+   moved.  Parents of a heap environment are always on the heap, so we
+   can stop as soon as we reach one. */
 value __arc_env2heap(arc *c, value thr, value env)
 {
-  value nenv = env, oldenv;
-
-  env = CNIL;
-  while (!NIL_P(nenv)) {
-    /* Do nothing if the environment is already on the heap */
-    oldenv = nenv;
-    nenv = (TYPE(oldenv) == T_VECTOR) ? oldenv : heap_env(c, thr, oldenv);
-    if (NIL_P(env))
-      env = nenv;
-    __arc_update_cont_envs(c, thr, oldenv, nenv);
-    nenv = nextenv(c, thr, nenv);
+  value henv, prev, first, *senv;
+
+  first = prev = CNIL;
+  for (;;) {
+    env = __arc_envfwd(c, thr, env);
+    if (ENV_P(env)) {
+      henv = heap_env(c, thr, env);
+      senv = SENV_PTR(TSTOP(thr), env);
+      __arc_wb(SENV_FORWARD(senv), henv);
+      SENV_FORWARD(senv) = henv;
+    } else {
+      henv = env;
+    }
+    if (NIL_P(prev))
+      first = henv;
+    else
+      SVENV_NEXT(prev, henv);
+    if (!ENV_P(env))
+      break;
+    prev = henv;
+    env = VENV_NEXT(henv);
   }
-  return(env);
+  /* The environment register must never refer to a forwarded stack
+     environment. */
+  SENVR(thr, __arc_envfwd(c, thr, TENVR(thr)));
+  return(first);
 }
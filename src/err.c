@@ -38,7 +38,7 @@ void *alloca (size_t);
 
 /*
   (def on-err (handler thunk)
-    (ccc (fn (cont)
+    (call/ec (fn (cont)
             (let old nil
                (dynamic-wind (fn () (= old *exh)
                                     (= *exh (cons cont handler)))
@@ -99,12 +99,11 @@ static AFFDEF(ccchandler)
   AFBEGIN;
   (void)old;
   (void)cont;
-  SENVR(thr, __arc_env2heap(c, thr, TENVR(thr)));
   /* (dynamic-wind ... thunk ...) */
-  AFTCALL(arc_mkaff(c, arc_dynamic_wind, CNIL),
-	  arc_mkaff2(c, savetexh, CNIL, TENVR(thr)),
+  AFTCALL(ARC_AFF(c, arc_dynamic_wind),
+	  arc_mkaff_nested(c, savetexh, CNIL, thr),
 	  __arc_getenv(c, thr, 1, 1), /* thunk from arc_on_err */
-	  arc_mkaff2(c, restoretexh, CNIL, TENVR(thr)));
+	  arc_mkaff_nested(c, restoretexh, CNIL, thr));
   AFEND;
 }
 AFFEND
@@ -118,9 +117,8 @@ AFFDEF(arc_on_err)
      indirectly. */
   (void)handler;
   (void)thunk;
-  SENVR(thr, __arc_env2heap(c, thr, TENVR(thr)));
-  AFCALL(arc_mkaff(c, arc_callcc, CNIL), arc_mkaff2(c, ccchandler, CNIL,
-						    TENVR(thr)));
+  AFCALL(ARC_AFF(c, arc_callec),
+	 arc_mkaff_nested(c, ccchandler, CNIL, thr));
   ret = AFCRV;
   if (TYPE(ret) != T_EXCEPTION)
     ARETURN(ret);
@@ -162,7 +160,7 @@ AFFDEF(arc_err)
        handler if one is set, and longjmp away.  The thread becomes
        broken if this happens. */
     /* First we need to reroot to the root */
-    AFCALL(arc_mkaff(c, __arc_reroot, CNIL), TBCH(thr));
+    AFCALL(ARC_AFF(c, __arc_reroot), TBCH(thr));
     TSTATE(thr) = Tbroken;
     if (c->errhandler != NULL)
       c->errhandler(c, thr, arc_details(c, AV(exc)));
@@ -189,7 +187,7 @@ static void va_err_cstrfmt(arc *c, const char *fmt, va_list ap)
   str = arc_mkstringc(c, cstr);
   /* This is how we can invoke arc_err from a non-AFF */
   __arc_mkenv(c, c->curthread, 0, 0);	/* null env required */
-  __arc_affapply(c, c->curthread, CNIL, arc_mkaff(c, arc_err, CNIL), str,
+  __arc_affapply(c, c->curthread, CNIL, ARC_AFF(c, arc_err), str,
 		 CLASTARG);
   longjmp(TEJMP(c->curthread), 1);
 }
@@ -230,7 +228,7 @@ void arc_err_cstrfmt_line(arc *c, value fileline, const char *fmt, ...)
   str = arc_strcat(c, arc_mkstringc(c, filelinestr), str);
   /* This is how we can invoke arc_err from a non-AFF */
   __arc_mkenv(c, c->curthread, 0, 0);	/* null env required */
-  __arc_affapply(c, c->curthread, CNIL, arc_mkaff(c, arc_err, CNIL), str,
+  __arc_affapply(c, c->curthread, CNIL, ARC_AFF(c, arc_err), str,
 		 CLASTARG);
   longjmp(TEJMP(c->curthread), 1);
 }
@@ -241,8 +239,8 @@ static AFFDEF(exception_pprint)
   AOARG(visithash);
   AVAR(dw, wc);
   AFBEGIN;
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
+  WV(wc, ARC_AFF(c, arc_writec));
   AFCALL(AV(dw), arc_mkstringc(c, "#<exception: "), CTRUE, AV(fp), CNIL);
   AFCALL(AV(dw), arc_details(c, AV(sexpr)), AV(disp), AV(fp), AV(visithash));
   AFCALL(AV(wc), arc_mkchar(c, '>'), AV(fp));
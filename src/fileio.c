@@ -77,7 +77,7 @@ static void fio_sweeper(arc *c, value v)
 static AFFDEF(fio_closed_p)
 {
   AARG(fio);
-  AFBEGIN;
+  AFLBEGIN;
   ARETURN((FIODATA(AV(fio))->closed) ? CTRUE : CNIL);
   AFEND;
 }
@@ -146,7 +146,7 @@ AFFEND
 static AFFDEF(fio_wready)
 {
   AARG(fio);
-  AFBEGIN;
+  AFLBEGIN;
   (void)fio;
   ARETURN(CTRUE);   /* XXX - make this do something more reasonable */
   AFEND;
@@ -157,7 +157,7 @@ static AFFDEF(fio_getb)
 {
   AARG(fio);
   int byte;
-  AFBEGIN;
+  AFLBEGIN;
   byte = fgetc(FIODATA(AV(fio))->fp);
   if (byte < 0)
     ARETURN(CNIL);
@@ -171,7 +171,7 @@ static AFFDEF(fio_putb)
   AARG(fio, byte);
   int rv;
 
-  AFBEGIN;
+  AFLBEGIN;
   rv = fputc(FIX2INT(AV(byte)), FIODATA(AV(fio))->fp);
   if (rv < 0)
     ARETURN(CNIL);
@@ -183,7 +183,7 @@ AFFEND
 static AFFDEF(fio_seek)
 {
   AARG(fio, offset, whence);
-  AFBEGIN;
+  AFLBEGIN;
   if (!(FIX2INT(AV(whence)) == SEEK_SET || FIX2INT(AV(whence)) == SEEK_CUR ||
 	FIX2INT(AV(whence)) == SEEK_END)) {
     arc_err_cstrfmt(c, "invalid seek whence argument");
@@ -218,7 +218,7 @@ AFFEND
 static AFFDEF(fio_tell)
 {
   AARG(fio);
-  AFBEGIN;
+  AFLBEGIN;
 #ifdef HAVE_FSEEKO
   off_t offset;
 
@@ -237,7 +237,7 @@ AFFEND
 static AFFDEF(pio_close)
 {
   AARG(fio);
-  AFBEGIN;
+  AFLBEGIN;
   if (FIODATA(AV(fio))->closed == 0) {
     pclose(FIODATA(AV(fio))->fp);
     FIODATA(AV(fio))->closed = 1;
@@ -250,7 +250,7 @@ AFFEND
 static AFFDEF(fio_close)
 {
   AARG(fio);
-  AFBEGIN;
+  AFLBEGIN;
   if (FIODATA(AV(fio))->closed == 0) {
     fclose(FIODATA(AV(fio))->fp);
     FIODATA(AV(fio))->closed = 1;
@@ -362,25 +362,25 @@ void __arc_init_fio(arc *c)
   value io_ops;
 
   io_ops = arc_mkvector(c, IO_last+1);
-  SVINDEX(io_ops, IO_closed_p, arc_mkaff(c, fio_closed_p, CNIL));
-  SVINDEX(io_ops, IO_ready, arc_mkaff(c, fio_ready, CNIL));
-  SVINDEX(io_ops, IO_wready, arc_mkaff(c, fio_wready, CNIL));
-  SVINDEX(io_ops, IO_getb, arc_mkaff(c, fio_getb, CNIL));
-  SVINDEX(io_ops, IO_putb, arc_mkaff(c, fio_putb, CNIL));
-  SVINDEX(io_ops, IO_seek, arc_mkaff(c, fio_seek, CNIL));
-  SVINDEX(io_ops, IO_tell, arc_mkaff(c, fio_tell, CNIL));
-  SVINDEX(io_ops, IO_close, arc_mkaff(c, fio_close, CNIL));
+  SVINDEX(io_ops, IO_closed_p, ARC_AFF(c, fio_closed_p));
+  SVINDEX(io_ops, IO_ready, ARC_AFF(c, fio_ready));
+  SVINDEX(io_ops, IO_wready, ARC_AFF(c, fio_wready));
+  SVINDEX(io_ops, IO_getb, ARC_AFF(c, fio_getb));
+  SVINDEX(io_ops, IO_putb, ARC_AFF(c, fio_putb));
+  SVINDEX(io_ops, IO_seek, ARC_AFF(c, fio_seek));
+  SVINDEX(io_ops, IO_tell, ARC_AFF(c, fio_tell));
+  SVINDEX(io_ops, IO_close, ARC_AFF(c, fio_close));
   SVINDEX(VINDEX(c->builtins, BI_io), BI_io_fp, io_ops);
 
   io_ops = arc_mkvector(c, IO_last+1);
-  SVINDEX(io_ops, IO_closed_p, arc_mkaff(c, fio_closed_p, CNIL));
-  SVINDEX(io_ops, IO_ready, arc_mkaff(c, fio_ready, CNIL));
-  SVINDEX(io_ops, IO_wready, arc_mkaff(c, fio_wready, CNIL));
-  SVINDEX(io_ops, IO_getb, arc_mkaff(c, fio_getb, CNIL));
-  SVINDEX(io_ops, IO_putb, arc_mkaff(c, fio_putb, CNIL));
-  SVINDEX(io_ops, IO_seek, arc_mkaff(c, fio_seek, CNIL));
-  SVINDEX(io_ops, IO_tell, arc_mkaff(c, fio_tell, CNIL));
-  SVINDEX(io_ops, IO_close, arc_mkaff(c, pio_close, CNIL));
+  SVINDEX(io_ops, IO_closed_p, ARC_AFF(c, fio_closed_p));
+  SVINDEX(io_ops, IO_ready, ARC_AFF(c, fio_ready));
+  SVINDEX(io_ops, IO_wready, ARC_AFF(c, fio_wready));
+  SVINDEX(io_ops, IO_getb, ARC_AFF(c, fio_getb));
+  SVINDEX(io_ops, IO_putb, ARC_AFF(c, fio_putb));
+  SVINDEX(io_ops, IO_seek, ARC_AFF(c, fio_seek));
+  SVINDEX(io_ops, IO_tell, ARC_AFF(c, fio_tell));
+  SVINDEX(io_ops, IO_close, ARC_AFF(c, pio_close));
   SVINDEX(VINDEX(c->builtins, BI_io), BI_io_pfp, io_ops);
 
   arc_bindsym(c, ARC_BUILTIN(c, S_STDIN_FD),
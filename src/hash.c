@@ -177,15 +177,30 @@ unsigned long arc_hash(arc *c, value v)
   return(arc_hash_level(c, v, 0));
 }
 
-/* Arcueid's hash table data type.  A hash table is simply a four-tuple,
+/* Arcueid's hash table data type.  A hash table is simply a five-tuple,
    with the elements as follows:
 
    0 - The actual table itself (a vector)
    1 - Number of hash bits (a fixnum)
    2 - Number of entries total (a fixnum)
    3 - Load limit (a fixnum)
+   4 - Number of deleted entries still taking up space (a fixnum)
 
-   Hash buckets are triples with the elements as follows:
+   The entries of an ordinary table are kept inline in its vector,
+   three slots to an entry:
+
+   0 - The key of this element
+   1 - The value of this element
+   2 - The hash value computed for the key (a fixnum)
+
+   so that probing the table never has to follow a pointer except to
+   compare keys whose hash values match, and inserting a key does not
+   allocate.
+
+   Weak tables (used for the symbol tables) are different, as each of
+   their entries must be swept by itself once nothing else refers to
+   it.  Their vectors (T_TABLEVEC) point to hash buckets, which are
+   tuples with the elements as follows:
 
    0 - The index of the element in the current hash table (fixnum)
    1 - The key of this element
@@ -194,15 +209,25 @@ unsigned long arc_hash(arc *c, value v)
    4 - The original hash value computed for this element
 */
 
-#define HASH_SIZE (4)
+#define HASH_SIZE (5)
 #define HASH_TABLE(t) (REP(t)[0])
 #define HASH_INDEX(t, i) (VINDEX(HASH_TABLE(t), (i)))
 #define HASH_BITS(t) (FIX2INT(REP(t)[1]))
 #define HASH_NENTRIES(t) (FIX2INT(REP(t)[2]))
 #define HASH_LLIMIT(t) (FIX2INT(REP(t)[3]))
+#define HASH_NDELETED(t) (FIX2INT(REP(t)[4]))
 #define SET_HASHBITS(t, n) (REP(t)[1] = INT2FIX(n))
 #define SET_NENTRIES(t, n) (REP(t)[2] = INT2FIX(n))
 #define SET_LLIMIT(t, n) (REP(t)[3] = INT2FIX(n))
+#define SET_NDELETED(t, n) (REP(t)[4] = INT2FIX(n))
+
+#define ENTRY_SIZE (3)
+#define EKEY(v, i) (XVINDEX(v, (i)*ENTRY_SIZE))
+#define EVALUE(v, i) (XVINDEX(v, (i)*ENTRY_SIZE+1))
+#define EHASHVAL(v, i) (XVINDEX(v, (i)*ENTRY_SIZE+2))
+#define SEKEY(v, i, k) SVINDEX(v, (i)*ENTRY_SIZE, k)
+#define SEVALUE(v, i, val) SVINDEX(v, (i)*ENTRY_SIZE+1, val)
+#define SEHASHVAL(v, i, hv) (EHASHVAL(v, i) = (hv))
 
 #define BUCKET_SIZE (5)
 #define BINDEX(t) (FIX2INT(REP(t)[0]))
@@ -212,23 +237,51 @@ unsigned long arc_hash(arc *c, value v)
 #define BTABLE(t) (REP(t)[3])
 #define BHASHVAL(t) (REP(t)[4])
 
+#define WEAKP(t) (TYPE(t) == T_WTABLE)
+
 #define HASHSIZE(n) ((unsigned long)1 << (n))
 #define HASHMASK(n) (HASHSIZE(n)-1)
 #define MAX_LOAD_FACTOR 70	/* percentage */
+#define MIN_LOAD_FACTOR 10	/* percentage */
+#define MIN_HASHBITS 3
 /* linear probing */
 #define PROBE(i) (i)
 
 #define TABLESIZE(t) (HASHSIZE(HASH_BITS(t)))
 #define TABLEMASK(t) (HASHMASK(HASH_BITS(t)))
 
+/* Hash values are kept as fixnums of the low bits used to index the
+   table, which are compared before any keys are. */
+#define HASHVAL(hv) (INT2FIX((unsigned int)(hv)))
+
 /* An empty slot is either CUNBOUND or CUNDEF.  CUNDEF is used as a
    'tombstone' value for deleted elements.  If this is found, one may have
    to keep probing until either the actual element is found or one runs into
    a CUNBOUND, meaning the element is definitely not in the table.
    Since we enforce load factor, there will definitely be some table
-   elements which remain unused. */
+   elements which remain unused.  In an ordinary table it is the key
+   slot of an entry that is empty. */
 #define EMPTYP(x) (((x) == CUNBOUND) || ((x) == CUNDEF))
 
+/* The key and value of the entry at index i of any table, the key
+   being empty if there is none. */
+static value entry_key(value hash, int i)
+{
+  value e;
+
+  if (!WEAKP(hash))
+    return(EKEY(HASH_TABLE(hash), i));
+  e = HASH_INDEX(hash, i);
+  return(EMPTYP(e) ? e : BKEY(e));
+}
+
+static value entry_value(value hash, int i)
+{
+  if (!WEAKP(hash))
+    return(EVALUE(HASH_TABLE(hash), i));
+  return(BVALUE(HASH_INDEX(hash, i)));
+}
+
 static AFFDEF(hash_pprint)
 {
   AARG(sexpr, disp, fp);
@@ -241,15 +294,15 @@ static AFFDEF(hash_pprint)
 
   if (!NIL_P(__arc_visit(c, AV(sexpr), AV(visithash)))) {
     /* already visited at some point. Do not recurse further */
-    AFTCALL(arc_mkaff(c, __arc_disp_write, CNIL), arc_mkstringc(c, "(...)"),
+    AFTCALL(ARC_AFF(c, __arc_disp_write), arc_mkstringc(c, "(...)"),
 	   CTRUE, AV(fp), AV(visithash));
   }
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
+  WV(wc, ARC_AFF(c, arc_writec));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
   AFCALL(AV(dw), arc_mkstringc(c, "#hash("), CTRUE, AV(fp), CNIL);
   WV(state, CNIL);
   for (;;) {
-    AFCALL(arc_mkaff(c, arc_xhash_iter, CNIL), AV(sexpr), AV(state));
+    AFCALL(ARC_AFF(c, arc_xhash_iter), AV(sexpr), AV(state));
     WV(state, AFCRV);
     if (NIL_P(AV(state)))
       goto finished;
@@ -304,7 +357,7 @@ static void tablevec_sweeper(arc *c, value v)
 static AFFDEF(hash_isocmp)
 {
   AARG(v1, v2, vh1, vh2);
-  AVAR(iso2, tbl, e, v2val, i);
+  AVAR(iso2, e, v2val, i);
   value vhh1, vhh2;		/* not required after calls */
   AFBEGIN;
 
@@ -326,15 +379,15 @@ static AFFDEF(hash_isocmp)
   /* Two hash tables must have identical numbers of entries to be isomorphic */
   if (HASH_NENTRIES(AV(v1)) != HASH_NENTRIES(AV(v2)))
     ARETURN(CNIL);
-  WV(tbl, HASH_TABLE(AV(v1)));
-  WV(iso2, arc_mkaff(c, arc_iso2, CNIL));
-  for (WV(i, INT2FIX(0)); FIX2INT(AV(i))<VECLEN(AV(tbl));
+  WV(iso2, ARC_AFF(c, arc_iso2));
+  for (WV(i, INT2FIX(0)); FIX2INT(AV(i))<TABLESIZE(AV(v1));
        WV(i, INT2FIX(FIX2INT(AV(i)) + 1))) {
-    WV(e, VINDEX(AV(tbl), FIX2INT(AV(i))));
+    WV(e, entry_key(AV(v1), FIX2INT(AV(i))));
     if (EMPTYP(AV(e)))
       continue;
-    WV(v2val, arc_hash_lookup(c, AV(v2), BKEY(AV(e))));
-    AFCALL(AV(iso2), BVALUE(AV(e)), AV(v2val), AV(vh1), AV(vh2));
+    WV(v2val, arc_hash_lookup(c, AV(v2), AV(e)));
+    AFCALL(AV(iso2), entry_value(AV(v1), FIX2INT(AV(i))), AV(v2val),
+	   AV(vh1), AV(vh2));
     if (NIL_P(AFCRV))
       ARETURN(CNIL);
   }
@@ -347,7 +400,7 @@ static AFFDEF(xhash_apply)
 {
   AARG(tbl, key, dflt);
   AFBEGIN;
-  AFCALL(arc_mkaff(c, arc_xhash_lookup, CNIL), AV(tbl), AV(key));
+  AFCALL(ARC_AFF(c, arc_xhash_lookup), AV(tbl), AV(key));
   if (BOUND_P(AFCRV))
     ARETURN(AFCRV);
   ARETURN(AV(dflt));
@@ -370,7 +423,7 @@ static int hash_apply(arc *c, value thr, value tbl)
   key = arc_thr_pop(c, thr);
   /* This is one way one can make a tail call from a non-AFF. */
   __arc_mkenv(c, thr, 0, 0);	/* null env required */
-  __arc_affapply(c, thr, CNIL, arc_mkaff(c, xhash_apply, CNIL), tbl, key, dflt,
+  __arc_affapply(c, thr, CNIL, ARC_AFF(c, xhash_apply), tbl, key, dflt,
 		 CLASTARG);
   return(TR_FNAPP);
 }
@@ -378,37 +431,58 @@ static int hash_apply(arc *c, value thr, value tbl)
 int arc_hash_length(arc *c, value hash)
 {
   int count, i;
-  value e, tbl;
 
+  /* Weak tables are not told when the collector removes entries */
+  if (!WEAKP(hash))
+    return(HASH_NENTRIES(hash));
   count = 0;
-  tbl = HASH_TABLE(hash);
-  for (i=0; i<VECLEN(tbl); i++) {
-    e = VINDEX(tbl, i);
-    if (EMPTYP(e))
+  for (i=0; i<TABLESIZE(hash); i++) {
+    if (EMPTYP(entry_key(hash, i)))
       continue;
     count++;
   }
   return(count);
 }
 
-value arc_mkhash(arc *c, int hashbits)
+static value mktablevec(arc *c, int hashbits, int weak)
 {
-  value hash, hv;
+  value tv;
   int i;
 
-  hash = arc_mkobject(c, sizeof(value)*HASH_SIZE, T_TABLE);
+  if (weak) {
+    tv = arc_mkvector(c, HASHSIZE(hashbits));
+    ((struct cell *)tv)->_type = T_TABLEVEC;
+    for (i=0; i<HASHSIZE(hashbits); i++)
+      XVINDEX(tv, i) = CUNBOUND;
+    return(tv);
+  }
+  tv = arc_mkvector(c, HASHSIZE(hashbits)*ENTRY_SIZE);
+  for (i=0; i<HASHSIZE(hashbits); i++) {
+    EKEY(tv, i) = CUNBOUND;
+    EVALUE(tv, i) = CNIL;
+    EHASHVAL(tv, i) = INT2FIX(0);
+  }
+  return(tv);
+}
+
+static value mkhash(arc *c, int hashbits, int type)
+{
+  value hash;
+
+  hash = arc_mkobject(c, sizeof(value)*HASH_SIZE, type);
   SET_HASHBITS(hash, hashbits);
   SET_NENTRIES(hash, 0);
   SET_LLIMIT(hash, (HASHSIZE(hashbits)*MAX_LOAD_FACTOR) / 100);
-  hv = arc_mkvector(c, HASHSIZE(hashbits));
-  ((struct cell *)hv)->_type = T_TABLEVEC;
-  HASH_TABLE(hash) = hv;
-  
-  for (i=0; i<HASHSIZE(hashbits); i++)
-    XVINDEX(HASH_TABLE(hash), i) = CUNBOUND;
+  SET_NDELETED(hash, 0);
+  HASH_TABLE(hash) = mktablevec(c, hashbits, type == T_WTABLE);
   return(hash);
 }
 
+value arc_mkhash(arc *c, int hashbits)
+{
+  return(mkhash(c, hashbits, T_TABLE));
+}
+
 AFFDEF(arc_newtable)
 {
   AOARG(constructor);
@@ -423,40 +497,137 @@ AFFDEF(arc_newtable)
 }
 AFFEND
 
+/* Index of a free entry for an element with hash value hv */
+static unsigned int hash_slot(value hash, value hv)
+{
+  unsigned int index, i;
+
+  index = FIX2INT(hv) & TABLEMASK(hash);
+  for (i=0; !EMPTYP(entry_key(hash, index)); i++)
+    index = (index + PROBE(i)) & TABLEMASK(hash);
+  return(index);
+}
 
-static void hashtable_expand(arc *c, value hash)
+/* Move all of the entries of a table to a new vector with nhashbits
+   bits, leaving behind any deleted entries. */
+static void hashtable_resize(arc *c, value hash, int nhashbits)
 {
-  unsigned int hv, index, i, j, nhashbits;
-  value oldtbl, newtbl, e;
+  unsigned int index, i, j;
+  value oldtbl, newtbl, e, k, hv;
 
-  nhashbits = HASH_BITS(hash) + 1;
-  newtbl = arc_mkvector(c, HASHSIZE(nhashbits));
-  ((struct cell *)newtbl)->_type = T_TABLEVEC;
-  for (i=0; i<HASHSIZE(nhashbits); i++)
-    XVINDEX(newtbl, i) = CUNBOUND;
   oldtbl = HASH_TABLE(hash);
-  /* Search for active keys and move them into the new table */
-  for (i=0; i<VECLEN(oldtbl); i++) {
-    e = VINDEX(oldtbl, i);
-    if (EMPTYP(e))
-      continue;
-    /* remove the old link now that we have a copy */
-    SVINDEX(oldtbl, i, CUNBOUND);
-    /* insert the old key into the new table */
-    hv = (unsigned int)FIX2INT(BHASHVAL(e));
-    index = hv & HASHMASK(nhashbits);
-    for (j=0; !EMPTYP(VINDEX(newtbl, index)); j++)
-      index = (index + PROBE(j)) & HASHMASK(nhashbits);
-    BTABLE(e) = newtbl;
-    XVINDEX(newtbl, index) =  e;
-    SBINDEX(e, index);		/* change index */
-    SVINDEX(oldtbl, i, CUNBOUND);
+  newtbl = mktablevec(c, nhashbits, WEAKP(hash));
+  if (!WEAKP(hash)) {
+    for (i=0; i<TABLESIZE(hash); i++) {
+      k = EKEY(oldtbl, i);
+      if (EMPTYP(k))
+	continue;
+      hv = EHASHVAL(oldtbl, i);
+      index = FIX2INT(hv) & HASHMASK(nhashbits);
+      for (j=0; EKEY(newtbl, index) != CUNBOUND; j++)
+	index = (index + PROBE(j)) & HASHMASK(nhashbits);
+      EKEY(newtbl, index) = k;
+      EVALUE(newtbl, index) = EVALUE(oldtbl, i);
+      EHASHVAL(newtbl, index) = hv;
+    }
+    /* The old vector still has everything the collector may not have
+       seen yet. */
+    __arc_wb(HASH_TABLE(hash), newtbl);
+  } else {
+    /* Search for active keys and move them into the new table */
+    for (i=0; i<VECLEN(oldtbl); i++) {
+      e = VINDEX(oldtbl, i);
+      if (EMPTYP(e))
+	continue;
+      /* remove the old link now that we have a copy */
+      SVINDEX(oldtbl, i, CUNBOUND);
+      /* insert the old key into the new table */
+      index = FIX2INT(BHASHVAL(e)) & HASHMASK(nhashbits);
+      for (j=0; !EMPTYP(VINDEX(newtbl, index)); j++)
+	index = (index + PROBE(j)) & HASHMASK(nhashbits);
+      BTABLE(e) = newtbl;
+      XVINDEX(newtbl, index) =  e;
+      SBINDEX(e, index);		/* change index */
+    }
   }
   SET_HASHBITS(hash, nhashbits);
   SET_LLIMIT(hash, (HASHSIZE(nhashbits)*MAX_LOAD_FACTOR) / 100);
+  SET_NDELETED(hash, 0);
   HASH_TABLE(hash) = newtbl;
 }
 
+/* Make room in a table for one more entry.  A table is resized when
+   its entries and deleted entries together reach the load limit, or
+   when entries have been deleted from it until it is mostly empty,
+   and then it is sized to be at most half as full as the load limit
+   allows.  This may grow it, shrink it, or only rid it of deleted
+   entries.  It is never done on deletion, so that entries may be
+   deleted from a table while it is being iterated over.
+
+   Weak tables lose entries to the collector without their counts
+   being changed, so they are only ever grown. */
+static void hash_reserve(arc *c, value hash)
+{
+  int n = HASH_NENTRIES(hash) + 1, nhashbits;
+
+  if (WEAKP(hash)) {
+    if (n > HASH_LLIMIT(hash))
+      hashtable_resize(c, hash, HASH_BITS(hash) + 1);
+    return;
+  }
+  if (n + HASH_NDELETED(hash) <= HASH_LLIMIT(hash)
+      && (HASH_NDELETED(hash) == 0 || HASH_BITS(hash) <= MIN_HASHBITS
+	  || n*100 >= TABLESIZE(hash)*MIN_LOAD_FACTOR))
+    return;
+  for (nhashbits = MIN_HASHBITS;
+       HASHSIZE(nhashbits)*MAX_LOAD_FACTOR < n*200; nhashbits++)
+    ;
+  hashtable_resize(c, hash, nhashbits);
+}
+
+/* Put a new element into the free entry index of a table */
+static void hash_put(arc *c, value hash, unsigned int index, value key,
+		     value val, value hv)
+{
+  value tbl = HASH_TABLE(hash), e;
+
+  SET_NENTRIES(hash, HASH_NENTRIES(hash)+1);
+  if (WEAKP(hash)) {
+    e = arc_mkobject(c, BUCKET_SIZE*sizeof(value), T_TBUCKET);
+    BKEY(e) = key;
+    BVALUE(e) = val;
+    SBINDEX(e, index);
+    BTABLE(e) = tbl;
+    BHASHVAL(e) = hv;
+    SVINDEX(tbl, index, e);
+    return;
+  }
+  if (EKEY(tbl, index) == CUNDEF)
+    SET_NDELETED(hash, HASH_NDELETED(hash)-1);
+  SEKEY(tbl, index, key);
+  SEVALUE(tbl, index, val);
+  SEHASHVAL(tbl, index, hv);
+}
+
+/* Remove the element at index from a table, returning its value */
+static value hash_remove(arc *c, value hash, unsigned int index)
+{
+  value tbl = HASH_TABLE(hash), e, val;
+
+  SET_NENTRIES(hash, HASH_NENTRIES(hash)-1);
+  if (WEAKP(hash)) {
+    e = VINDEX(tbl, index);
+    BTABLE(e) = CNIL;
+    SVINDEX(tbl, index, CUNDEF);
+    return(BVALUE(e));
+  }
+  val = EVALUE(tbl, index);
+  SET_NDELETED(hash, HASH_NDELETED(hash)+1);
+  SEKEY(tbl, index, CUNDEF);
+  SEVALUE(tbl, index, CNIL);
+  return(val);
+}
+
 static void hb_marker(arc *c, value v, int depth,
 		      void (*markfn)(arc *, value, int))
 {
@@ -476,45 +647,48 @@ static void hb_sweeper(arc *c, value v)
   }
 }
 
-/* Create a hash bucket.  Hash buckets are objects that should never be
-   directly visble, just as the tombstone values CUNDEF and CUNBOUND should
-   never be seen directly by the interpreter. */
-static value mkhashbucket(arc *c, value key, value val, int index, value table,
-			  value hashcode)
+/* Find the index of the entry in a table whose hash value is hv and
+   whose key is accepted by match, or -1 if there is none. */
+static int hash_probe(arc *c, value hash, value hv,
+		      int (*match)(arc *, value, const void *),
+		      const void *data)
 {
-  value bucket;
+  unsigned int index, i;
+  value k;
 
-  bucket = arc_mkobject(c, BUCKET_SIZE*sizeof(value), T_TBUCKET);
-  BKEY(bucket) = key;
-  BVALUE(bucket) = val;
-  SBINDEX(bucket, index);
-  BTABLE(bucket) = HASH_TABLE(table);
-  BHASHVAL(bucket) = hashcode;
-  return(bucket);
-}
-
-static value hash_lookup(arc *c, value hash, value key, unsigned int *index)
-{
-  unsigned int hv, i;
-  value e;
-
-  hv = arc_hash(c, key);
-  *index = hv & TABLEMASK(hash);
+  index = FIX2INT(hv) & TABLEMASK(hash);
   for (i=0;; i++) {
-    *index = (*index + PROBE(i)) & TABLEMASK(hash);
-    e = HASH_INDEX(hash, *index);
+    index = (index + PROBE(i)) & TABLEMASK(hash);
+    k = entry_key(hash, index);
     /* CUNBOUND means there was never any element at that index, so we
        can stop. */
-    if (e == CUNBOUND)
-      return(CUNBOUND);
+    if (k == CUNBOUND)
+      return(-1);
     /* CUNDEF means that there was an element at that index, but it was
        deleted at some point, so we may need to continue probing. */
-    if (e == CUNDEF)
+    if (k == CUNDEF)
       continue;
-    if (arc_is2(c, BKEY(e), key) == CTRUE)
-      return(BVALUE(e));
+    if (WEAKP(hash)) {
+      if (BHASHVAL(HASH_INDEX(hash, index)) != hv)
+	continue;
+    } else if (EHASHVAL(HASH_TABLE(hash), index) != hv) {
+      continue;
+    }
+    if (match(c, k, data))
+      return(index);
   }
-  return(CUNBOUND);
+  return(-1);
+}
+
+static int key_match(arc *c, value k, const void *data)
+{
+  return(arc_is2(c, k, *(const value *)data) == CTRUE);
+}
+
+/* Find the index of key in a table, or -1 if it is not there. */
+static int hash_find(arc *c, value hash, value key, value hv)
+{
+  return(hash_probe(c, hash, hv, key_match, &key));
 }
 
 /* These functions will only work for simple keys for which a basic hash
@@ -524,83 +698,86 @@ static value hash_lookup(arc *c, value hash, value key, unsigned int *index)
 
 value arc_hash_insert(arc *c, value hash, value key, value val)
 {
-  unsigned int hv, index, i;
-  value e;
+  int index;
+  value hv;
 
-  index = 0;
+  hv = HASHVAL(arc_hash(c, key));
   /* First of all, look for the key if a binding already exists for it */
-  e = hash_lookup(c, hash, key, &index);
-  if (BOUND_P(e)) {
+  index = hash_find(c, hash, key, hv);
+  if (index >= 0) {
     /* if we are already bound, overwrite the old value */
-    e = VINDEX(HASH_TABLE(hash), index);
-    BVALUE(e) = val;
+    if (WEAKP(hash))
+      BVALUE(HASH_INDEX(hash, index)) = val;
+    else
+      SEVALUE(HASH_TABLE(hash), index, val);
     return(val);
   }
   /* Not yet bound.  Look for a slot where we can put it */
-  if (HASH_NENTRIES(hash)+1 > HASH_LLIMIT(hash))
-    hashtable_expand(c, hash);
-  SET_NENTRIES(hash, HASH_NENTRIES(hash)+1);
-  hv = arc_hash(c, key);
-  index = hv & TABLEMASK(hash);
-  for (i=0;; i++) {
-    e = VINDEX(HASH_TABLE(hash), index);
-    /* If we see an empty bucket in our search, or if we see a bucket
-       whose key is the same as the key specified, we have found the
-       place where the element should go. This second case should never
-       happen, based on what we did above, but hey, belt and suspenders. */
-    if (EMPTYP(e) || arc_is2(c, BKEY(e), key) == CTRUE)
-      break;
-    /* We found a bucket, but it is occupied by some other key. Continue
-       probing. */
-    index = (index + PROBE(i)) & TABLEMASK(hash);
-  }
-
-  if (EMPTYP(e)) {
-    /* No such key in the hash table yet.  Create a bucket and
-       assign it to the table. */
-    e = mkhashbucket(c, key, val, index, hash, INT2FIX(hv));
-    SVINDEX(HASH_TABLE(hash), index, e);
-  } else {
-    /* The key already exists.  Use the current bucket but change the
-       value to the value specified. */
-    BVALUE(e) = val;
-  }
+  hash_reserve(c, hash);
+  hash_put(c, hash, hash_slot(hash, hv), key, val, hv);
   return(val);
 }
 
 value arc_hash_lookup(arc *c, value tbl, value key)
 {
-  unsigned int index;
+  int index;
 
-  return(hash_lookup(c, tbl, key, &index));
+  index = hash_find(c, tbl, key, HASHVAL(arc_hash(c, key)));
+  return((index < 0) ? CUNBOUND : entry_value(tbl, index));
 }
 
 /* Slightly different version which returns the actual hash bucket
-   with the key and value if a binding is available. */
+   with the key and value if a binding is available.  Only weak tables
+   have hash buckets. */
 value arc_hash_lookup2(arc *c, value hash, value key)
 {
-  unsigned int index;
-  value val;
+  int index;
 
-  val = hash_lookup(c, hash, key, &index);
-  if (val == CUNBOUND)
+  if (!WEAKP(hash))
     return(CUNBOUND);
-  return(HASH_INDEX(hash, index));
+  index = hash_find(c, hash, key, HASHVAL(arc_hash(c, key)));
+  return((index < 0) ? CUNBOUND : HASH_INDEX(hash, index));
+}
+
+struct runekey {
+  const Rune *name;
+  int len;
+};
+
+static int runes_match(arc *c, value k, const void *data)
+{
+  const struct runekey *r = (const struct runekey *)data;
+
+  return(TYPE(k) == T_STRING && __arc_streq_runes(c, k, r->name, r->len));
+}
+
+/* Look up a string key given only its runes, so that no string need
+   be made only to look for it.  The hash must be computed just as
+   arc_hash would compute it for the string. */
+value arc_hash_lookup_runes(arc *c, value hash, const Rune *name, int len)
+{
+  int index;
+  arc_hs s;
+  struct runekey r;
+
+  arc_hash_init(&s, 0);
+  arc_hash_update(&s, T_STRING);
+  arc_hash_update(&s, __arc_strhash_runes(name, len));
+  r.name = name;
+  r.len = len;
+  index = hash_probe(c, hash, HASHVAL(arc_hash_final(&s, len)),
+		     runes_match, &r);
+  return((index < 0) ? CUNBOUND : entry_value(hash, index));
 }
 
 value arc_hash_delete(arc *c, value hash, value key)
 {
-  unsigned int index;
-  value v, e;
+  int index;
 
-  v = hash_lookup(c, hash, key, &index);
-  if (v != CUNBOUND) {
-    e = VINDEX(HASH_TABLE(hash), index);
-    BTABLE(e) = CNIL;
-    SVINDEX(HASH_TABLE(hash), index, CUNDEF);
-    SET_NENTRIES(hash, HASH_NENTRIES(hash)-1);
-  }
-  return(v);
+  index = hash_find(c, hash, key, HASHVAL(arc_hash(c, key)));
+  if (index < 0)
+    return(CUNBOUND);
+  return(hash_remove(c, hash, index));
 }
 
 /* The following functions are more general, and will work for any kind
@@ -678,7 +855,7 @@ AFFDEF(arc_xhash_increment)
       WV(length, INT2FIX(tfn->hash(c, AV(v), &hs)));
     else if (tfn->xhash != NULL) {
       encode_hs(c, AV(ehs), &hs);
-      AFTCALL(arc_mkaff(c, tfn->xhash, CNIL), AV(v), AV(ehs), AV(length), AV(visithash));
+      AFTCALL(ARC_AFF(c, tfn->xhash), AV(v), AV(ehs), AV(length), AV(visithash));
     } else {
       arc_err_cstrfmt(c, "no type-specific hasher found for type %d", TYPE(v));
     }
@@ -703,7 +880,7 @@ AFFDEF(arc_xhash)
     WV(level, INT2FIX(0));
   arc_hash_init(&s, FIX2INT(AV(level)));
   encode_hs(c, AV(ehs), &s);
-  AFCALL(arc_mkaff(c, arc_xhash_increment, CNIL), AV(v), AV(ehs));
+  AFCALL(ARC_AFF(c, arc_xhash_increment), AV(v), AV(ehs));
   len = AFCRV;
   decode_hs(c, &s, AV(ehs));
   final = arc_hash_final(&s, FIX2INT(len));
@@ -712,95 +889,66 @@ AFFDEF(arc_xhash)
 }
 AFFEND
 
-/* Returns unbound or the hash bucket */
-AFFDEF(xhash_lookup)
+/* Returns the index of key in an ordinary table, or unbound.  The
+   hash value of the key may be given if it is already known. */
+static AFFDEF(xhash_lookup)
 {
   AARG(hash, key);
-  AVAR(e, index, i);
-  unsigned int hv;
+  AOARG(hv);
+  AVAR(index, i);
+  value k;
   AFBEGIN;
-  AFCALL(arc_mkaff(c, arc_xhash, CNIL), AV(key));
-  hv = FIX2INT(AFCRV);
-  WV(index, INT2FIX(hv & TABLEMASK(AV(hash))));
+  if (!BOUND_P(AV(hv))) {
+    AFCALL(ARC_AFF(c, arc_xhash), AV(key));
+    WV(hv, HASHVAL(FIX2INT(AFCRV)));
+  }
+  WV(index, INT2FIX(FIX2INT(AV(hv)) & TABLEMASK(AV(hash))));
   for (WV(i, INT2FIX(0));; WV(i, INT2FIX(FIX2INT(AV(i)) + 1))) {
     WV(index, INT2FIX((FIX2INT(AV(index)) + PROBE(FIX2INT(AV(i)))) & TABLEMASK(AV(hash))));
-    WV(e, HASH_INDEX(AV(hash), FIX2INT(AV(index))));
+    k = EKEY(HASH_TABLE(AV(hash)), FIX2INT(AV(index)));
     /* CUNBOUND means there was never any element at that index, so we
        can stop. */
-    if (AV(e) == CUNBOUND)
+    if (k == CUNBOUND)
       ARETURN(CUNBOUND);
     /* CUNDEF means that there was an element at that index, but it was
        deleted at some point, so we may need to continue probing. */
-    if (AV(e) == CUNDEF)
+    if (k == CUNDEF || EHASHVAL(HASH_TABLE(AV(hash)), FIX2INT(AV(index))) != AV(hv))
       continue;
-    AFCALL(arc_mkaff(c, arc_iso, CNIL), BKEY(AV(e)), AV(key));
+    if (k == AV(key))
+      ARETURN(AV(index));
+    AFCALL(ARC_AFF(c, arc_iso), k, AV(key));
     if (AFCRV == CTRUE)
-      ARETURN(cons(c, AV(index), AV(e)));
+      ARETURN(AV(index));
   }
   ARETURN(CUNBOUND);
   AFEND;
 }
 AFFEND
 
-AFFDEF(arc_xhash_lookup2)
-{
-  AARG(tbl, key);
-  AFBEGIN;
-  AFCALL(arc_mkaff(c, xhash_lookup, CNIL), AV(tbl), AV(key));
-  if (BOUND_P(AFCRV))
-    ARETURN(cdr(AFCRV));
-  ARETURN(CUNBOUND);
-  AFEND;
-}
-AFFEND
+/* Weak tables only ever have simple keys, and go the simple way. */
 
 AFFDEF(arc_xhash_insert)
 {
   AARG(hash, key, val);
-  AVAR(hv, index, i, e);
+  AVAR(hv);
   AFBEGIN;
 
+  if (WEAKP(AV(hash)))
+    ARETURN(arc_hash_insert(c, AV(hash), AV(key), AV(val)));
+
   /* First, look for the key if a binding already exists for it */
-  AFCALL(arc_mkaff(c, arc_xhash_lookup2, CNIL), AV(hash), AV(key));
+  AFCALL(ARC_AFF(c, arc_xhash), AV(key));
+  WV(hv, HASHVAL(FIX2INT(AFCRV)));
+  AFCALL(ARC_AFF(c, xhash_lookup), AV(hash), AV(key), AV(hv));
   if (BOUND_P(AFCRV)) {
-    WV(e, AFCRV);
-    BVALUE(AV(e)) = AV(val);
+    SEVALUE(HASH_TABLE(AV(hash)), FIX2INT(AFCRV), AV(val));
     ARETURN(AV(val));
   }
 
   /* Not already bound, so we need to create a new binding */
-  if (HASH_NENTRIES(AV(hash))+1 > HASH_LLIMIT(AV(hash)))
-    hashtable_expand(c, AV(hash));
-  SET_NENTRIES(AV(hash), HASH_NENTRIES(AV(hash))+1);
-  AFCALL(arc_mkaff(c, arc_xhash, CNIL), AV(key));
-  WV(hv, AFCRV);
-  WV(index, INT2FIX(FIX2INT(AV(hv)) & TABLEMASK(AV(hash))));
-  for (WV(i, INT2FIX(0));; WV(i, INT2FIX(FIX2INT(AV(i)) + 1))) {
-    WV(e, VINDEX(HASH_TABLE(AV(hash)), FIX2INT(AV(index))));
-    /* If we see an empty bucket in our search, or if we see a bucket
-       whose key is the same as the key specified, we have found the
-       place where the element should go. */
-    if (EMPTYP(AV(e)))
-      break;
-    AFCALL(arc_mkaff(c, arc_iso, CNIL), BKEY(AV(e)), AV(key));
-    if (AFCRV == CTRUE)
-      break;
-    /* We found a bucket, but it is occupied by some other key. Continue
-       probing. */
-    WV(index, INT2FIX((FIX2INT(AV(index)) + PROBE(FIX2INT(AV(i)))) & TABLEMASK(AV(hash))));
-  }
-
-  if (EMPTYP(AV(e))) {
-    /* No such key in the hash table yet.  Create a bucket and
-       assign it to the table. */
-    WV(e, mkhashbucket(c, AV(key), AV(val), FIX2INT(AV(index)), AV(hash),
-		       AV(hv)));
-    SVINDEX(HASH_TABLE(AV(hash)), FIX2INT(AV(index)), AV(e));
-  } else {
-    /* The key already exists.  Use the current bucket but change the
-       value to the value specified. */
-    BVALUE(AV(e)) = val;
-  }
+  hash_reserve(c, AV(hash));
+  hash_put(c, AV(hash), hash_slot(AV(hash), AV(hv)), AV(key), AV(val),
+	   AV(hv));
   ARETURN(AV(val));
   AFEND;
 }
@@ -810,9 +958,11 @@ AFFDEF(arc_xhash_lookup)
 {
   AARG(tbl, key);
   AFBEGIN;
-  AFCALL(arc_mkaff(c, arc_xhash_lookup2, CNIL), AV(tbl), AV(key));
+  if (WEAKP(AV(tbl)))
+    ARETURN(arc_hash_lookup(c, AV(tbl), AV(key)));
+  AFCALL(ARC_AFF(c, xhash_lookup), AV(tbl), AV(key));
   if (BOUND_P(AFCRV))
-    ARETURN(BVALUE(AFCRV));
+    ARETURN(EVALUE(HASH_TABLE(AV(tbl)), FIX2INT(AFCRV)));
   ARETURN(CUNBOUND);
   AFEND;
 }
@@ -821,18 +971,13 @@ AFFEND
 AFFDEF(arc_xhash_delete)
 {
   AARG(tbl, key);
-  value index, e;
   AFBEGIN;
-  AFCALL(arc_mkaff(c, arc_xhash_lookup2, CNIL), AV(tbl), AV(key));
+  if (WEAKP(AV(tbl)))
+    ARETURN(arc_hash_delete(c, AV(tbl), AV(key)));
+  AFCALL(ARC_AFF(c, xhash_lookup), AV(tbl), AV(key));
   if (!BOUND_P(AFCRV))
     ARETURN(CUNBOUND);
-
-  index = car(AFCRV);
-  e = VINDEX(HASH_TABLE(AV(tbl)), FIX2INT(index));
-  BTABLE(e) = CNIL;
-  SVINDEX(HASH_TABLE(AV(tbl)), FIX2INT(index), CUNDEF);
-  SET_NENTRIES(AV(tbl), HASH_NENTRIES(AV(tbl))-1);
-  ARETURN(BVALUE(e));
+  ARETURN(hash_remove(c, AV(tbl), FIX2INT(AFCRV)));
   AFEND;
 }
 AFFEND
@@ -840,20 +985,20 @@ AFFEND
 AFFDEF(arc_xhash_iter)
 {
   AARG(hash, state);
-  value index, keyval, e;
-  AFBEGIN;
+  value keyval, k;
+  int index;
+  AFLBEGIN;
   if (NIL_P(AV(state)))
     WV(state, cons(c, cons(c, CNIL, CNIL), INT2FIX(0)));
   keyval = car(AV(state));
-  index = cdr(AV(state));
-  while (FIX2INT(index) < VECLEN(HASH_TABLE(AV(hash)))) {
-    e = VINDEX(HASH_TABLE(AV(hash)), FIX2INT(index));
-    index = __arc_add2(c, index, INT2FIX(1));
-    if (EMPTYP(e))
+  index = FIX2INT(cdr(AV(state)));
+  while (index < TABLESIZE(AV(hash))) {
+    k = entry_key(AV(hash), index++);
+    if (EMPTYP(k))
       continue;
-    scdr(AV(state), index);
-    scar(keyval, BKEY(e));
-    scdr(keyval, BVALUE(e));
+    scdr(AV(state), INT2FIX(index));
+    scar(keyval, k);
+    scdr(keyval, entry_value(AV(hash), index-1));
     ARETURN(AV(state));
   }
   ARETURN(CNIL);
@@ -869,7 +1014,7 @@ AFFDEF(arc_xhash_map)
 
   WV(state, CNIL);
   for (;;) {
-    AFCALL(arc_mkaff(c, arc_xhash_iter, CNIL), AV(table), AV(state));
+    AFCALL(ARC_AFF(c, arc_xhash_iter), AV(table), AV(state));
     WV(state, AFCRV);
     if (NIL_P(AV(state)))
       ARETURN(AV(table));
@@ -892,7 +1037,7 @@ static AFFDEF(hash_xcoerce)
   if (FIX2INT(AV(stype)) == T_CONS) {
     WV(list, WV(state, CNIL));
     for (;;) {
-      AFCALL(arc_mkaff(c, arc_xhash_iter, CNIL), AV(obj), AV(state));
+      AFCALL(ARC_AFF(c, arc_xhash_iter), AV(obj), AV(state));
       WV(state, AFCRV);
       if (NIL_P(AV(state))) {
 	ARETURN(AV(list));
@@ -925,17 +1070,17 @@ AFFDEF(hash_xhash)
   /* Iterate over all keys and values */
   WV(state, CNIL);
   for (;;) {
-    AFCALL(arc_mkaff(c, arc_xhash_iter, CNIL), AV(obj), AV(state));
+    AFCALL(ARC_AFF(c, arc_xhash_iter), AV(obj), AV(state));
     WV(state, AFCRV);
     if (NIL_P(AV(state))) {
       ARETURN(AV(length));
     }
     /* increment the hash over the key */
-    AFCALL(arc_mkaff(c, arc_xhash_increment, CNIL), car(car(AV(state))),
+    AFCALL(ARC_AFF(c, arc_xhash_increment), car(car(AV(state))),
 	   AV(ehs), AV(visithash));
     WV(length, __arc_add2(c, AV(length), AFCRV));
     /* increment the hash over the value */
-    AFCALL(arc_mkaff(c, arc_xhash_increment, CNIL), cdr(car(AV(state))),
+    AFCALL(ARC_AFF(c, arc_xhash_increment), cdr(car(AV(state))),
 	   AV(ehs), AV(visithash));
     WV(length, __arc_add2(c, AV(length), AFCRV));
   }
@@ -959,10 +1104,7 @@ static void wtable_marker(arc *c, value v, int depth,
 /* Make a weak table */
 value arc_mkwtable(arc *c, int hashbits)
 {
-  value tbl = arc_mkhash(c, hashbits);
-
-  ((struct cell *)tbl)->_type = T_WTABLE;
-  return(tbl);
+  return(mkhash(c, hashbits, T_WTABLE));
 }
 
 /* Type function tables */
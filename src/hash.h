@@ -30,15 +30,31 @@ extern value arc_mkwtable(arc *c, int hashbits);
 extern int arc_newtable(arc *c, value thr);
 extern value arc_hash_lookup(arc *c, value tbl, value key);
 extern value arc_hash_lookup2(arc *c, value tbl, value key);
+extern value arc_hash_lookup_runes(arc *c, value hash, const Rune *name,
+				   int len);
 extern value arc_hash_insert(arc *c, value hash, value key, value val);
 extern value arc_hash_delete(arc *c, value hash, value key);
 extern int arc_hash_length(arc *c, value hash);
 extern int arc_xhash_lookup(arc *c, value thr);
-extern int arc_xhash_lookup2(arc *c, value thr);
 extern int arc_xhash_delete(arc *c, value thr);
 extern int arc_xhash_insert(arc *c, value thr);
 extern int arc_xhash_increment(arc *c, value thr);
 extern int arc_xhash_iter(arc *c, value thr);
 extern int arc_xhash_map(arc *c, value thr);
 
+/* Ordered maps */
+extern value arc_mkomap(arc *c);
+extern int arc_omap_length(arc *c, value omap);
+extern value arc_omap_lookup(arc *c, value omap, value key);
+extern value arc_omap_insert(arc *c, value omap, value key, value val);
+extern value arc_omap_delete(arc *c, value omap, value key);
+extern int arc_omap_rank(arc *c, value omap, value key);
+extern value arc_omap_nth(arc *c, value omap, int idx);
+extern value arc_omap_range(arc *c, value omap, value lo, value hi);
+extern value arc_omap_first(arc *c, value omap);
+extern value arc_omap_last(arc *c, value omap);
+extern value arc_omap_xrank(arc *c, value omap, value key);
+extern value arc_omap_xnth(arc *c, value omap, value idx);
+extern int arc_omap_xrange(arc *c, value thr);
+
 #endif
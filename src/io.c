@@ -116,8 +116,8 @@ static AFFDEF(io_pprint)
   AVAR(dw, wc);
   AFBEGIN;
 
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
+  WV(wc, ARC_AFF(c, arc_writec));
   if (TYPE(AV(sexpr)) == T_INPORT) {
     AFCALL(AV(dw), arc_mkstringc(c, "#<input-port:"), CTRUE,
 	   AV(fp), AV(visithash));
@@ -133,7 +133,7 @@ static AFFDEF(io_pprint)
 	   AV(fp), AV(visithash));
   }
   if (IO(AV(sexpr))->io_tfn->pprint != NULL) {
-    AFCALL(arc_mkaff(c, IO(AV(sexpr))->io_tfn->pprint, CNIL), AV(sexpr),
+    AFCALL(ARC_AFF(c, IO(AV(sexpr))->io_tfn->pprint), AV(sexpr),
 	   AV(disp), AV(fp), AV(visithash));
   }
   AFCALL(AV(wc), arc_mkchar(c, '>'), AV(fp));
@@ -205,7 +205,7 @@ AFFDEF(arc_readc)
   }
   WV(buf, arc_mkvector(c, UTFmax));
   /* XXX - should put this in builtins */
-  WV(readb, arc_mkaff(c, arc_readb, CNIL));
+  WV(readb, ARC_AFF(c, arc_readb));
   for (WV(i, INT2FIX(0)); FIX2INT(AV(i)) < UTFmax; WV(i, INT2FIX(FIX2INT(AV(i)) + 1))) {
     AFCALL(AV(readb), AV(fd));
     WV(chr, AFCRV);
@@ -277,7 +277,7 @@ AFFDEF(arc_writec)
     ARETURN(arc_mkchar(c, FIX2INT(AFCRV)));
   }
   /* XXX - should put this in builtins */
-  WV(writeb, arc_mkaff(c, arc_writeb, CNIL));
+  WV(writeb, ARC_AFF(c, arc_writeb));
   ch = arc_char2rune(c, AV(chr));
   WV(nbytes, INT2FIX(runetochar(cbuf, &ch)));
   /* Convert C char array into Arcueid vector of fixnums */
@@ -340,7 +340,7 @@ AFFDEF(arc_rewind)
 {
   AARG(fp);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, arc_seek, CNIL), AV(fp), INT2FIX(0), INT2FIX(SEEK_SET));
+  AFTCALL(ARC_AFF(c, arc_seek), AV(fp), INT2FIX(0), INT2FIX(SEEK_SET));
   AFEND;
 }
 AFFEND
@@ -399,10 +399,10 @@ AFFDEF(__arc_disp_write)
     snprintf(strrep, len+1, utype, TYPE(AV(arg)), (void *)AV(arg));
     vstr = arc_mkstringc(c, strrep);
 
-    AFTCALL(arc_mkaff(c, arc_disp, CNIL), vstr, AV(outport));
+    AFTCALL(ARC_AFF(c, arc_disp), vstr, AV(outport));
     ARETURN(CNIL);
   }
-  AFTCALL(arc_mkaff(c, tfn->pprint, CNIL), AV(arg), AV(disp), AV(outport),
+  AFTCALL(ARC_AFF(c, tfn->pprint), AV(arg), AV(disp), AV(outport),
 	  AV(visithash));
   AFEND;
 }
@@ -413,7 +413,7 @@ AFFDEF(arc_disp)
   AARG(arg);
   AOARG(outport);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, __arc_disp_write, CNIL), AV(arg), CTRUE, AV(outport));
+  AFTCALL(ARC_AFF(c, __arc_disp_write), AV(arg), CTRUE, AV(outport));
   AFEND;
 }
 AFFEND
@@ -423,7 +423,7 @@ AFFDEF(arc_write)
   AARG(arg);
   AOARG(outport);
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, __arc_disp_write, CNIL), AV(arg), CNIL, AV(outport));
+  AFTCALL(ARC_AFF(c, __arc_disp_write), AV(arg), CNIL, AV(outport));
   AFEND;
 }
 AFFEND
@@ -462,7 +462,7 @@ AFFDEF(arc_peekc)
   AFBEGIN;
   if (!BOUND_P(AV(fd)))
     STDIN(fd);
-  AFCALL(arc_mkaff(c, arc_readc, CNIL), AV(fd));
+  AFCALL(ARC_AFF(c, arc_readc), AV(fd));
   WV(ch, AFCRV);
   arc_ungetc_rune(c, arc_char2rune(c, AV(ch)), AV(fd));
   ARETURN(AV(ch));
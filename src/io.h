@@ -167,6 +167,8 @@ extern int __arc_is_absolute_path(arc *c, value path);
 /* loader */
 extern value arc_loadpath_add(arc *c, value path);
 extern int arc_load(arc *c, value thr);
+extern value arc_load_native(arc *c, value path);
+extern void __arc_unload_native(arc *c);
 
 /* General I/O functions */
 extern int arc_readb(arc *c, value thr);
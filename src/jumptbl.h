@@ -1 +1 @@
-&&lbl_invalid - &&lbl_inop, &&lbl_inop - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ipush - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ipop - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iret - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_itrue - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_inil - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ihlt - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iadd - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_isub - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_imul - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idiv - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icons - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icar - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icdr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iscar - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iscdr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iis - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idup - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icls - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iconsr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idcar - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idcdr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ispl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ildl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ildi - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ildg - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_istg - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iapply - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijmp - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijt - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijf - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijbnd - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_imenv - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ilde0 - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iste0 - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ilde - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iste - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icont - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ienv - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ienvr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop
+&&lbl_invalid - &&lbl_inop, &&lbl_inop - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ipush - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ipop - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iret - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_itrue - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_inil - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ihlt - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iadd - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_isub - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_imul - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idiv - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icons - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icar - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icdr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iscar - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iscdr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iis - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idup - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icls - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iconsr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iclsn - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idcar - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_idcdr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ispl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iaddfx - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_isubfx - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_imulfx - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iaddfl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_isubfl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_imulfl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ildl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ildi - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ildg - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_istg - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iclsf - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iapply - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijmp - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijt - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijf - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijbnd - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iaddi - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_isubi - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_imenv - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ilde0 - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iste0 - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ilde - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iste - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_icont - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijself - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ijinl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ienv - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ienvr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_ienvl - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_iapplyr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_itapplyr - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop, &&lbl_invalid - &&lbl_inop
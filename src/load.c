@@ -21,6 +21,11 @@
 #include "builtins.h"
 #include "io.h"
 #include "compiler.h"
+#include "../config.h"
+
+#ifdef HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
 
 #ifdef HAVE_ALLOCA_H
 # include <alloca.h>
@@ -87,8 +92,8 @@ static AFFDEF(duringthunk)
 {
   AVAR(sread, eval, sexpr);
   AFBEGIN;
-  WV(sread, arc_mkaff(c, arc_sread, CNIL));
-  WV(eval, arc_mkaff(c, arc_eval, CNIL));
+  WV(sread, ARC_AFF(c, arc_sread));
+  WV(eval, ARC_AFF(c, arc_eval));
   /* This performs the actual load. */
   for (;;) {
     AFCALL(AV(sread), LOAD_FP, CNIL, LNDATA);
@@ -105,12 +110,11 @@ AFFEND
 static AFFDEF(afterthunk)
 {
   AFBEGIN;
-  AFTCALL(arc_mkaff(c, arc_close, CNIL), LOAD_FP);
+  AFTCALL(ARC_AFF(c, arc_close), LOAD_FP);
   AFEND;
 }
 AFFEND
 
-/* XXX - add the ability to load dynamic shared objects */
 AFFDEF(arc_load)
 {
   AARG(loadfile);
@@ -119,13 +123,13 @@ AFFDEF(arc_load)
 
   /* Try to load a file specified as an absolute path directly */
   if (__arc_is_absolute_path(c, AV(loadfile))) {
-    AFCALL(arc_mkaff(c, arc_infile, CNIL), AV(loadfile));
+    AFCALL(ARC_AFF(c, arc_infile), AV(loadfile));
     WV(fp, AFCRV);
     WV(lndata, arc_mkhash(c, ARC_HASHBITS));
-    AFCALL(arc_mkaff(c, arc_dynamic_wind, CNIL),
-	   arc_mkaff2(c, beforethunk, CNIL, TENVR(thr)),
-	   arc_mkaff2(c, duringthunk, CNIL, TENVR(thr)),
-	   arc_mkaff2(c, afterthunk, CNIL, TENVR(thr)));
+    AFCALL(ARC_AFF(c, arc_dynamic_wind),
+	   arc_mkaff_nested(c, beforethunk, CNIL, thr),
+	   arc_mkaff_nested(c, duringthunk, CNIL, thr),
+	   arc_mkaff_nested(c, afterthunk, CNIL, thr));
     ARETURN(CNIL);
   }
 
@@ -138,16 +142,16 @@ AFFDEF(arc_load)
       continue;
     }
     /* first open the file. */
-    AFCALL(arc_mkaff(c, arc_infile, CNIL), AV(ldf));
+    AFCALL(ARC_AFF(c, arc_infile), AV(ldf));
     WV(fp, AFCRV);
     /* The actual load takes place in the duringthunk. The
        after thunk will take care of closing the file
        whatever happens. */
     WV(lndata, arc_mkhash(c, ARC_HASHBITS));
-    AFCALL(arc_mkaff(c, arc_dynamic_wind, CNIL),
-	   arc_mkaff2(c, beforethunk, CNIL, TENVR(thr)),
-	   arc_mkaff2(c, duringthunk, CNIL, TENVR(thr)),
-	   arc_mkaff2(c, afterthunk, CNIL, TENVR(thr)));
+    AFCALL(ARC_AFF(c, arc_dynamic_wind),
+	   arc_mkaff_nested(c, beforethunk, CNIL, thr),
+	   arc_mkaff_nested(c, duringthunk, CNIL, thr),
+	   arc_mkaff_nested(c, afterthunk, CNIL, thr));
     ARETURN(CNIL);
   }
   {
@@ -160,3 +164,96 @@ AFFDEF(arc_load)
   AFEND;
 }
 AFFEND
+
+/* Native extension modules.  A module is a shared object exporting a
+   function named by ARC_MODULE_INIT, which is called with the
+   interpreter handle and binds whatever the module provides (see
+   README.EXT).  Handles are kept until arc_deinit, as objects made
+   by a module may still be using its code until the very last
+   collection. */
+struct arc_module {
+  void *handle;
+  struct arc_module *next;
+};
+
+#ifdef HAVE_DLOPEN
+
+static value load_native(arc *c, value path)
+{
+  char *str, *msg;
+  void *handle;
+  value (*init)(arc *);
+  struct arc_module *mod;
+
+  str = (char *)alloca(FIX2INT(arc_strutflen(c, path)) + 1);
+  arc_str2cstr(c, path, str);
+  handle = dlopen(str, RTLD_NOW | RTLD_LOCAL);
+  if (handle == NULL) {
+    arc_err_cstrfmt(c, "load-native: %s", dlerror());
+    return(CNIL);
+  }
+  dlerror();
+  *(void **)(&init) = dlsym(handle, ARC_MODULE_INIT);
+  if ((msg = dlerror()) != NULL) {
+    dlclose(handle);
+    arc_err_cstrfmt(c, "load-native: %s", msg);
+    return(CNIL);
+  }
+  /* Track the module before running any of its code */
+  mod = (struct arc_module *)malloc(sizeof(struct arc_module));
+  if (mod == NULL) {
+    dlclose(handle);
+    arc_err_cstrfmt(c, "load-native: out of memory");
+    return(CNIL);
+  }
+  mod->handle = handle;
+  mod->next = c->modules;
+  c->modules = mod;
+  return(init(c));
+}
+
+#else
+
+static value load_native(arc *c, value path)
+{
+  arc_err_cstrfmt(c, "load-native: native modules are not supported on this platform");
+  return(CNIL);
+}
+
+#endif
+
+/* Load a native module, looking for it in the loadpath just as load
+   does if it is not given as an absolute path.  Returns whatever the
+   module's initialisation function returns. */
+value arc_load_native(arc *c, value path)
+{
+  value lpath, ldf;
+  char *str;
+
+  TYPECHECK(path, T_STRING);
+  if (__arc_is_absolute_path(c, path))
+    return(load_native(c, path));
+  for (lpath = arc_gbind(c, ARC_BUILTIN(c, S_LOADPATH));
+       BOUND_P(lpath) && !NIL_P(lpath); lpath = cdr(lpath)) {
+    ldf = arc_pathjoin2(c, car(lpath), path);
+    if (!NIL_P(arc_file_exists(c, ldf)))
+      return(load_native(c, ldf));
+  }
+  str = (char *)alloca(FIX2INT(arc_strutflen(c, path)) + 1);
+  arc_str2cstr(c, path, str);
+  arc_err_cstrfmt(c, "file %s not found in loadpath*", str);
+  return(CNIL);
+}
+
+void __arc_unload_native(arc *c)
+{
+  struct arc_module *mod;
+
+  while ((mod = c->modules) != NULL) {
+    c->modules = mod->next;
+#ifdef HAVE_DLOPEN
+    dlclose(mod->handle);
+#endif
+    free(mod);
+  }
+}
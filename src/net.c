@@ -93,7 +93,7 @@ static unsigned long sock_hash(arc *c, value v, arc_hs *s)
 static AFFDEF(sock_closed_p)
 {
   AARG(sock);
-  AFBEGIN;
+  AFLBEGIN;
   ARETURN((SOCKDATA(AV(sock))->closed) ? CTRUE : CNIL);
   AFEND;
 }
@@ -164,7 +164,7 @@ static AFFDEF(sock_getb)
   AARG(sock);
   char ch;
   int rb;
-  AFBEGIN;
+  AFLBEGIN;
 
   rb = recv(SOCKDATA(AV(sock))->fd, (void *)&ch, sizeof(ch), 0);
   if (rb == 0)
@@ -186,7 +186,7 @@ static AFFDEF(sock_putb)
   AARG(sock, byte);
   unsigned char ch;
   int wb;
-  AFBEGIN;
+  AFLBEGIN;
   ch = (char)(FIX2INT(AV(byte)) & 0xff);
   wb = send(SOCKDATA(AV(sock))->fd, (void *)&ch, sizeof(ch), 0);
   if (wb < 0) {
@@ -203,7 +203,7 @@ AFFEND
 static AFFDEF(sock_seek)
 {
   AARG(sock, offset, whence);
-  AFBEGIN;
+  AFLBEGIN;
   (void)sock;
   (void)offset;
   (void)whence;
@@ -216,7 +216,7 @@ AFFEND
 static AFFDEF(sock_tell)
 {
   AARG(sock);
-  AFBEGIN;
+  AFLBEGIN;
   (void)sock;
   arc_err_cstrfmt(c, "cannot tell a socket");
   ARETURN(INT2FIX(-1));
@@ -227,7 +227,7 @@ AFFEND
 static AFFDEF(sock_close)
 {
   AARG(sock);
-  AFBEGIN;
+  AFLBEGIN;
   if (SOCKDATA(AV(sock))->closed == 0) {
     close(SOCKDATA(AV(sock))->fd);
     SOCKDATA(AV(sock))->closed = 1;
@@ -258,14 +258,14 @@ void __arc_init_sockio(arc *c)
   value io_ops;
 
   io_ops = arc_mkvector(c, IO_last+1);
-  SVINDEX(io_ops, IO_closed_p, arc_mkaff(c, sock_closed_p, CNIL));
-  SVINDEX(io_ops, IO_ready, arc_mkaff(c, sock_ready, CNIL));
-  SVINDEX(io_ops, IO_wready, arc_mkaff(c, sock_wready, CNIL));
-  SVINDEX(io_ops, IO_getb, arc_mkaff(c, sock_getb, CNIL));
-  SVINDEX(io_ops, IO_putb, arc_mkaff(c, sock_putb, CNIL));
-  SVINDEX(io_ops, IO_seek, arc_mkaff(c, sock_seek, CNIL));
-  SVINDEX(io_ops, IO_tell, arc_mkaff(c, sock_tell, CNIL));
-  SVINDEX(io_ops, IO_close, arc_mkaff(c, sock_close, CNIL));
+  SVINDEX(io_ops, IO_closed_p, ARC_AFF(c, sock_closed_p));
+  SVINDEX(io_ops, IO_ready, ARC_AFF(c, sock_ready));
+  SVINDEX(io_ops, IO_wready, ARC_AFF(c, sock_wready));
+  SVINDEX(io_ops, IO_getb, ARC_AFF(c, sock_getb));
+  SVINDEX(io_ops, IO_putb, ARC_AFF(c, sock_putb));
+  SVINDEX(io_ops, IO_seek, ARC_AFF(c, sock_seek));
+  SVINDEX(io_ops, IO_tell, ARC_AFF(c, sock_tell));
+  SVINDEX(io_ops, IO_close, ARC_AFF(c, sock_close));
   SVINDEX(VINDEX(c->builtins, BI_io), BI_io_sock, io_ops);
 }
 
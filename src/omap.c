@@ -0,0 +1,718 @@
+/* 
+  Copyright (C) 2013 Rafael R. Sevilla
+
+  This file is part of Arcueid
+
+  Arcueid is free software: you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this library. If not, see <http://www.gnu.org/licenses/>
+*/
+#include "arcueid.h"
+#include "builtins.h"
+#include "hash.h"
+#include "arith.h"
+
+/* Ordered maps are B-trees.  The map object itself holds only the
+   root node.  Each node is a vector laid out as follows:
+
+   0 - number of keys in the node (fixnum)
+   1 - number of keys in the subtree rooted at the node (fixnum)
+   2 to MAXKEYS+1 - keys, in ascending order
+   MAXKEYS+2 to 2*MAXKEYS+1 - values, in the same order as the keys
+   2*MAXKEYS+2 to 3*MAXKEYS+2 - child nodes, all nil for a leaf
+
+   Every node but the root has between MINDEG-1 and MAXKEYS keys.
+   Keeping the size of every subtree in its root node allows keys to
+   be found by rank, and the rank of keys found, in logarithmic time.
+
+   Keys are ordered by arc_cmp.  Only keys that arc_cmp can order may
+   be used: real numbers, characters, strings and symbols.  Keys of
+   different kinds are ordered by kind, in that order, so any two
+   valid keys can be compared without error. */
+#define MINDEG 8
+#define MAXKEYS (2*MINDEG - 1)
+#define NODE_SIZE (3*MAXKEYS + 3)
+
+#define NKEYS(n) (FIX2INT(VINDEX(n, 0)))
+#define NSIZE(n) (FIX2INT(VINDEX(n, 1)))
+#define NKEY(n, i) (VINDEX(n, (i) + 2))
+#define NVAL(n, i) (VINDEX(n, (i) + MAXKEYS + 2))
+#define NCHILD(n, i) (VINDEX(n, (i) + 2*MAXKEYS + 2))
+#define LEAFP(n) (NIL_P(NCHILD(n, 0)))
+
+/* The counts are fixnums, so they need no write barrier */
+#define SNKEYS(n, k) (XVINDEX(n, 0) = INT2FIX(k))
+#define SNSIZE(n, k) (XVINDEX(n, 1) = INT2FIX(k))
+#define SNKEY(n, i, k) (SVINDEX(n, (i) + 2, k))
+#define SNVAL(n, i, v) (SVINDEX(n, (i) + MAXKEYS + 2, v))
+#define SNCHILD(n, i, ch) (SVINDEX(n, (i) + 2*MAXKEYS + 2, ch))
+
+#define OMAP_ROOT(m) (REP(m)[0])
+
+static value mknode(arc *c)
+{
+  value node = arc_mkvector(c, NODE_SIZE);
+
+  SNKEYS(node, 0);
+  SNSIZE(node, 0);
+  return(node);
+}
+
+value arc_mkomap(arc *c)
+{
+  value omap;
+
+  omap = arc_mkobject(c, sizeof(value), T_OMAP);
+  OMAP_ROOT(omap) = mknode(c);
+  return(omap);
+}
+
+static void set_root(value omap, value root)
+{
+  __arc_wb(OMAP_ROOT(omap), root);
+  OMAP_ROOT(omap) = root;
+}
+
+static int keyclass(value key)
+{
+  switch (TYPE(key)) {
+  case T_FIXNUM:
+  case T_FLONUM:
+  case T_BIGNUM:
+  case T_RATIONAL:
+    return(0);
+  case T_CHAR:
+    return(1);
+  case T_STRING:
+    return(2);
+  case T_SYMBOL:
+    return(3);
+  default:
+    break;
+  }
+  return(-1);
+}
+
+static int keycmp(arc *c, value k1, value k2)
+{
+  int c1 = keyclass(k1), c2 = keyclass(k2);
+
+  if (c1 != c2)
+    return(c1 - c2);
+  return(FIX2INT(arc_cmp(c, k1, k2)));
+}
+
+/* Find the position of the first key in node which is not less than
+   key.  eq is set if that key is the same as key. */
+static int node_search(arc *c, value node, value key, int *eq)
+{
+  int lo = 0, hi = NKEYS(node), mid, r;
+
+  *eq = 0;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    r = keycmp(c, key, NKEY(node, mid));
+    if (r == 0) {
+      *eq = 1;
+      return(mid);
+    }
+    if (r < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return(lo);
+}
+
+static void node_move(value dst, int di, value src, int si)
+{
+  SNKEY(dst, di, NKEY(src, si));
+  SNVAL(dst, di, NVAL(src, si));
+}
+
+static void node_clear(value node, int i)
+{
+  SNKEY(node, i, CNIL);
+  SNVAL(node, i, CNIL);
+}
+
+/* Split the full child i of node in two, moving its median key up
+   into node, which must not be full. */
+static void split_child(arc *c, value node, int i)
+{
+  value y = NCHILD(node, i), z = mknode(c);
+  int j, n = NKEYS(node), zsize = MINDEG - 1;
+
+  for (j=0; j<MINDEG-1; j++) {
+    node_move(z, j, y, j + MINDEG);
+    node_clear(y, j + MINDEG);
+  }
+  if (!LEAFP(y)) {
+    for (j=0; j<MINDEG; j++) {
+      SNCHILD(z, j, NCHILD(y, j + MINDEG));
+      SNCHILD(y, j + MINDEG, CNIL);
+      zsize += NSIZE(NCHILD(z, j));
+    }
+  }
+  SNKEYS(z, MINDEG - 1);
+  SNSIZE(z, zsize);
+
+  for (j=n; j>i; j--) {
+    node_move(node, j, node, j - 1);
+    SNCHILD(node, j + 1, NCHILD(node, j));
+  }
+  node_move(node, i, y, MINDEG - 1);
+  node_clear(y, MINDEG - 1);
+  SNCHILD(node, i + 1, z);
+  SNKEYS(node, n + 1);
+  SNKEYS(y, MINDEG - 1);
+  SNSIZE(y, NSIZE(y) - zsize - 1);
+}
+
+/* Insert into the subtree rooted at node, which must not be full,
+   splitting full nodes on the way down.  Returns 1 if a new key was
+   added, or 0 if the value of an existing key was replaced. */
+static int node_insert(arc *c, value node, value key, value val)
+{
+  int i, j, eq, r;
+
+  i = node_search(c, node, key, &eq);
+  if (eq) {
+    SNVAL(node, i, val);
+    return(0);
+  }
+  if (LEAFP(node)) {
+    for (j=NKEYS(node); j>i; j--)
+      node_move(node, j, node, j - 1);
+    SNKEY(node, i, key);
+    SNVAL(node, i, val);
+    SNKEYS(node, NKEYS(node) + 1);
+    SNSIZE(node, NSIZE(node) + 1);
+    return(1);
+  }
+  if (NKEYS(NCHILD(node, i)) == MAXKEYS) {
+    split_child(c, node, i);
+    r = keycmp(c, key, NKEY(node, i));
+    if (r == 0) {
+      SNVAL(node, i, val);
+      return(0);
+    }
+    if (r > 0)
+      i++;
+  }
+  if (!node_insert(c, NCHILD(node, i), key, val))
+    return(0);
+  SNSIZE(node, NSIZE(node) + 1);
+  return(1);
+}
+
+/* Merge child i+1 of node, and the key between them, into child i */
+static void merge_children(value node, int i)
+{
+  value y = NCHILD(node, i), z = NCHILD(node, i + 1);
+  int j, n = NKEYS(node), yn = NKEYS(y), zn = NKEYS(z);
+
+  node_move(y, yn, node, i);
+  for (j=0; j<zn; j++)
+    node_move(y, yn + 1 + j, z, j);
+  if (!LEAFP(y)) {
+    for (j=0; j<=zn; j++)
+      SNCHILD(y, yn + 1 + j, NCHILD(z, j));
+  }
+  SNKEYS(y, yn + zn + 1);
+  SNSIZE(y, NSIZE(y) + NSIZE(z) + 1);
+
+  for (j=i; j<n-1; j++) {
+    node_move(node, j, node, j + 1);
+    SNCHILD(node, j + 1, NCHILD(node, j + 2));
+  }
+  node_clear(node, n - 1);
+  SNCHILD(node, n, CNIL);
+  SNKEYS(node, n - 1);
+}
+
+/* Move a key from the left sibling of child i of node, through node,
+   into child i. */
+static void borrow_left(value node, int i)
+{
+  value ch = NCHILD(node, i), sib = NCHILD(node, i - 1);
+  int j, n = NKEYS(ch), sn = NKEYS(sib), moved = 1, leaf = LEAFP(ch);
+
+  for (j=n; j>0; j--)
+    node_move(ch, j, ch, j - 1);
+  node_move(ch, 0, node, i - 1);
+  node_move(node, i - 1, sib, sn - 1);
+  node_clear(sib, sn - 1);
+  if (!leaf) {
+    for (j=n+1; j>0; j--)
+      SNCHILD(ch, j, NCHILD(ch, j - 1));
+    SNCHILD(ch, 0, NCHILD(sib, sn));
+    SNCHILD(sib, sn, CNIL);
+    moved += NSIZE(NCHILD(ch, 0));
+  }
+  SNKEYS(ch, n + 1);
+  SNKEYS(sib, sn - 1);
+  SNSIZE(ch, NSIZE(ch) + moved);
+  SNSIZE(sib, NSIZE(sib) - moved);
+}
+
+/* Move a key from the right sibling of child i of node, through node,
+   into child i. */
+static void borrow_right(value node, int i)
+{
+  value ch = NCHILD(node, i), sib = NCHILD(node, i + 1);
+  int j, n = NKEYS(ch), sn = NKEYS(sib), moved = 1, leaf = LEAFP(ch);
+
+  node_move(ch, n, node, i);
+  node_move(node, i, sib, 0);
+  for (j=0; j<sn-1; j++)
+    node_move(sib, j, sib, j + 1);
+  node_clear(sib, sn - 1);
+  if (!leaf) {
+    SNCHILD(ch, n + 1, NCHILD(sib, 0));
+    moved += NSIZE(NCHILD(ch, n + 1));
+    for (j=0; j<sn; j++)
+      SNCHILD(sib, j, NCHILD(sib, j + 1));
+    SNCHILD(sib, sn, CNIL);
+  }
+  SNKEYS(ch, n + 1);
+  SNKEYS(sib, sn - 1);
+  SNSIZE(ch, NSIZE(ch) + moved);
+  SNSIZE(sib, NSIZE(sib) - moved);
+}
+
+/* Delete key from the subtree rooted at node, which must have at
+   least MINDEG keys unless it is the root, making sure that every
+   node descended into also has them.  Returns 1 and sets val to the
+   value of the key if it was there. */
+static int node_delete(arc *c, value node, value key, value *val)
+{
+  int i, j, eq, n = NKEYS(node);
+  value ch, pk, pv;
+
+  i = node_search(c, node, key, &eq);
+  if (LEAFP(node)) {
+    if (!eq)
+      return(0);
+    *val = NVAL(node, i);
+    for (j=i; j<n-1; j++)
+      node_move(node, j, node, j + 1);
+    node_clear(node, n - 1);
+    SNKEYS(node, n - 1);
+    SNSIZE(node, NSIZE(node) - 1);
+    return(1);
+  }
+
+  if (eq) {
+    /* Replace the key with its predecessor or successor if either of
+       the children around it can spare one, else merge them and
+       delete it from the merged child. */
+    if (NKEYS(NCHILD(node, i)) >= MINDEG) {
+      for (ch = NCHILD(node, i); !LEAFP(ch); ch = NCHILD(ch, NKEYS(ch)))
+	;
+      pk = NKEY(ch, NKEYS(ch) - 1);
+      *val = NVAL(node, i);
+      node_delete(c, NCHILD(node, i), pk, &pv);
+      SNKEY(node, i, pk);
+      SNVAL(node, i, pv);
+      SNSIZE(node, NSIZE(node) - 1);
+      return(1);
+    }
+    if (NKEYS(NCHILD(node, i + 1)) >= MINDEG) {
+      for (ch = NCHILD(node, i + 1); !LEAFP(ch); ch = NCHILD(ch, 0))
+	;
+      pk = NKEY(ch, 0);
+      *val = NVAL(node, i);
+      node_delete(c, NCHILD(node, i + 1), pk, &pv);
+      SNKEY(node, i, pk);
+      SNVAL(node, i, pv);
+      SNSIZE(node, NSIZE(node) - 1);
+      return(1);
+    }
+    merge_children(node, i);
+  } else if (NKEYS(NCHILD(node, i)) < MINDEG) {
+    if (i > 0 && NKEYS(NCHILD(node, i - 1)) >= MINDEG) {
+      borrow_left(node, i);
+    } else if (i < n && NKEYS(NCHILD(node, i + 1)) >= MINDEG) {
+      borrow_right(node, i);
+    } else if (i < n) {
+      merge_children(node, i);
+    } else {
+      merge_children(node, i - 1);
+      i--;
+    }
+  }
+  if (!node_delete(c, NCHILD(node, i), key, val))
+    return(0);
+  SNSIZE(node, NSIZE(node) - 1);
+  return(1);
+}
+
+static int check_key(arc *c, value key)
+{
+  if (keyclass(key) >= 0)
+    return(1);
+  arc_err_cstrfmt(c, "invalid key for ordered map");
+  return(0);
+}
+
+int arc_omap_length(arc *c, value omap)
+{
+  return(NSIZE(OMAP_ROOT(omap)));
+}
+
+/* Returns CUNBOUND if key is not in omap */
+value arc_omap_lookup(arc *c, value omap, value key)
+{
+  value node = OMAP_ROOT(omap);
+  int i, eq;
+
+  if (keyclass(key) < 0)
+    return(CUNBOUND);
+  for (;;) {
+    i = node_search(c, node, key, &eq);
+    if (eq)
+      return(NVAL(node, i));
+    if (LEAFP(node))
+      return(CUNBOUND);
+    node = NCHILD(node, i);
+  }
+}
+
+value arc_omap_insert(arc *c, value omap, value key, value val)
+{
+  value root = OMAP_ROOT(omap), nroot;
+
+  if (!check_key(c, key))
+    return(CNIL);
+  if (NKEYS(root) == MAXKEYS) {
+    nroot = mknode(c);
+    SNCHILD(nroot, 0, root);
+    SNSIZE(nroot, NSIZE(root));
+    split_child(c, nroot, 0);
+    set_root(omap, nroot);
+    root = nroot;
+  }
+  node_insert(c, root, key, val);
+  return(val);
+}
+
+/* Returns the value key had, or CUNBOUND if it was not in omap */
+value arc_omap_delete(arc *c, value omap, value key)
+{
+  value root = OMAP_ROOT(omap), val = CUNBOUND;
+
+  if (keyclass(key) < 0)
+    return(CUNBOUND);
+  node_delete(c, root, key, &val);
+  if (NKEYS(root) == 0 && !LEAFP(root))
+    set_root(omap, NCHILD(root, 0));
+  return(val);
+}
+
+/* The number of keys in omap which are less than key.  Key need not
+   be in omap itself. */
+int arc_omap_rank(arc *c, value omap, value key)
+{
+  value node = OMAP_ROOT(omap);
+  int i, j, eq, rank = 0;
+
+  if (!check_key(c, key))
+    return(0);
+  for (;;) {
+    i = node_search(c, node, key, &eq);
+    rank += i;
+    if (LEAFP(node))
+      return(rank);
+    for (j=0; j<i; j++)
+      rank += NSIZE(NCHILD(node, j));
+    if (eq)
+      return(rank + NSIZE(NCHILD(node, i)));
+    node = NCHILD(node, i);
+  }
+}
+
+/* The key-value pair of rank idx in omap, or nil if there is none */
+value arc_omap_nth(arc *c, value omap, int idx)
+{
+  value node = OMAP_ROOT(omap);
+  int i, cs;
+
+  if (idx < 0 || idx >= NSIZE(node))
+    return(CNIL);
+  for (;;) {
+    for (i=0; i<NKEYS(node); i++) {
+      cs = (LEAFP(node)) ? 0 : NSIZE(NCHILD(node, i));
+      if (idx < cs)
+	break;
+      if (idx == cs)
+	return(cons(c, NKEY(node, i), NVAL(node, i)));
+      idx -= cs + 1;
+    }
+    node = NCHILD(node, i);
+  }
+}
+
+/* Add the key-value pairs of the subtree rooted at node whose ranks
+   are from lo up to but not including hi to the front of list.  The
+   first key in the subtree has rank base. */
+static value collect(arc *c, value node, int base, int lo, int hi,
+		     value list)
+{
+  int i, cs, end = base + NSIZE(node);
+
+  for (i=NKEYS(node); i>=0 && end > lo; i--) {
+    cs = (LEAFP(node)) ? 0 : NSIZE(NCHILD(node, i));
+    if (cs > 0 && end - cs < hi)
+      list = collect(c, NCHILD(node, i), end - cs, lo, hi, list);
+    end -= cs;
+    if (i > 0 && end - 1 >= lo && end - 1 < hi)
+      list = cons(c, cons(c, NKEY(node, i - 1), NVAL(node, i - 1)), list);
+    end--;
+  }
+  return(list);
+}
+
+/* A list of the key-value pairs in omap with keys from lo up to but
+   not including hi, in order.  Either bound may be CUNBOUND or nil,
+   in which case the range is unbounded on that side. */
+value arc_omap_range(arc *c, value omap, value lo, value hi)
+{
+  int rlo = 0, rhi = arc_omap_length(c, omap);
+
+  if (BOUND_P(lo) && !NIL_P(lo))
+    rlo = arc_omap_rank(c, omap, lo);
+  if (BOUND_P(hi) && !NIL_P(hi))
+    rhi = arc_omap_rank(c, omap, hi);
+  if (rlo >= rhi)
+    return(CNIL);
+  return(collect(c, OMAP_ROOT(omap), 0, rlo, rhi, CNIL));
+}
+
+/* Arc builtins */
+
+static int check_omap(arc *c, value omap)
+{
+  if (TYPE(omap) == T_OMAP)
+    return(1);
+  arc_err_cstrfmt(c, "expected ordered map, given object of type %d",
+		  TYPE(omap));
+  return(0);
+}
+
+value arc_omap_first(arc *c, value omap)
+{
+  if (!check_omap(c, omap))
+    return(CNIL);
+  return(arc_omap_nth(c, omap, 0));
+}
+
+value arc_omap_last(arc *c, value omap)
+{
+  if (!check_omap(c, omap))
+    return(CNIL);
+  return(arc_omap_nth(c, omap, arc_omap_length(c, omap) - 1));
+}
+
+value arc_omap_xrank(arc *c, value omap, value key)
+{
+  if (!check_omap(c, omap))
+    return(CNIL);
+  return(INT2FIX(arc_omap_rank(c, omap, key)));
+}
+
+value arc_omap_xnth(arc *c, value omap, value idx)
+{
+  if (!check_omap(c, omap))
+    return(CNIL);
+  if (TYPE(idx) != T_FIXNUM) {
+    arc_err_cstrfmt(c, "ordered map index must be an exact integer");
+    return(CNIL);
+  }
+  return(arc_omap_nth(c, omap, FIX2INT(idx)));
+}
+
+AFFDEF(arc_omap_xrange)
+{
+  AARG(omap);
+  AOARG(lo, hi);
+  AFLBEGIN;
+  if (!check_omap(c, AV(omap)))
+    ARETURN(CNIL);
+  ARETURN(arc_omap_range(c, AV(omap), AV(lo), AV(hi)));
+  AFEND;
+}
+AFFEND
+
+static void omap_marker(arc *c, value v, int depth,
+			void (*markfn)(arc *, value, int))
+{
+  markfn(c, OMAP_ROOT(v), depth);
+}
+
+static AFFDEF(omap_pprint)
+{
+  AARG(sexpr, disp, fp);
+  AOARG(visithash);
+  AVAR(wc, dw, list);
+  AFBEGIN;
+
+  if (!BOUND_P(AV(visithash)))
+    WV(visithash, arc_mkhash(c, ARC_HASHBITS));
+
+  if (!NIL_P(__arc_visit(c, AV(sexpr), AV(visithash)))) {
+    /* already visited at some point. Do not recurse further */
+    AFTCALL(ARC_AFF(c, __arc_disp_write), arc_mkstringc(c, "(...)"),
+	   CTRUE, AV(fp), AV(visithash));
+  }
+  WV(wc, ARC_AFF(c, arc_writec));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
+  AFCALL(AV(dw), arc_mkstringc(c, "#omap("), CTRUE, AV(fp), CNIL);
+  for (WV(list, arc_omap_range(c, AV(sexpr), CNIL, CNIL)); !NIL_P(AV(list));
+       WV(list, cdr(AV(list)))) {
+    AFCALL(AV(wc), arc_mkchar(c, '('), AV(fp));
+    AFCALL(AV(dw), car(car(AV(list))), AV(disp), AV(fp), AV(visithash));
+    AFCALL(AV(dw), arc_mkstringc(c, " . "), CTRUE, AV(fp), CNIL);
+    if (!NIL_P(__arc_visitp(c, cdr(car(AV(list))), AV(visithash)))) {
+      /* already visited at some point. Do not recurse further */
+      AFCALL(AV(dw), arc_mkstringc(c, "(...)"), CTRUE,
+	     AV(fp), AV(visithash));
+    } else {
+      AFCALL(AV(dw), cdr(car(AV(list))), AV(disp), AV(fp), AV(visithash));
+    }
+    AFCALL(AV(wc), arc_mkchar(c, ')'), AV(fp));
+  }
+  AFCALL(AV(wc), arc_mkchar(c, ')'), AV(fp));
+  __arc_unvisit(c, AV(sexpr), AV(visithash));
+  ARETURN(CNIL);
+  AFEND;
+}
+AFFEND
+
+/* Two ordered maps are isomorphic if their keys are in the same order
+   and each key and its value is isomorphic to the one in the same
+   place in the other map. */
+static AFFDEF(omap_isocmp)
+{
+  AARG(v1, v2, vh1, vh2);
+  AVAR(iso2, l1, l2);
+  value vhh1, vhh2;		/* not required after calls */
+  AFBEGIN;
+
+  if ((vhh1 = __arc_visit(c, AV(v1), AV(vh1))) != CNIL) {
+    /* If we find a visited object, see if v2 is also visited in vh2.
+       If not, they are not the same. */
+    vhh2 = __arc_visit(c, AV(v2), AV(vh2));
+    /* We see if the same value was produced on visiting. */
+    ARETURN((vhh2 == vhh1) ? CTRUE : CNIL);
+  }
+
+  /* Get value assigned by __arc_visit to v1. */
+  vhh1 = __arc_visit(c, AV(v1), AV(vh1));
+  /* If we somehow already visited v2 when v1 was not visited in the
+     same way, they cannot be the same. */
+  if (__arc_visit2(c, AV(v2), AV(vh2), vhh1) != CNIL)
+    ARETURN(CNIL);
+
+  if (arc_omap_length(c, AV(v1)) != arc_omap_length(c, AV(v2)))
+    ARETURN(CNIL);
+  WV(iso2, ARC_AFF(c, arc_iso2));
+  for (WV(l1, arc_omap_range(c, AV(v1), CNIL, CNIL)),
+	 WV(l2, arc_omap_range(c, AV(v2), CNIL, CNIL));
+       !NIL_P(AV(l1)); WV(l1, cdr(AV(l1))), WV(l2, cdr(AV(l2)))) {
+    AFCALL(AV(iso2), car(car(AV(l1))), car(car(AV(l2))), AV(vh1), AV(vh2));
+    if (NIL_P(AFCRV))
+      ARETURN(CNIL);
+    AFCALL(AV(iso2), cdr(car(AV(l1))), cdr(car(AV(l2))), AV(vh1), AV(vh2));
+    if (NIL_P(AFCRV))
+      ARETURN(CNIL);
+  }
+  ARETURN(CTRUE);
+  AFEND;
+}
+AFFEND
+
+/* Hash the keys and values of an ordered map in key order, so that
+   isomorphic maps hash the same */
+static AFFDEF(omap_xhash)
+{
+  AARG(obj, ehs, length, visithash);
+  AVAR(list);
+  AFBEGIN;
+
+  if (!BOUND_P(AV(visithash)))
+    WV(visithash, arc_mkhash(c, ARC_HASHBITS));
+
+  /* Already visited at some point.  Do not recurse further. */
+  if (__arc_visit(c, AV(obj), AV(visithash)) != CNIL)
+    ARETURN(AV(length));
+
+  for (WV(list, arc_omap_range(c, AV(obj), CNIL, CNIL)); !NIL_P(AV(list));
+       WV(list, cdr(AV(list)))) {
+    AFCALL(ARC_AFF(c, arc_xhash_increment), car(car(AV(list))),
+	   AV(ehs), AV(visithash));
+    WV(length, __arc_add2(c, AV(length), AFCRV));
+    AFCALL(ARC_AFF(c, arc_xhash_increment), cdr(car(AV(list))),
+	   AV(ehs), AV(visithash));
+    WV(length, __arc_add2(c, AV(length), AFCRV));
+  }
+  ARETURN(AV(length));
+  AFEND;
+}
+AFFEND
+
+/* An ordered map can be applied with a key and an optional default
+   value, just like a table */
+static int omap_apply(arc *c, value thr, value omap)
+{
+  value key, dflt = CNIL, val;
+
+  if (arc_thr_argc(c, thr) == 2) {
+    dflt = arc_thr_pop(c, thr);
+  } else if (arc_thr_argc(c, thr) != 1) {
+    arc_err_cstrfmt(c, "application of an ordered map expects 1 or 2 arguments, given %d",
+		    arc_thr_argc(c, thr));
+    return(TR_RC);
+  }
+  key = arc_thr_pop(c, thr);
+  val = arc_omap_lookup(c, omap, key);
+  arc_thr_set_valr(c, thr, (BOUND_P(val)) ? val : dflt);
+  return(TR_RC);
+}
+
+static AFFDEF(omap_xcoerce)
+{
+  AARG(obj, stype, arg);
+  AFLBEGIN;
+  (void)arg;
+  if (FIX2INT(AV(stype)) == T_OMAP)
+    ARETURN(AV(obj));
+
+  if (FIX2INT(AV(stype)) == T_CONS)
+    ARETURN(arc_omap_range(c, AV(obj), CNIL, CNIL));
+  arc_err_cstrfmt(c, "cannot coerce");
+  ARETURN(CNIL);
+  AFEND;
+}
+AFFEND
+
+typefn_t __arc_omap_typefn__ = {
+  omap_marker,
+  __arc_null_sweeper,
+  omap_pprint,
+  NULL,
+  NULL,
+  omap_isocmp,
+  omap_apply,
+  omap_xcoerce,
+  omap_xhash
+};
@@ -114,11 +114,11 @@ AFFDEF(arc_timedate)
   (void)ignored;
 
   if (BOUND_P(AV(arg))) {
-    AFCALL(arc_mkaff(c, arc_coerce, CNIL), AV(arg),
+    AFCALL(ARC_AFF(c, arc_coerce), AV(arg),
 	   ARC_BUILTIN(c, S_FIXNUM));
     fnv = AFCRV;
     if (NIL_P(fnv)) {
-      AFCALL(arc_mkaff(c, arc_coerce, CNIL), AV(arg),
+      AFCALL(ARC_AFF(c, arc_coerce), AV(arg),
 	     ARC_BUILTIN(c, S_FLONUM));
       fnv = AFCRV;
       tm = (time_t)REPFLO(fnv);
@@ -173,15 +173,15 @@ AFFDEF(arc_system)
   AFBEGIN;
   WV(pf, arc_pipe_from(c, AV(cmd)));
   for (;;) {
-    AFCALL(arc_mkaff(c, arc_readc, CNIL), AV(pf));
+    AFCALL(ARC_AFF(c, arc_readc), AV(pf));
     if (NIL_P(AFCRV))
       goto finished;
-    AFCALL(arc_mkaff(c, arc_writec, CNIL), AFCRV);
+    AFCALL(ARC_AFF(c, arc_writec), AFCRV);
   }
  finished:
   /* XXX - find out a way to get the original return value of the
      command to return it properly. */
-  AFCALL(arc_mkaff(c, arc_close, CNIL), AV(pf));
+  AFCALL(ARC_AFF(c, arc_close), AV(pf));
   ARETURN(CTRUE);
   AFEND;
 }
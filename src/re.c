@@ -94,8 +94,8 @@ static AFFDEF(regex_pprint)
 
   (void)visithash;
   (void)disp;
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
+  WV(wc, ARC_AFF(c, arc_writec));
   AFCALL(AV(wc), arc_mkchar(c, 'r'), AV(fp));
   AFCALL(AV(wc), arc_mkchar(c, '/'), AV(fp));
 
@@ -274,14 +274,14 @@ value arc_readlineport(arc *c)
   rlio = __arc_allocio(c, T_INPORT, &rlio_tfn, sizeof(struct rlio_t));
   IO(rlio)->flags = IO_FLAG_GETB_IS_GETC;
   io_ops = arc_mkvector(c, IO_last+1);
-  SVINDEX(io_ops, IO_closed_p, arc_mkaff(c, rl_closed_p, CNIL));
-  SVINDEX(io_ops, IO_ready, arc_mkaff(c, rl_ready, CNIL));
-  SVINDEX(io_ops, IO_wready, arc_mkaff(c, rl_wready, CNIL));
-  SVINDEX(io_ops, IO_getb, arc_mkaff(c, rl_getb, CNIL));
-  SVINDEX(io_ops, IO_putb, arc_mkaff(c, rl_putb, CNIL));
-  SVINDEX(io_ops, IO_seek, arc_mkaff(c, rl_seek, CNIL));
-  SVINDEX(io_ops, IO_tell, arc_mkaff(c, rl_tell, CNIL));
-  SVINDEX(io_ops, IO_close, arc_mkaff(c, rl_close, CNIL));
+  SVINDEX(io_ops, IO_closed_p, ARC_AFF(c, rl_closed_p));
+  SVINDEX(io_ops, IO_ready, ARC_AFF(c, rl_ready));
+  SVINDEX(io_ops, IO_wready, ARC_AFF(c, rl_wready));
+  SVINDEX(io_ops, IO_getb, ARC_AFF(c, rl_getb));
+  SVINDEX(io_ops, IO_putb, ARC_AFF(c, rl_putb));
+  SVINDEX(io_ops, IO_seek, ARC_AFF(c, rl_seek));
+  SVINDEX(io_ops, IO_tell, ARC_AFF(c, rl_tell));
+  SVINDEX(io_ops, IO_close, ARC_AFF(c, rl_close));
   IO(rlio)->io_ops = io_ops;
   IO(rlio)->name = arc_mkstringc(c, "(repl)");
   RLDATA(rlio)->closed = 0;
@@ -336,6 +336,7 @@ static void help(void)
   printf("  -l, --load=FILE       load FILE before dropping into the REPL\n");
   printf("                        (may be used more than once)\n");
   printf("  -q, --quiet           do not display banner on startup\n");
+  printf("  --no-opt              compile code without optimizing it\n");
   printf("  -h, --help            display this help and exit\n");
   printf("  -v, --version         output version information and exit\n");
 }
@@ -374,7 +375,7 @@ static void errhandler(arc *c, value thr, value str)
   } while (0)
 
 #define XCALL(fname, ...) do {				\
-    SVALR(c->curthread, arc_mkaff(c, fname, CNIL));	\
+    SVALR(c->curthread, ARC_AFF(c, fname));	\
     TARGC(c->curthread) = NARGS(__VA_ARGS__);		\
     FOR_EACH(CPUSH_, __VA_ARGS__);			\
     __arc_thr_trampoline(c, c->curthread, TR_FNAPP);	\
@@ -388,9 +389,9 @@ AFFDEF(compile_something)
   AFBEGIN;
   TQUANTA(thr) = QUANTA;	/* needed so macros can execute */
   WV(sio, arc_instring(c, AV(something), CNIL));
-  AFCALL(arc_mkaff(c, arc_sread, CNIL), AV(sio), CNIL);
+  AFCALL(ARC_AFF(c, arc_sread), AV(sio), CNIL);
   sexpr = AFCRV;
-  AFTCALL(arc_mkaff(c, arc_compile, CNIL), sexpr, arc_mkcctx(c), CNIL, CTRUE);
+  AFTCALL(ARC_AFF(c, arc_compile), sexpr, arc_mkcctx(c), CNIL, CTRUE);
   AFEND;
 }
 AFFEND
@@ -457,6 +458,8 @@ int main(int argc, const char **argv)
 			 gopt_option('I', GOPT_ARG|GOPT_REPEAT,
 				     gopt_shorts('I'),
 				     gopt_longs("include")),
+			 gopt_option('O', 0, gopt_shorts(0),
+				     gopt_longs("no-opt")),
 			 gopt_option('s', 0, gopt_shorts('s'),
 				     gopt_longs("script")),
 			 gopt_option('l', GOPT_ARG|GOPT_REPEAT,
@@ -492,6 +495,8 @@ int main(int argc, const char **argv)
   c->errhandler = errhandler2;
   arc_init(c);
   atexit(cleanup);
+  if (gopt(options, 'O'))
+    arc_declare(c, ARC_BUILTIN(c, S_OPTIMIZE), CNIL);
 
   c->curthread = arc_mkthread(c);
   /* Load arc.arc into our system. */
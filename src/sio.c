@@ -52,7 +52,7 @@ static unsigned long sio_hash(arc *c, value v, arc_hs *s)
 static AFFDEF(sio_closed_p)
 {
   AARG(sio);
-  AFBEGIN;
+  AFLBEGIN;
   ARETURN((SIODATA(AV(sio))->closed) ? CTRUE : CNIL);
   AFEND;
 }
@@ -62,7 +62,7 @@ AFFEND
 static AFFDEF(sio_ready)
 {
   AARG(sio);
-  AFBEGIN;
+  AFLBEGIN;
   ARETURN((SIODATA(AV(sio))->idx >= 0) ? CTRUE : CTRUE);
   AFEND;
 }
@@ -71,7 +71,7 @@ AFFEND
 static AFFDEF(sio_wready)
 {
   AARG(sio);
-  AFBEGIN;
+  AFLBEGIN;
   ARETURN((TYPE(AV(sio)) == T_OUTPORT) ? CTRUE : CNIL);
   AFEND;
 }
@@ -82,7 +82,7 @@ static AFFDEF(sio_getb)
   AARG(sio);
   int len;
   Rune r;
-  AFBEGIN;
+  AFLBEGIN;
   len = arc_strlen(c, SIODATA(AV(sio))->str);
   if (SIODATA(AV(sio))->idx >= len)
     ARETURN(CNIL);
@@ -97,7 +97,7 @@ static AFFDEF(sio_putb)
   AARG(sio, byte);
   int len;
 
-  AFBEGIN;
+  AFLBEGIN;
   if (SIODATA(AV(sio))->str == CNIL)
     SIODATA(AV(sio))->str = arc_mkstringlen(c, 0);
   len = arc_strlen(c, SIODATA(AV(sio))->str);
@@ -118,7 +118,7 @@ static AFFDEF(sio_seek)
 {
   AARG(sio, offset, whence);
   int len, noffset;
-  AFBEGIN;
+  AFLBEGIN;
 
   if (!FIXNUM_P(AV(offset))) {
     arc_err_cstrfmt(c, "invalid seek offset for sio (must be fixnum)");
@@ -151,7 +151,7 @@ AFFEND
 static AFFDEF(sio_tell)
 {
   AARG(sio);
-  AFBEGIN;
+  AFLBEGIN;
   ARETURN(INT2FIX(SIODATA(AV(sio))->idx));
   AFEND;
 }
@@ -160,7 +160,7 @@ AFFEND
 static AFFDEF(sio_close)
 {
   AARG(sio);
-  AFBEGIN;
+  AFLBEGIN;
   SIODATA(AV(sio))->closed = 1;
   ARETURN(CNIL);
   AFEND;
@@ -229,14 +229,14 @@ void __arc_init_sio(arc *c)
   value io_ops;
 
   io_ops = arc_mkvector(c, IO_last+1);
-  SVINDEX(io_ops, IO_closed_p, arc_mkaff(c, sio_closed_p, CNIL));
-  SVINDEX(io_ops, IO_ready, arc_mkaff(c, sio_ready, CNIL));
-  SVINDEX(io_ops, IO_wready, arc_mkaff(c, sio_wready, CNIL));
-  SVINDEX(io_ops, IO_getb, arc_mkaff(c, sio_getb, CNIL));
-  SVINDEX(io_ops, IO_putb, arc_mkaff(c, sio_putb, CNIL));
-  SVINDEX(io_ops, IO_seek, arc_mkaff(c, sio_seek, CNIL));
-  SVINDEX(io_ops, IO_tell, arc_mkaff(c, sio_tell, CNIL));
-  SVINDEX(io_ops, IO_close, arc_mkaff(c, sio_close, CNIL));
+  SVINDEX(io_ops, IO_closed_p, ARC_AFF(c, sio_closed_p));
+  SVINDEX(io_ops, IO_ready, ARC_AFF(c, sio_ready));
+  SVINDEX(io_ops, IO_wready, ARC_AFF(c, sio_wready));
+  SVINDEX(io_ops, IO_getb, ARC_AFF(c, sio_getb));
+  SVINDEX(io_ops, IO_putb, ARC_AFF(c, sio_putb));
+  SVINDEX(io_ops, IO_seek, ARC_AFF(c, sio_seek));
+  SVINDEX(io_ops, IO_tell, ARC_AFF(c, sio_tell));
+  SVINDEX(io_ops, IO_close, ARC_AFF(c, sio_close));
   SVINDEX(VINDEX(c->builtins, BI_io), BI_io_strio, io_ops);
 }
 
@@ -123,10 +123,10 @@ value __arc_reset_lineno(arc *c, value lndata)
   return(set_lineno2(c, lndata, INT2FIX(1)));
 }
 
-/* Gets the closest file and line number to obj. If obj is not
-   found in the lndata table, returns the last value it returned
-   (which is probably close enough) */
-value __arc_get_fileline(arc *c, value lndata, value obj)
+/* Gets the closest line number to obj. If obj is not found in the
+   lndata table, returns the last value it returned (which is probably
+   close enough) */
+value __arc_get_lineno(arc *c, value lndata, value obj)
 {
   value lineno;
 
@@ -142,7 +142,15 @@ value __arc_get_fileline(arc *c, value lndata, value obj)
       set_lineno2(c, lndata, lineno);
     }
   }
-  return(cons(c, get_file(c, lndata), lineno));
+  return(lineno);
+}
+
+/* Gets the file and the closest line number to obj */
+value __arc_get_fileline(arc *c, value lndata, value obj)
+{
+  if (!BOUND_P(lndata))
+    return(CUNBOUND);
+  return(cons(c, get_file(c, lndata), __arc_get_lineno(c, lndata, obj)));
 }
 
 /* Is ch a valid character in a symbol? */
@@ -160,15 +168,15 @@ static int issym(Rune ch)
 }
 
 #define SCAN(fp, lndata, ch)			\
-  AFCALL(arc_mkaff(c, scan, CNIL), fp, lndata);	\
+  AFCALL(ARC_AFF(c, scan), fp, lndata);	\
   WV(ch, AFCRV)
 
 #define READ(fp, eof, lndata, val)				\
-  AFCALL(arc_mkaff(c, arc_sread, CNIL), fp, eof, lndata);	\
+  AFCALL(ARC_AFF(c, arc_sread), fp, eof, lndata);	\
   WV(val, AFCRV)
 
 #define READC(fp, val)					\
-  AFCALL(arc_mkaff(c, arc_readc, CNIL), fp);	\
+  AFCALL(ARC_AFF(c, arc_readc), fp);	\
   WV(val, AFCRV);					\
   if (NIL_P(AV(val))) {					\
     arc_err_cstrfmt(c, "unexpected end of source");	\
@@ -176,22 +184,94 @@ static int issym(Rune ch)
   }
 
 #define READC2(fp, val, r)					\
-  AFCALL(arc_mkaff(c, arc_readc, CNIL), fp);			\
+  AFCALL(ARC_AFF(c, arc_readc), fp);			\
   WV(val, AFCRV);						\
   r = (NIL_P(AV(val))) ? Runeerror : arc_char2rune(c, AV(val))	\
 
-#define READ_COMMENT(fd, lndata) AFCALL(arc_mkaff(c, read_comment, CNIL), fd, CNIL, lndata)
+#define READ_COMMENT(fd, lndata) AFCALL(ARC_AFF(c, read_comment), fd, CNIL, lndata)
+
+/* Symbols are read into a token buffer, a string that is used over
+   again from one token to the next, so that reading a symbol that has
+   already been interned makes no garbage.  A reader takes the buffer
+   while it reads a token and puts it back afterwards.  Another thread
+   reading a token in the meantime will get a buffer of its own. */
+#define TOKBUF_SIZE 64
+#define TOKBUF_MAX 1024
+
+static value get_tokbuf(arc *c)
+{
+  value buf = VINDEX(c->builtins, BI_tokbuf);
+
+  if (NIL_P(buf))
+    return(arc_mkstringlen(c, TOKBUF_SIZE));
+  SVINDEX(c->builtins, BI_tokbuf, CNIL);
+  return(buf);
+}
+
+static void put_tokbuf(arc *c, value buf)
+{
+  /* do not hang on to the buffer for some very long token */
+  if (arc_strlen(c, buf) <= TOKBUF_MAX)
+    SVINDEX(c->builtins, BI_tokbuf, buf);
+}
+
+/* Put r at index len of the token buffer buf, returning the buffer,
+   which will have been replaced by a bigger one if it was full. */
+static value tokbuf_put(arc *c, value buf, int len, Rune r)
+{
+  value nbuf;
+  int i;
+
+  if (len >= arc_strlen(c, buf)) {
+    nbuf = arc_mkstringlen(c, 2*len);
+    for (i=0; i<len; i++)
+      arc_strsetindex(c, nbuf, i, arc_strindex(c, buf, i));
+    buf = nbuf;
+  }
+  arc_strsetindex(c, buf, len, r);
+  return(buf);
+}
+
+/* Turn the symbol or number in the token buffer into its value. */
+static value toksym(arc *c, value buf, int len)
+{
+  Rune name[TOKBUF_MAX];
+  value str, num;
+  int i;
+
+  if (len > TOKBUF_MAX)
+    return(arc_intern(c, arc_substrcpy(c, buf, 0, len)));
+  for (i=0; i<len; i++)
+    name[i] = arc_strindex(c, buf, i);
+  if (len == 1 && name[0] == '.')
+    return(ARC_BUILTIN(c, S_DOT));
+  /* Only a token that begins with one of these could be a number */
+  if (len > 0 && name[0] < 0x80
+      && (isdigit(name[0]) || name[0] == '+' || name[0] == '-'
+	  || name[0] == '.')) {
+    str = arc_mkstring(c, name, len);
+    num = arc_string2num(c, str, 0, 0);
+    if (!NIL_P(num))
+      return(num);
+    return(arc_intern(c, str));
+  }
+  return(arc_intern_runes(c, name, len));
+}
 
 /* Read up to the first non-symbol character from fp.
    This also serves to read a regex, which is something of the
-   form r/.../ */
+   form r/.../  If intern is true, a token that is not a regex is
+   returned as the number or symbol it reads as, rather than as a
+   string. */
 static AFFDEF(getsymbol)
 {
-  AARG(fp);
-  AVAR(buf, ch, state, casefold, multiline);
+  AARG(fp, intern);
+  AVAR(buf, len, ch, state, casefold, multiline);
   Rune r;
+  value tok;
   AFBEGIN;
-  WV(buf, arc_outstring(c, CNIL));
+  WV(buf, get_tokbuf(c));
+  WV(len, INT2FIX(0));
   WV(state, INT2FIX(0));
   WV(casefold, CNIL);
   WV(multiline, CNIL);
@@ -208,7 +288,7 @@ static AFFDEF(getsymbol)
 	/* We are reading a regular expression.  Transition to state 2
 	   and clear the buffer. */
 	WV(state, INT2FIX(2));
-	WV(buf, arc_outstring(c, CNIL));
+	WV(len, INT2FIX(0));
 	continue;
       } else {
 	/* We are not reading a regex.  Transition to state 5. */
@@ -231,6 +311,7 @@ static AFFDEF(getsymbol)
       }
 
       if (r == Runeerror) {
+	put_tokbuf(c, AV(buf));
 	arc_err_cstrfmt(c, "unexpected end of source while reading regex");
 	ARETURN(CNIL);
       }
@@ -244,6 +325,7 @@ static AFFDEF(getsymbol)
       else if (r == 'm' && NIL_P(AV(multiline)))
 	WV(multiline, CTRUE);
       else if (r == 'i' || r == 'm') {
+	put_tokbuf(c, AV(buf));
 	arc_err_cstrfmt(c, "regular expression flags used more than once");
 	ARETURN(CNIL);
       } else if (ucisspace(r)) {
@@ -251,6 +333,7 @@ static AFFDEF(getsymbol)
 	goto finished;
       } else {
 	/* any other character is considered an invalid flag */
+	put_tokbuf(c, AV(buf));
 	arc_err_cstrfmt(c, "invalid regular expression flag %c", r);
 	ARETURN(CNIL);
       }
@@ -262,24 +345,29 @@ static AFFDEF(getsymbol)
       goto finished;		/* no more to read */
     }
     /* write character to buffer */
-    AFCALL(arc_mkaff(c, arc_writec, CNIL), AV(ch), AV(buf));
+    WV(buf, tokbuf_put(c, AV(buf), FIX2INT(AV(len)), r));
+    WV(len, INT2FIX(FIX2INT(AV(len)) + 1));
   }
  finished:
+  put_tokbuf(c, AV(buf));
   /* If the final state was state 5, we have a normal symbol or
      number.  Return it. */
-  if (AV(state) == INT2FIX(5))
-    ARETURN(arc_inside(c, AV(buf)));
+  if (AV(state) == INT2FIX(5)) {
+    if (!NIL_P(AV(intern)))
+      ARETURN(toksym(c, AV(buf), FIX2INT(AV(len))));
+    ARETURN(arc_substrcpy(c, AV(buf), 0, FIX2INT(AV(len))));
+  }
 
   /* If our final state is state 4, we read a regex. */
   if (AV(state) == INT2FIX(4)) {
-    value rxstr = arc_inside(c, AV(buf));
     unsigned int flags = 0;
 
+    tok = arc_substrcpy(c, AV(buf), 0, FIX2INT(AV(len)));
     if (AV(casefold))
       flags |= REGEXP_CASEFOLD;
     if (AV(multiline))
       flags |= REGEXP_MULTILINE;
-    ARETURN(arc_mkregexp(c, rxstr, flags));
+    ARETURN(arc_mkregexp(c, tok, flags));
   }
 
   /* never get here */
@@ -308,31 +396,31 @@ AFFDEF(arc_sread)
     /* cannot use switch here: interferes with the case statement implicitly
        created by AFBEGIN! */
     if (r == '(') {
-      WV(func, arc_mkaff(c, read_list, CNIL));
+      WV(func, ARC_AFF(c, read_list));
     } else if (r == ')') {
       arc_err_cstrfmt(c, "misplaced right paren");
       ARETURN(CNIL);
     } else if (r == '[') {
-      WV(func, arc_mkaff(c, read_anonf, CNIL));
+      WV(func, ARC_AFF(c, read_anonf));
     } else if (r == ']') {
       arc_err_cstrfmt(c, "misplaced right bracket");
       ARETURN(CNIL);
     } else if (r == '\'') {
-      WV(func, arc_mkaff(c, read_quote, CNIL));
+      WV(func, ARC_AFF(c, read_quote));
     } else if (r == '`') {
-      WV(func, arc_mkaff(c, read_qquote, CNIL));
+      WV(func, ARC_AFF(c, read_qquote));
     } else if (r == ',') {
-      WV(func, arc_mkaff(c, read_comma, CNIL));
+      WV(func, ARC_AFF(c, read_comma));
     } else if (r == '"') {
-      WV(func, arc_mkaff(c, read_string, CNIL));
+      WV(func, ARC_AFF(c, read_string));
     } else if (r == '#') {
-      WV(func, arc_mkaff(c, read_char, CNIL));
+      WV(func, ARC_AFF(c, read_char));
     } else if (r == ';') {
       READ_COMMENT(AV(fp), AV(lndata));
       continue;
     } else {
       arc_ungetc_rune(c, r, AV(fp));
-      WV(func, arc_mkaff(c, read_symbol, CNIL));
+      WV(func, ARC_AFF(c, read_symbol));
     }
     if (BOUND_P(AV(lndata))) {
       value result;
@@ -358,7 +446,7 @@ static AFFDEF(scan)
   AVAR(ch);
   AFBEGIN;
   for (;;) {
-    AFCALL(arc_mkaff(c, arc_readc, CNIL), AV(fp));
+    AFCALL(ARC_AFF(c, arc_readc), AV(fp));
     WV(ch, AFCRV);
     if (NIL_P(AV(ch)))
       ARETURN(CNIL);
@@ -482,7 +570,7 @@ static AFFDEF(read_quote)
   AOARG(lndata);
   AFBEGIN;
   (void)lndata;
-  AFTCALL(arc_mkaff(c, readq, CNIL), AV(fp), ARC_BUILTIN(c, S_QUOTE),
+  AFTCALL(ARC_AFF(c, readq), AV(fp), ARC_BUILTIN(c, S_QUOTE),
 	  AV(eof), AV(lndata));
   AFEND;
 }
@@ -494,7 +582,7 @@ static AFFDEF(read_qquote)
   AOARG(lndata);
   AFBEGIN;
   (void)lndata;
-  AFTCALL(arc_mkaff(c, readq, CNIL), AV(fp), ARC_BUILTIN(c, S_QQUOTE),
+  AFTCALL(ARC_AFF(c, readq), AV(fp), ARC_BUILTIN(c, S_QQUOTE),
 	  AV(eof), AV(lndata));
   AFEND;
 }
@@ -513,12 +601,12 @@ static AFFDEF(read_comma)
   r = arc_char2rune(c, AV(ch));
   /* unquote-splicing */
   if (r == '@') {
-    AFTCALL(arc_mkaff(c, readq, CNIL), AV(fp),
+    AFTCALL(ARC_AFF(c, readq), AV(fp),
 	    ARC_BUILTIN(c, S_UNQUOTESP), AV(eof), AV(lndata));
   }
   /* normal unquote. */
   arc_ungetc_rune(c, r, AV(fp));
-  AFTCALL(arc_mkaff(c, readq, CNIL), AV(fp), ARC_BUILTIN(c, S_UNQUOTE),
+  AFTCALL(ARC_AFF(c, readq), AV(fp), ARC_BUILTIN(c, S_UNQUOTE),
 	  AV(eof), AV(lndata));
   AFEND;
 }
@@ -583,10 +671,10 @@ static AFFDEF(codestring)
   /* Get the current position after reading. Break the string up
      again at that point, and pass the remainder of the string back
      to codestring recursively. */
-  AFCALL(arc_mkaff(c, arc_tell, CNIL), AV(in));
+  AFCALL(ARC_AFF(c, arc_tell), AV(in));
   i = FIX2INT(AFCRV);
   rlen = arc_strlen(c, AV(rest));
-  AFCALL(arc_mkaff(c, codestring, CNIL),
+  AFCALL(ARC_AFF(c, codestring),
 	 arc_substr(c, AV(rest), i, rlen), AV(lndata));
   /* We then combine the pre-@-sign portion of the string (ss),
      the post-@-sign portion (that became sexpr after reading), and the
@@ -605,7 +693,7 @@ static AFFDEF(read_atstring)
   AVAR(cs, p);
   AFBEGIN;
   if (atpos(c, AV(s), 0) >= 0) {
-    AFCALL(arc_mkaff(c, codestring, CNIL), AV(s), AV(lndata));
+    AFCALL(ARC_AFF(c, codestring), AV(s), AV(lndata));
     WV(cs, AFCRV);
     for (WV(p, AV(cs)); AV(p); WV(p, cdr(AV(p)))) {
       if (TYPE(car(AV(p))) == T_STRING)
@@ -638,7 +726,7 @@ AFFDEF(read_string)
       if (r == '\"') {
 	/* end of string */
 	if (arc_declared(c, ARC_BUILTIN(c, S_ATSTRINGS))) {
-	  AFTCALL(arc_mkaff(c, read_atstring, CNIL),
+	  AFTCALL(ARC_AFF(c, read_atstring),
 		  arc_inside(c, AV(buf)), AV(lndata));
 	}
 	ARETURN(arc_inside(c, AV(buf)));
@@ -655,7 +743,7 @@ AFFDEF(read_string)
       }
 
       /* Otherwise, just add the character to our string buffer */
-      AFCALL(arc_mkaff(c, arc_writec, CNIL), arc_mkchar(c, r), AV(buf));
+      AFCALL(ARC_AFF(c, arc_writec), arc_mkchar(c, r), AV(buf));
       continue;
     }
 
@@ -688,7 +776,7 @@ AFFDEF(read_string)
 	arc_err_cstrfmt(c, "unknown escape code");
 	ARETURN(CNIL);
       }
-      AFCALL(arc_mkaff(c, arc_writec, CNIL), arc_mkchar(c, r), AV(buf));
+      AFCALL(ARC_AFF(c, arc_writec), arc_mkchar(c, r), AV(buf));
       WV(state, INT2FIX(1));
       continue;
     }
@@ -697,7 +785,7 @@ AFFDEF(read_string)
       /* Unicode escape */
       if (FIX2INT(AV(digcount)) >= 5) {
 	arc_ungetc_rune(c, r, AV(fp));
-	AFCALL(arc_mkaff(c, arc_writec, CNIL),
+	AFCALL(ARC_AFF(c, arc_writec),
 	       arc_mkchar(c, FIX2INT(AV(escrune))),
 	       AV(buf));
 	WV(state, INT2FIX(1));
@@ -760,7 +848,7 @@ static AFFDEF(read_char)
     ARETURN(arc_mkchar(c, r));
   }
   arc_ungetc_rune(c, r, AV(fp));
-  AFCALL(arc_mkaff(c, getsymbol, CNIL), AV(fp));
+  AFCALL(ARC_AFF(c, getsymbol), AV(fp), CNIL);
   tok = AFCRV;
   /* no AFCALLs after this point? */
   if (arc_strlen(c, tok) == 1)	/* single character */
@@ -856,24 +944,10 @@ static AFFDEF(read_symbol)
 {
   AARG(fp, eof);
   AOARG(lndata);
-  AVAR(sym);
-  value num;
   AFBEGIN;
   (void)lndata;
   (void)eof;
-  AFCALL(arc_mkaff(c, getsymbol, CNIL), AV(fp));
-  WV(sym, AFCRV);
-  if (TYPE(AV(sym)) == T_REGEXP)
-    return(AV(sym));
-  if (arc_strcmp(c, AV(sym), arc_mkstringc(c, ".")) == 0)
-    ARETURN(ARC_BUILTIN(c, S_DOT));
-  /* Try to convert the symbol to a number */
-  num = arc_string2num(c, AV(sym), 0, 0);
-  if (!NIL_P(num))
-    ARETURN(num);
-  /* If that doesn't work, well, just intern the symbol and toss it
-     out there. */
-  ARETURN(arc_intern(c, AV(sym)));  
+  AFTCALL(ARC_AFF(c, getsymbol), AV(fp), CTRUE);
   AFEND;
 }
 AFFEND
@@ -21,11 +21,11 @@
 #include "io.h"
 
 #define READ(fp, eof, val)					\
-  AFCALL(arc_mkaff(c, arc_sread, CNIL), fp, eof);	\
+  AFCALL(ARC_AFF(c, arc_sread), fp, eof);	\
   WV(val, AFCRV)
 
 #define READC(fp, val)					\
-  AFCALL(arc_mkaff(c, arc_readc, CNIL), fp);		\
+  AFCALL(ARC_AFF(c, arc_readc), fp);		\
   WV(val, AFCRV)
 
 value arc_ssyntax(arc *c, value x)
@@ -205,12 +205,12 @@ static AFFDEF(expand_ssyntax)
   AFBEGIN;
   if (arc_strchr(c, AV(sym), ':') != CNIL
       || arc_strchr(c, AV(sym), '~') != CNIL)
-    AFTCALL(arc_mkaff(c, expand_compose, CNIL), AV(sym));
+    AFTCALL(ARC_AFF(c, expand_compose), AV(sym));
   if (arc_strchr(c, AV(sym), '.') != CNIL
       || arc_strchr(c, AV(sym), '!') != CNIL)
-    AFTCALL(arc_mkaff(c, expand_sexpr, CNIL), AV(sym));
+    AFTCALL(ARC_AFF(c, expand_sexpr), AV(sym));
   if (arc_strchr(c, AV(sym), '&') != CNIL)
-    AFTCALL(arc_mkaff(c, expand_and, CNIL), AV(sym));
+    AFTCALL(ARC_AFF(c, expand_and), AV(sym));
   ARETURN(CNIL);
   AFEND;
 } 
@@ -229,7 +229,7 @@ AFFDEF(arc_ssexpand)
     ARETURN(CNIL);
 
   x = arc_sym2name(c, AV(sym));
-  AFTCALL(arc_mkaff(c, expand_ssyntax, CNIL), x);
+  AFTCALL(ARC_AFF(c, expand_ssyntax), x);
   AFEND;
 }
 AFFEND
@@ -16,6 +16,7 @@
   You should have received a copy of the GNU Lesser General Public
   License along with this library; if not, see <http://www.gnu.org/licenses/>.
 */
+#include <stddef.h>
 #include <inttypes.h>
 #include <string.h>
 #include "arcueid.h"
@@ -40,12 +41,55 @@
 void *alloca (size_t);
 #endif
 
+/* A string whose runes all fit in a byte keeps them in one byte each,
+   as Latin-1.  Its kind says whether that is so, or whether it keeps
+   them as UCS-4.  A string made with only one-byte runes is widened
+   when a wider rune is put into it.  As the string itself cannot grow,
+   its runes are then moved into a new UCS-4 string, to which it points
+   from then on.
+
+   The kind is only ever an upper bound.  A string of kind STR_LATIN1
+   may well contain nothing but ASCII, but one of kind STR_ASCII has
+   no runes over 0x7f, so it is also valid UTF-8 as it stands.
+
+   A substring need not have runes of its own either.  It can be a
+   slice, pointing into the runes of the string it was taken from at
+   some offset.  The string whose runes are pointed into is then marked
+   as shared, and from then on whichever string puts a rune into shared
+   runes first copies them, so the others never see the change. */
+enum {
+  STR_ASCII=0,			/* one byte per rune, all below 0x80 */
+  STR_LATIN1=1,			/* one byte per rune */
+  STR_UCS4=2			/* four bytes per rune */
+};
+
 typedef struct {
   int len;
-  Rune str[1];
+  int kind;
+  unsigned long hash;		/* cached hash of str, zero if none yet */
+  value buf;			/* string holding the runes, if not this one */
+  int ofs;			/* where the runes begin in buf */
+  int shared;			/* whether some slice points into our runes */
+  union {
+    unsigned char b[1];
+    Rune r[1];
+  } str;
 } string;
 
 #define STRREP(v) ((string *)REP(v))
+#define NARROWP(v) (STRREP(v)->kind != STR_UCS4)
+#define STRSTORE(v) ((NIL_P(STRREP(v)->buf)) ? (v) : STRREP(v)->buf)
+#define STRBYTES(v) (STRREP(STRSTORE(v))->str.b + STRREP(v)->ofs)
+#define STRRUNES(v) (STRREP(STRSTORE(v))->str.r + STRREP(v)->ofs)
+
+/* Substrings shorter than this are copied rather than sliced, as a
+   slice would take up about as much room as the copy. */
+#define SLICE_MIN 16
+
+/* Nor is a substring sliced if it is less than 1/SLICE_RATIO of the
+   runes it would point into, so that a slice never keeps alive more
+   than SLICE_RATIO times the runes it needs. */
+#define SLICE_RATIO 4
 
 #define FIXINC(x) WV(x, INT2FIX(FIX2INT(AV(x)) + 1))
 
@@ -93,7 +137,7 @@ static AFFDEF(string_pprint)
   AFBEGIN;
 
   (void)visithash;
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(wc, ARC_AFF(c, arc_writec));
   if (NIL_P(AV(disp)))
     AFCALL(AV(wc), arc_mkchar(c, '\"'), AV(fp));
 
@@ -118,20 +162,114 @@ static AFFDEF(string_pprint)
 }
 AFFEND
 
-static unsigned long string_hash(arc *c, value v, arc_hs *s)
+/* Hash a string two runes at a time, in the manner of MurmurHash3's
+   64-bit block mixing.  Only the result goes into the state of the
+   table hash, so a string is hashed in a single pass however long it
+   is, and the result can be kept for the next time. */
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* The same hash is computed whichever way the runes are kept. */
+#define RUNES_HASH(h, p, len)					\
+  do {								\
+    uint64_t k;							\
+    int i;							\
+								\
+    h = 0x9e3779b97f4a7c15ULL ^ (uint64_t)(len);		\
+    for (i=0; i<(len); i+=2) {					\
+      k = (uint64_t)(p)[i];					\
+      if (i+1 < (len))						\
+	k |= (uint64_t)(p)[i+1] << 32;				\
+      k *= 0x87c37b91114253d5ULL;				\
+      k = ROTL64(k, 31);					\
+      k *= 0x4cf5ad432745937fULL;				\
+      h ^= k;							\
+      h = ROTL64(h, 27) * 5 + 0x52dce729;			\
+    }								\
+    h ^= h >> 33;						\
+    h *= 0xff51afd7ed558ccdULL;					\
+    h ^= h >> 33;						\
+    h *= 0xc4ceb9fe1a85ec53ULL;					\
+    h ^= h >> 33;						\
+    if (h == 0)							\
+      h = 1;							\
+  } while (0)
+
+/* The hash a string with the given runes would have */
+unsigned long __arc_strhash_runes(const Rune *p, int len)
+{
+  uint64_t h;
+
+  RUNES_HASH(h, p, len);
+  return((unsigned long)h);
+}
+
+static unsigned long strhash(value v)
+{
+  uint64_t h;
+
+  if (STRREP(v)->hash == 0) {
+    if (NARROWP(v))
+      RUNES_HASH(h, STRBYTES(v), STRREP(v)->len);
+    else
+      RUNES_HASH(h, STRRUNES(v), STRREP(v)->len);
+    STRREP(v)->hash = (unsigned long)h;
+  }
+  return(STRREP(v)->hash);
+}
+
+/* Whether the string str has exactly the given runes */
+int __arc_streq_runes(arc *c, value str, const Rune *p, int len)
 {
+  unsigned char *b;
   int i;
-  unsigned long len;
 
-  len = arc_strlen(c, v);
-  for (i=0; i<len; i++)
-    arc_hash_update(s, (unsigned long)arc_strindex(c, v, i));
-  return(len);
+  if (STRREP(str)->len != len)
+    return(0);
+  if (!NARROWP(str))
+    return(memcmp(STRRUNES(str), p, len*sizeof(Rune)) == 0);
+  b = STRBYTES(str);
+  for (i=0; i<len; i++) {
+    if (b[i] != p[i])
+      return(0);
+  }
+  return(1);
+}
+
+static unsigned long string_hash(arc *c, value v, arc_hs *s)
+{
+  arc_hash_update(s, strhash(v));
+  return(STRREP(v)->len);
 }
 
 static value string_iscmp(arc *c, value v1, value v2)
 {
-  return((arc_strcmp(c, v1, v2) == 0) ? CTRUE : CNIL);
+  int i, len = STRREP(v1)->len;
+
+  if (len != STRREP(v2)->len)
+    return(CNIL);
+  /* strings that have been hashed can often be told apart that way */
+  if (STRREP(v1)->hash != 0 && STRREP(v2)->hash != 0
+      && STRREP(v1)->hash != STRREP(v2)->hash)
+    return(CNIL);
+  if (NARROWP(v1) && NARROWP(v2))
+    return((memcmp(STRBYTES(v1), STRBYTES(v2), len) == 0) ? CTRUE : CNIL);
+  if (!NARROWP(v1) && !NARROWP(v2))
+    return((memcmp(STRRUNES(v1), STRRUNES(v2),
+		   len*sizeof(Rune)) == 0) ? CTRUE : CNIL);
+  for (i=0; i<len; i++) {
+    if (arc_strindex(c, v1, i) != arc_strindex(c, v2, i))
+      return(CNIL);
+  }
+  return(CTRUE);
+}
+
+/* A widened string or a slice must keep the string holding its runes
+   alive */
+static void string_marker(arc *c, value v, int depth,
+			  void (*markfn)(arc *, value, int))
+{
+  if (!NIL_P(STRREP(v)->buf))
+    markfn(c, STRREP(v)->buf, depth);
 }
 
 /* A string can be applied to a fixnum value */
@@ -168,18 +306,99 @@ static int string_apply(arc *c, value thr, value str)
   return(TR_RC);
 }
 
-value arc_mkstringlen(arc *c, int length)
+/* Make a string of the given length and kind, all of whose runes are
+   zero.  Room is made for one rune more, which is left zero. */
+static value mkstr(arc *c, int length, int kind)
 {
   value str;
   string *strdata;
+  size_t size;
 
-
-  str = arc_mkobject(c, sizeof(string) + (length-1)*sizeof(Rune), T_STRING);
+  size = ((kind == STR_UCS4) ? sizeof(Rune) : 1) * (length + 1);
+  str = arc_mkobject(c, offsetof(string, str) + size, T_STRING);
   strdata = (string *)REP(str);
   strdata->len = length;
+  strdata->kind = kind;
+  strdata->hash = 0;
+  strdata->buf = CNIL;
+  strdata->ofs = 0;
+  strdata->shared = 0;
+  memset(&strdata->str, 0, size);
   return(str);
 }
 
+value arc_mkstringlen(arc *c, int length)
+{
+  return(mkstr(c, length, STR_ASCII));
+}
+
+/* Move the runes of a one-byte string into a UCS-4 string */
+static void widen(arc *c, value str)
+{
+  value wide;
+  Rune *r;
+  int i;
+
+  wide = mkstr(c, STRREP(str)->len, STR_UCS4);
+  r = STRREP(wide)->str.r;
+  for (i=0; i<STRREP(str)->len; i++)
+    r[i] = STRBYTES(str)[i];
+  __arc_wb(STRREP(str)->buf, wide);
+  STRREP(str)->buf = wide;
+  STRREP(str)->ofs = 0;
+  STRREP(str)->kind = STR_UCS4;
+}
+
+/* Give a string runes of its own before anything is put into it, if
+   the ones it has are shared with some slice. */
+static void unshare(arc *c, value str)
+{
+  value nbuf;
+
+  if (!STRREP(STRSTORE(str))->shared)
+    return;
+  nbuf = mkstr(c, STRREP(str)->len, STRREP(str)->kind);
+  if (NARROWP(str))
+    memcpy(STRREP(nbuf)->str.b, STRBYTES(str), STRREP(str)->len);
+  else
+    memcpy(STRREP(nbuf)->str.r, STRRUNES(str),
+	   STRREP(str)->len*sizeof(Rune));
+  __arc_wb(STRREP(str)->buf, nbuf);
+  STRREP(str)->buf = nbuf;
+  STRREP(str)->ofs = 0;
+}
+
+static int runekind(Rune r)
+{
+  if (r < 0x80)
+    return(STR_ASCII);
+  if (r < 0x100)
+    return(STR_LATIN1);
+  return(STR_UCS4);
+}
+
+#define MAXKIND(k1, k2) (((k1) > (k2)) ? (k1) : (k2))
+
+/* Copy n runes from src starting at index si into dst starting at di.
+   If dst is a one-byte string, so must src be. */
+static void strcopy(value dst, int di, value src, int si, int n)
+{
+  Rune *r;
+  int i;
+
+  if (NARROWP(dst)) {
+    memcpy(STRBYTES(dst) + di, STRBYTES(src) + si, n);
+    return;
+  }
+  r = STRRUNES(dst) + di;
+  if (!NARROWP(src)) {
+    memcpy(r, STRRUNES(src) + si, n*sizeof(Rune));
+    return;
+  }
+  for (i=0; i<n; i++)
+    r[i] = STRBYTES(src)[si + i];
+}
+
 AFFDEF(arc_newstring)
 {
   AARG(length);
@@ -197,14 +416,50 @@ AFFDEF(arc_newstring)
 }
 AFFEND
 
+AFFDEF(arc_substring)
+{
+  AARG(str, start);
+  AOARG(end);
+  int len, sidx, eidx;
+  AFBEGIN;
+  if (TYPE(AV(str)) != T_STRING) {
+    arc_err_cstrfmt(c, "substring expects a string argument");
+    ARETURN(CNIL);
+  }
+  len = arc_strlen(c, AV(str));
+  if (!BOUND_P(AV(end)) || NIL_P(AV(end)))
+    WV(end, INT2FIX(len));
+  if (TYPE(AV(start)) != T_FIXNUM || TYPE(AV(end)) != T_FIXNUM) {
+    arc_err_cstrfmt(c, "substring expects fixnum indices");
+    ARETURN(CNIL);
+  }
+  sidx = FIX2INT(AV(start));
+  eidx = FIX2INT(AV(end));
+  if (sidx < 0 || eidx > len || sidx > eidx) {
+    arc_err_cstrfmt(c, "substring indices [%d, %d) out of range [0, %d]",
+		    sidx, eidx, len);
+    ARETURN(CNIL);
+  }
+  ARETURN(arc_substr(c, AV(str), sidx, eidx));
+  AFEND;
+}
+AFFEND
+
 /* Make string from UCS-4 Runes */
 value arc_mkstring(arc *c, const Rune *data, int length)
 {
   value str;
-
-  str = arc_mkstringlen(c, length);
-  memcpy(((string *)REP(str))->str, data, length*sizeof(Rune));
-  STRREP(str)->len = length;
+  int i, kind = STR_ASCII;
+
+  for (i=0; i<length; i++)
+    kind = MAXKIND(kind, runekind(data[i]));
+  str = mkstr(c, length, kind);
+  if (kind == STR_UCS4) {
+    memcpy(STRRUNES(str), data, length*sizeof(Rune));
+    return(str);
+  }
+  for (i=0; i<length; i++)
+    STRBYTES(str)[i] = data[i];
   return(str);
 }
 
@@ -212,19 +467,35 @@ value arc_mkstring(arc *c, const Rune *data, int length)
 value arc_mkstringc(arc *c, const char *s)
 {
   value str;
-  int len, ch;
-  Rune *runeptr;
-
-  len = utflen(s);
-  str = arc_mkstringlen(c, len);
-  runeptr = ((string *)REP(str))->str;
-  for (;;) {
-    ch = *(unsigned char *)s;
-    if (ch == 0)
-      break;
-    s += chartorune(runeptr++, s);
-  }
-  STRREP(str)->len = len;
+  int len, kind, i;
+  const unsigned char *p;
+  Rune r;
+
+  /* ASCII is copied as it is */
+  for (p = (const unsigned char *)s; *p != 0 && *p < 0x80; p++)
+    ;
+  if (*p == 0) {
+    len = p - (const unsigned char *)s;
+    str = mkstr(c, len, STR_ASCII);
+    memcpy(STRBYTES(str), s, len);
+    return(str);
+  }
+
+  kind = STR_ASCII;
+  len = 0;
+  for (p = (const unsigned char *)s; *p != 0; len++) {
+    p += chartorune(&r, (const char *)p);
+    kind = MAXKIND(kind, runekind(r));
+  }
+  str = mkstr(c, len, kind);
+  p = (const unsigned char *)s;
+  for (i=0; i<len; i++) {
+    p += chartorune(&r, (const char *)p);
+    if (kind == STR_UCS4)
+      STRRUNES(str)[i] = r;
+    else
+      STRBYTES(str)[i] = r;
+  }
   return(str);
 }
 
@@ -236,7 +507,7 @@ static AFFDEF(char_pprint)
   AFBEGIN;
   (void)visithash;
 
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
+  WV(wc, ARC_AFF(c, arc_writec));
   /* in disp mode, we just print out the character as is */
   if (AV(disp) == CTRUE) {
     AFCALL(AV(wc), AV(sexpr), AV(fp));
@@ -248,9 +519,9 @@ static AFFDEF(char_pprint)
   if (BOUND_P(WV(escape, arc_hash_lookup(c, VINDEX(c->builtins, BI_charesc),
 					 AV(sexpr))))) {
     /* escape character */
-    AFCALL(arc_mkaff(c, string_pprint, CNIL), arc_mkstringc(c, "#\\"), CTRUE,
+    AFCALL(ARC_AFF(c, string_pprint), arc_mkstringc(c, "#\\"), CTRUE,
 	   AV(fp));
-    AFTCALL(arc_mkaff(c, string_pprint, CNIL), AV(escape), CTRUE, AV(fp));
+    AFTCALL(ARC_AFF(c, string_pprint), AV(escape), CTRUE, AV(fp));
   }
 
   /* no escape character */
@@ -300,30 +571,46 @@ Rune arc_strindex(arc *c, value v, int index)
 {
   if (index > STRREP(v)->len)
     return(Runeerror);
-  return(STRREP(v)->str[index]);
+  /* a slice has no terminating zero rune of its own */
+  if (index == STRREP(v)->len)
+    return(0);
+  if (NARROWP(v))
+    return(STRBYTES(v)[index]);
+  return(STRRUNES(v)[index]);
 }
 
 Rune arc_strsetindex(arc *c, value v, int index, Rune ch)
 {
-  STRREP(v)->str[index] = ch;
+  int kind = runekind(ch);
+
+  if (kind == STR_UCS4 && NARROWP(v))
+    widen(c, v);
+  else
+    unshare(c, v);
+  if (NARROWP(v)) {
+    STRBYTES(v)[index] = ch;
+    STRREP(v)->kind = MAXKIND(STRREP(v)->kind, kind);
+  } else {
+    STRRUNES(v)[index] = ch;
+  }
+  STRREP(v)->hash = 0;
   return(ch);
 }
 
 /* XXX - this is extremely inefficient! */
 value arc_strcatc(arc *c, value v1, Rune ch)
 {
-  Rune *runeptr;
   value newstr;
+  int len = STRREP(v1)->len;
 
-  newstr = arc_mkstringlen(c, STRREP(v1)->len + 1);
-  runeptr = STRREP(newstr)->str;
-  memcpy(runeptr, STRREP(v1)->str, STRREP(v1)->len*sizeof(Rune));
-  runeptr += STRREP(v1)->len;
-  *runeptr = ch;
+  newstr = mkstr(c, len + 1, MAXKIND(STRREP(v1)->kind, runekind(ch)));
+  strcopy(newstr, 0, v1, 0, len);
+  arc_strsetindex(c, newstr, len, ch);
   return(newstr);
 }
 
-value arc_substr(arc *c, value s, int sidx, int eidx)
+/* Copy the runes of s from sidx up to eidx into a new string */
+value arc_substrcpy(arc *c, value s, int sidx, int eidx)
 {
   int len, nlen;
   value ns;
@@ -332,23 +619,51 @@ value arc_substr(arc *c, value s, int sidx, int eidx)
   if (eidx > len)
     eidx = len;
   nlen = eidx - sidx;
-  ns = arc_mkstringlen(c, nlen);
-  memcpy(STRREP(ns)->str, STRREP(s)->str + sidx, nlen*sizeof(Rune));
+  ns = mkstr(c, nlen, STRREP(s)->kind);
+  strcopy(ns, 0, s, sidx, nlen);
+  return(ns);
+}
+
+/* Take the substring of s from sidx up to eidx.  Unless it is very
+   short, or a small part of the runes of s, this is a slice of s,
+   which shares the runes of s rather than copying them.  A slice
+   keeps all the runes of s alive for as long as it is itself, so a
+   string that will be changed over and over, like a buffer, is better
+   off with arc_substrcpy. */
+value arc_substr(arc *c, value s, int sidx, int eidx)
+{
+  int len, nlen;
+  value ns, store;
+  string *strdata;
+
+  len = arc_strlen(c, s);
+  if (eidx > len)
+    eidx = len;
+  nlen = eidx - sidx;
+  store = STRSTORE(s);
+  if (nlen < SLICE_MIN || nlen*SLICE_RATIO < STRREP(store)->len)
+    return(arc_substrcpy(c, s, sidx, eidx));
+  ns = arc_mkobject(c, offsetof(string, str), T_STRING);
+  strdata = (string *)REP(ns);
+  strdata->len = nlen;
+  strdata->kind = STRREP(s)->kind;
+  strdata->hash = 0;
+  strdata->buf = store;
+  strdata->ofs = STRREP(s)->ofs + sidx;
+  strdata->shared = 0;
+  STRREP(store)->shared = 1;
   return(ns);
 }
 
 value arc_strcat(arc *c, value v1, value v2)
 {
   value newstr;
-  int len;
-  Rune *runeptr;
-
-  len = STRREP(v1)->len + STRREP(v2)->len;
-  newstr = arc_mkstringlen(c, len);
-  runeptr = STRREP(newstr)->str;
-  memcpy(runeptr, STRREP(v1)->str, STRREP(v1)->len*sizeof(Rune));
-  runeptr += STRREP(v1)->len;
-  memcpy(runeptr, STRREP(v2)->str, STRREP(v2)->len*sizeof(Rune));
+  int len1 = STRREP(v1)->len, len2 = STRREP(v2)->len;
+
+  newstr = mkstr(c, len1 + len2, MAXKIND(STRREP(v1)->kind,
+					 STRREP(v2)->kind));
+  strcopy(newstr, 0, v1, 0, len1);
+  strcopy(newstr, len1, v2, 0, len2);
   return(newstr);
 }
 
@@ -367,6 +682,13 @@ int arc_strcmp(arc *c, value v1, value v2)
   len1 = arc_strlen(c, v1);
   len2 = arc_strlen(c, v2);
   len = (len1 > len2) ? len2 : len1;
+  /* Latin-1 bytes are ordered just as their code points are */
+  if (NARROWP(v1) && NARROWP(v2)) {
+    i = memcmp(STRBYTES(v1), STRBYTES(v2), len);
+    if (i != 0)
+      return((i > 0) ? 1 : -1);
+    len = 0;
+  }
   for (i=0; i<len; i++) {
     int r1, r2;
     r1 = arc_strindex(c, v1, i);
@@ -389,7 +711,14 @@ value arc_strutflen(arc *c, value str)
   char buf[UTFmax];
   Rune r;
 
+  if (STRREP(str)->kind == STR_ASCII)
+    return(INT2FIX(STRREP(str)->len));
   count = 0;
+  if (NARROWP(str)) {
+    for (i=0; i<STRREP(str)->len; i++)
+      count += (STRBYTES(str)[i] < 0x80) ? 1 : 2;
+    return(INT2FIX(count));
+  }
   for (i=0; i<arc_strlen(c, str); i++) {
     r = arc_strindex(c, str, i);
     count += runetochar(buf, &r);
@@ -417,6 +746,11 @@ void arc_str2cstr(arc *c, value str, char *ptr)
   char *p;
   Rune r;
 
+  if (STRREP(str)->kind == STR_ASCII) {
+    memcpy(ptr, STRBYTES(str), STRREP(str)->len);
+    ptr[STRREP(str)->len] = 0;
+    return;
+  }
   p = ptr;
   for (i=0; i<arc_strlen(c, str); i++) {
     r = arc_strindex(c, str, i);
@@ -640,7 +974,7 @@ static AFFDEF(string_xcoerce)
     value num;
 
     num = coerce_num(c, AV(obj), AV(arg));
-    AFTCALL(arc_mkaff(c, arc_coerce, CNIL), num, ARC_BUILTIN(c, S_INT));
+    AFTCALL(ARC_AFF(c, arc_coerce), num, ARC_BUILTIN(c, S_INT));
   }
 
   arc_err_cstrfmt(c, "cannot coerce");
@@ -661,7 +995,7 @@ typefn_t __arc_char_typefn__ = {
 };
 
 typefn_t __arc_string_typefn__ = {
-  __arc_null_marker,
+  string_marker,
   __arc_null_sweeper,
   string_pprint,
   string_hash,
@@ -20,35 +20,70 @@
 #include "builtins.h"
 #include "compiler.h"
 #include "hash.h"
+#include "utf.h"
 
-value arc_intern(arc *c, value name)
+/* convert a fixnum symbol ID in the symbol table into its symbol */
+static value id2sym(arc *c, value symid)
 {
-  value symid, symval;
-  int symintid;
+  value symval;
+
+  symval = ID2SYM(FIX2INT(symid));
+  /* do not allow nil or t to have a symbol value */
+  if (symval == ARC_BUILTIN(c, S_NIL))
+    symval = CNIL;
+  /*    else if (symval == ARC_BUILTIN(c, S_T)) 
+	symval = CTRUE; */
+  return(symval);
+}
 
-  if ((symid = arc_hash_lookup(c, c->symtable, name)) != CUNBOUND) {
-    /* convert the fixnum ID into the symbol value */
-    symval = ID2SYM(FIX2INT(symid));
-    /* do not allow nil or t to have a symbol value */
-    if (symval == ARC_BUILTIN(c, S_NIL))
-      symval = CNIL;
-    /*    else if (symval == ARC_BUILTIN(c, S_T)) 
-	  symval = CTRUE; */
-    return(symval);
-  }
+/* Make a new symbol named name, which must not already be interned */
+static value newsym(arc *c, value name)
+{
+  value symid;
+  int symintid;
 
   symintid = ++c->lastsym;
   symid = INT2FIX(symintid);
-  symval = ID2SYM(symintid);
   arc_hash_insert(c, c->symtable, name, symid);
   arc_hash_insert(c, c->rsymtable, symid, name);
-  return(symval);
+  return(ID2SYM(symintid));
 }
 
+value arc_intern(arc *c, value name)
+{
+  value symid;
+
+  if ((symid = arc_hash_lookup(c, c->symtable, name)) != CUNBOUND)
+    return(id2sym(c, symid));
+  return(newsym(c, name));
+}
+
+/* Intern a symbol given the runes of its name.  A string for the name
+   is only made if the symbol does not exist yet. */
+value arc_intern_runes(arc *c, const Rune *name, int len)
+{
+  value symid;
+
+  symid = arc_hash_lookup_runes(c, c->symtable, name, len);
+  if (symid != CUNBOUND)
+    return(id2sym(c, symid));
+  return(newsym(c, arc_mkstring(c, name, len)));
+}
+
+#define INTERN_BUFSIZE 256
+
 value arc_intern_cstr(arc *c, const char *name)
 {
-  value symstr = arc_mkstringc(c, name);
-  return(arc_intern(c, symstr));
+  Rune buf[INTERN_BUFSIZE];
+  const char *p = name;
+  int len = 0;
+
+  while (*p != '\0' && len < INTERN_BUFSIZE)
+    p += chartorune(&buf[len++], p);
+  /* names too long for the buffer are rare enough */
+  if (*p != '\0')
+    return(arc_intern(c, arc_mkstringc(c, name)));
+  return(arc_intern_runes(c, buf, len));
 }
 
 value arc_sym2name(arc *c, value sym)
@@ -85,12 +120,13 @@ static char *syms[] = { "fn", "_", "quote", "quasiquote", "unquote",
 			"sig", "stdin-fd", "stdout-fd", "stderr-fd",
 			"mac", "if", "assign", "o", ".", "car", "cdr",
 			"scar", "scdr", "is", "+", "-", "*", "/",
-			"and", "apply", "chan", "AF_UNIX", "AF_INET",
-			"AF_INET6", "SOCK_STREAM", "SOCK_DGRAM",
+			"and", "apply", "chan", "omap", "AF_UNIX",
+			"AF_INET", "AF_INET6", "SOCK_STREAM", "SOCK_DGRAM",
 			"SOCK_RAW", "binary", "text", "append",
 			"atstrings", "lndata", "dlist", "eval",
 			"SEEK_SET", "SEEK_CUR", "SEEK_END", "loadpath*",
-			"=~" };
+			"=~", "<", ">", "optimize",
+			"inline-globals", "or", "pure-macros" };
 
 static struct {
   char *str;
@@ -133,7 +169,7 @@ static AFFDEF(symbol_pprint)
   AFBEGIN;
   (void)visithash;
   (void)disp;
-  AFTCALL(arc_mkaff(c, arc_disp, CNIL), arc_sym2name(c, AV(sexpr)), AV(fp));
+  AFTCALL(ARC_AFF(c, arc_disp), arc_sym2name(c, AV(sexpr)), AV(fp));
   AFEND;
 }
 AFFEND
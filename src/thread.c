@@ -59,7 +59,7 @@ static AFFDEF(thread_pprint)
   value outstr;
   AFBEGIN;
   (void)disp;
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
   len = snprintf(NULL, 0, "#<thread: %d>", TTID(AV(sexpr)));
   coutstr = (char *)alloca(sizeof(char)*(len+2));
   snprintf(coutstr, len+1, "#<thread: %d>", TTID(AV(sexpr)));
@@ -69,6 +69,8 @@ static AFFDEF(thread_pprint)
 }
 AFFEND
 
+static value stkchunk_get(arc *c, int size, int minsize);
+
 static void thread_marker(arc *c, value thr, int depth,
 			  void (*mark)(struct arc *, value, int))
 {
@@ -82,7 +84,7 @@ static void thread_marker(arc *c, value thr, int depth,
      portions of the stack only, and the stack itself has to be marked
      non-recursively thereafter.
   */
-  for (p = TSP(thr)+1; p < TSTOP(thr); p++)
+  for (p = TSP(thr)+1; p <= TSTOP(thr); p++)
     mark(c, *p, depth);
   mark(c, TSTACK(thr), -1); /* negative depth means mark only the object */
 
@@ -104,9 +106,9 @@ value arc_mkthread(arc *c)
   ((struct vmthread_t *)REP(thr))->envr = CNIL;
   ((struct vmthread_t *)REP(thr))->valr = CNIL;
   ((struct vmthread_t *)REP(thr))->conr = CNIL;
-  TSTACK(thr) = arc_mkvector(c, c->stksize);
-  TSBASE(thr) = &XVINDEX(TSTACK(thr), 0);
-  TSFN(thr) = TSP(thr) = TSTOP(thr) = &XVINDEX(TSTACK(thr), VECLEN(TSTACK(thr))-1);
+  TSTACK(thr) = CNIL;
+  __arc_stackswitch(thr, stkchunk_get(c, TSTKINIT, 1));
+  TSFN(thr) = TSP(thr) = TSTOP(thr);
   TIP(thr).ipptr = NULL;
   TARGC(thr) = 0;
 
@@ -116,15 +118,43 @@ value arc_mkthread(arc *c)
   TTICKS(thr) = 0LL;
   TWAKEUP(thr) = 0LL;
   TWAITFD(thr) = CNIL;
-  TCM(thr) = arc_mkhash(c, ARC_HASHBITS);
+  TCM(thr) = CNIL;
   TEXH(thr) = CNIL;
   TACELL(thr) = 0;
-  TRVCH(thr) = arc_mkchan(c);
-  TCH(thr) = cons(c, INT2FIX(0xdead), CNIL);
-  TBCH(thr) = TCH(thr);
+  /* unbound until someone waits for the thread to finish */
+  TRVCH(thr) = CUNBOUND;
+  TCH(thr) = TBCH(thr) = CNIL;
   return(thr);
 }
 
+value __arc_thread_cmarks(arc *c, value thr)
+{
+  if (NIL_P(TCM(thr))) {
+    __arc_wb(TCM(thr), CNIL);
+    TCM(thr) = arc_mkhash(c, ARC_HASHBITS);
+  }
+  return(TCM(thr));
+}
+
+/* Only valid while the thread has not yet terminated.  Afterwards,
+   TRVCH is the value the thread returned. */
+value __arc_thread_rvchan(arc *c, value thr)
+{
+  if (TRVCH(thr) == CUNBOUND) {
+    __arc_wb(TRVCH(thr), CNIL);
+    TRVCH(thr) = arc_mkchan(c);
+  }
+  return(TRVCH(thr));
+}
+
+value __arc_thread_here(arc *c, value thr)
+{
+  if (NIL_P(TCH(thr))) {
+    TCH(thr) = TBCH(thr) = cons(c, INT2FIX(0xdead), CNIL);
+  }
+  return(TCH(thr));
+}
+
 value arc_thr_valr(arc *c, value thr)
 {
   return(TVALR(thr));
@@ -162,6 +192,8 @@ value arc_cmark(arc *c, value key)
   value cm, val;
 
   cm = TCM(c->curthread);
+  if (NIL_P(cm))
+    return(CNIL);
   val = arc_hash_lookup(c, cm, key);
   if (!BOUND_P(val))
     return(CNIL);
@@ -174,7 +206,7 @@ value arc_scmark(arc *c, value key, value val)
 {
   value cm, bind;
 
-  cm = TCM(c->curthread);
+  cm = __arc_thread_cmarks(c, c->curthread);
   bind = arc_hash_lookup(c, cm, key);
   if (!BOUND_P(bind))
     bind = CNIL;
@@ -188,6 +220,8 @@ value arc_ccmark(arc *c, value key)
   value cm, bind, val;
 
   cm = TCM(c->curthread);
+  if (NIL_P(cm))
+    return(CNIL);
   bind = arc_hash_lookup(c, cm, key);
   if (!BOUND_P(bind))
     return(CNIL);
@@ -370,6 +404,7 @@ void arc_thread_dispatch(arc *c)
 	  __arc_send_rvchan(c, TRVCH(thr), TVALR(thr));
 	__arc_wb(TRVCH(thr), TVALR(thr));
 	TRVCH(thr) = TVALR(thr);
+	__arc_stackrelease(c, thr);
 	/* unlink the thread from the queue */
 	if (prev == CNIL) {
 	  __arc_wb(c->vmthreads, cdr(vmqueue));
@@ -512,7 +547,7 @@ AFFDEF(arc_sleep)
   value timetowake;
   AFBEGIN;
 
-  AFCALL(arc_mkaff(c, arc_coerce, CNIL), AV(sleeptime),
+  AFCALL(ARC_AFF(c, arc_coerce), AV(sleeptime),
 	 ARC_BUILTIN(c, S_FLONUM));
   timetowake = AFCRV;
   if (REPFLO(timetowake) < 0.0) {
@@ -556,7 +591,7 @@ AFFDEF(arc_kill_thread)
     TACELL(AV(tthr)) = 0;
     WV(achan, arc_gbind_cstr(c, "__achan__"));
     if (BOUND_P(AV(achan))) {
-      AFCALL(arc_mkaff(c, arc_recv_channel, CNIL), AV(achan));
+      AFCALL(ARC_AFF(c, arc_recv_channel), AV(achan));
     }
   }
   ARETURN(AV(tthr));
@@ -584,7 +619,7 @@ value arc_break_thread(arc *c, value tthr)
   TSTATE(tthr) = Tready;
 
   /* make the thread resume at a call to arc_err */
-  SVALR(tthr, arc_mkaff(c, arc_err, CNIL));
+  SVALR(tthr, ARC_AFF(c, arc_err));
   CPUSH(tthr, arc_mkstringc(c, "user break"));
   SFUNR(tthr, TVALR(tthr));
   tfn = __arc_typefn(c, TVALR(tthr));
@@ -596,8 +631,9 @@ AFFDEF(arc_join_thread)
 {
   AARG(jthr);
   AFBEGIN;
-  while (TYPE(TRVCH(AV(jthr))) == T_CHAN) {
-    AFCALL(arc_mkaff(c, __arc_recv_rvchan, CNIL), TRVCH(AV(jthr)));
+  while (TRVCH(AV(jthr)) == CUNBOUND || TYPE(TRVCH(AV(jthr))) == T_CHAN) {
+    AFCALL(ARC_AFF(c, __arc_recv_rvchan),
+	   __arc_thread_rvchan(c, AV(jthr)));
   }
   ARETURN(TRVCH(AV(jthr)));
   AFEND;
@@ -611,11 +647,15 @@ value arc_current_thread(arc *c)
 
 void arc_init_threads(arc *c)
 {
+  int i;
+
   c->vmthreads = CNIL;
   c->vmthrtail = CNIL;
   c->curthread = CNIL;
   c->tid_nonce = 0;
   c->stksize = TSTKSIZE;
+  for (i=0; i<ARC_STKSIZES; i++)
+    c->nstkpool[i] = 0;
   c->quantum = DEFAULT_QUANTUM;
 }
 
@@ -630,59 +670,163 @@ typefn_t __arc_thread_typefn__ = {
   NULL
 };
 
-static value vector_doubledown(arc *c, value curr)
+/* Thread stacks are made up of fixed-size chunks.  Only one chunk, the
+   current one, is in use by a thread at any time.  When the current
+   chunk fills up, the values that belong to the function presently
+   executing are copied to a fresh chunk, and the old chunk is sealed
+   inside a stack segment boundary continuation (see vmengine.h) which
+   becomes the new value of the continuation register.  When a function
+   returns through that continuation, the old chunk becomes current
+   once again, and the chunk that was abandoned goes back into a per-arc
+   pool of free chunks of its size, so recursion that goes back and forth across
+   the boundary of a chunk does not have to allocate anything.
+
+   A chunk that is in use by a thread only has the used portion of the
+   stack marked by the garbage collector (see thread_marker above), and
+   free chunks in the pool are never marked at all, so neither have to
+   be cleared.  A chunk that is sealed in a stack segment boundary has
+   all of its contents marked, so anything in it that is not part of
+   the continuations that remain there is cleared when it is sealed.
+
+   A new thread starts out with a small chunk of TSTKINIT values, and
+   each chunk it needs after that is twice as big as the last, up to
+   the normal chunk size.  Most threads never need more than a few
+   hundred values of stack.  Free chunks are pooled by size, so a new
+   thread gets a small chunk from the pool when there is one, rather
+   than a full-sized one or a newly made one.
+
+   Return the pool for chunks of size values, or -1 if they are not
+   pooled. */
+static int stkpool_index(int size)
 {
-  value new;
-  int currlen, i;
+  int i;
+
+  for (i=0; i<ARC_STKSIZES; i++) {
+    if (size == 1 << i)
+      return(i);
+  }
+  return(-1);
+}
 
-  currlen = VECLEN(curr);
-  new = arc_mkvector(c, currlen*2);
-  for (i=0; i<currlen; i++)
-    SVINDEX(new, currlen+i, XVINDEX(curr, i));
-  return(new);
+/* Get a chunk of at least minsize values, preferably size values. */
+static value stkchunk_get(arc *c, int size, int minsize)
+{
+  value chunk;
+  int i;
+
+  while (size < minsize)
+    size *= 2;
+  i = stkpool_index(size);
+  if (i >= 0 && c->nstkpool[i] > 0) {
+    chunk = c->stkpool[i][--c->nstkpool[i]];
+    c->stkpool[i][c->nstkpool[i]] = CNIL;
+    return(chunk);
+  }
+  return(arc_mkvector(c, size));
 }
 
-static void grow_stack(arc *c, value thr)
+static void stkchunk_put(arc *c, value chunk)
 {
-  value old_stack;
-  int tsfnofs;
+  int i;
+
+  /* Chunks too big to be pooled are left for the garbage collector */
+  if (NIL_P(chunk) || (i = stkpool_index(VECLEN(chunk))) < 0
+      || c->nstkpool[i] >= ARC_STKPOOL)
+    return;
+  c->stkpool[i][c->nstkpool[i]++] = chunk;
+}
 
-  tsfnofs = TSTOP(thr) - TSFN(thr);
-  old_stack = TSTACK(thr);
-  TSTACK(thr) = vector_doubledown(c, old_stack);
-  TSBASE(thr) = &XVINDEX(TSTACK(thr), 0);
-  TSTOP(thr) = &XVINDEX(TSTACK(thr), VECLEN(TSTACK(thr))-1);
-  TSFN(thr) = TSTOP(thr) - tsfnofs;
+/* Make chunk the current stack chunk of thr.  The stack pointers are
+   not changed. */
+void __arc_stackswitch(value thr, value chunk)
+{
+  __arc_wb(TSTACK(thr), chunk);
+  TSTACK(thr) = chunk;
+  if (NIL_P(chunk)) {
+    TSBASE(thr) = TSTOP(thr) = NULL;
+    return;
+  }
+  TSBASE(thr) = &XVINDEX(chunk, 0);
+  TSTOP(thr) = &XVINDEX(chunk, VECLEN(chunk)-1);
 }
 
-inline void __arc_stackcheck(value thr)
+/* Make sure there is room for at least n more values on the stack of
+   thr, moving to a new stack chunk if there is not. */
+void __arc_stackreserve(arc *c, value thr, int n)
 {
-  arc *c;
-  value cont, env;
-  int mvcount;
+  value oldchunk, chunk, *lim, *top, *p;
+  int live, size;
 
-  assert(TSP(thr) >= TSBASE(thr));
-  /* stack is fine, nothing to do */
-  if (TSP(thr) > TSBASE(thr))
+  if (TSP(thr) - TSBASE(thr) >= n)
     return;
-  c = ((struct vmthread_t *)REP(thr))->c;
-  /* If the stack fills up, first thing we try to do is move all
-     continuations and environments from the stack to the heap.
-     If this still doesn't free up enough stack space, we have
-     to grow the stack. */
-  cont = __arc_cont2heap(c, thr, TCONR(thr));
-  SCONR(thr, cont);
-  env = __arc_env2heap(c, thr, TENVR(thr));
-  SENVR(thr, env);
-  /* Now, everything below TSFN is continuations and environments that
-     have been moved to the heap.  We ought to be able to safely move
-     everything from TSFN to TSP such that TSFN is TSTOP. */
-  mvcount = TSFN(thr) - TSP(thr);
-  memmove(TSTOP(thr) - mvcount, TSP(thr), mvcount*sizeof(value));
-  TSP(thr) = TSTOP(thr) - mvcount;
-  /* XXX - if initial stack size is set too low, or under certain
-     circumstances doing this may be insufficient to free up enough
-     stack space.  May be necessary to resize the stack.  */
-  if (TSP(thr) <= TSBASE(thr));
-  grow_stack(c, thr);
+
+  /* The environment of the current function has to be moved to the
+     heap, as stack environments can only refer to the current chunk */
+  if (ENV_P(TENVR(thr)))
+    SENVR(thr, __arc_env2heap(c, thr, TENVR(thr)));
+
+  /* The values that go with the current function are everything
+     pushed since TSFN, or only those pushed since the last
+     continuation was made, if it was made after that. */
+  lim = TSFN(thr);
+  if (FIXNUM_P(TCONR(thr)) && TSTOP(thr) - FIX2INT(TCONR(thr)) < lim)
+    lim = TSTOP(thr) - FIX2INT(TCONR(thr));
+  live = (lim > TSP(thr)) ? lim - TSP(thr) : 0;
+
+  oldchunk = TSTACK(thr);
+  size = c->stksize;
+  if (!NIL_P(oldchunk) && VECLEN(oldchunk)*2 < size)
+    size = VECLEN(oldchunk)*2;
+  chunk = stkchunk_get(c, size, live + n + 1);
+  top = &XVINDEX(chunk, VECLEN(chunk)-1);
+  if (live > 0)
+    memcpy(top - live + 1, TSP(thr) + 1, live*sizeof(value));
+
+  if (FIXNUM_P(TCONR(thr))) {
+    /* There are continuations on the old chunk, seal it */
+    if (lim < TSP(thr))
+      lim = TSP(thr);
+    for (p = TSBASE(thr); p <= lim; p++)
+      *p = CNIL;
+    SCONR(thr, __arc_mkcontseg(c, oldchunk, TCONR(thr)));
+  } else {
+    /* Nothing on the old chunk is reachable any longer */
+    stkchunk_put(c, oldchunk);
+  }
+  __arc_stackswitch(thr, chunk);
+  TSFN(thr) = TSTOP(thr);
+  TSP(thr) = TSTOP(thr) - live;
+}
+
+void __arc_stackcheck(value thr)
+{
+  __arc_stackreserve(((struct vmthread_t *)REP(thr))->c, thr, 1);
+}
+
+/* Return through the stack segment boundary seg.  The chunk sealed in
+   it becomes the current chunk again, and the current chunk is
+   released.  Returns the continuation on the restored chunk that is
+   to be restored next. */
+value __arc_stackunderflow(arc *c, value thr, value seg)
+{
+  /* A segment that has been returned through before refers to the
+     current chunk */
+  if (NIL_P(CONT_STK(seg)))
+    return(CONT_CONT(seg));
+  stkchunk_put(c, TSTACK(thr));
+  __arc_stackswitch(thr, CONT_STK(seg));
+  /* The chunk is in use once again, and must no longer have all of it
+     marked through the segment. */
+  __arc_wb(CONT_STK(seg), CNIL);
+  CONT_STK(seg) = CNIL;
+  return(CONT_CONT(seg));
+}
+
+/* Release the stack of a thread that has finished running.  Should
+   it ever be used again, it will get a new chunk on the first push. */
+void __arc_stackrelease(arc *c, value thr)
+{
+  stkchunk_put(c, TSTACK(thr));
+  __arc_stackswitch(thr, CNIL);
+  TSP(thr) = TSFN(thr) = NULL;
 }
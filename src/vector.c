@@ -42,11 +42,11 @@ static AFFDEF(vector_pprint)
 
   if (!NIL_P(__arc_visit(c, AV(sexpr), AV(visithash)))) {
     /* already visited at some point. Do not recurse further */
-    AFTCALL(arc_mkaff(c, __arc_disp_write, CNIL), arc_mkstringc(c, "(...)"),
+    AFTCALL(ARC_AFF(c, __arc_disp_write), arc_mkstringc(c, "(...)"),
 	   CTRUE, AV(fp), AV(visithash));
   }
-  WV(wc, arc_mkaff(c, arc_writec, CNIL));
-  WV(dw, arc_mkaff(c, __arc_disp_write, CNIL));
+  WV(wc, ARC_AFF(c, arc_writec));
+  WV(dw, ARC_AFF(c, __arc_disp_write));
   AFCALL(AV(wc), arc_mkchar(c, '#'), AV(fp));
   AFCALL(AV(wc), arc_mkchar(c, '('), AV(fp));
 
@@ -96,7 +96,7 @@ AFFDEF(__arc_vector_isocmp)
   if (VECLEN(AV(v1)) != VECLEN(AV(v2)))
     ARETURN(CNIL);
   /* Recursive comparisons */
-  WV(iso2, arc_mkaff(c, arc_iso2, CNIL));
+  WV(iso2, ARC_AFF(c, arc_iso2));
   for (WV(i, INT2FIX(0)); FIX2INT(AV(i))<VECLEN(AV(v1)); FIXINC(i)) {
     AFCALL(AV(iso2), VINDEX(AV(v1), AV(i)), VINDEX(AV(v2), AV(i)),
 	   AV(vh1), AV(vh2));
@@ -155,7 +155,7 @@ AFFDEF(vector_xhash)
 
   /* Visit each element */
   for (WV(i, INT2FIX(0)); FIX2INT(AV(i))<VECLEN(AV(obj)); FIXINC(i)) {
-    AFCALL(arc_mkaff(c, arc_xhash_increment, CNIL),
+    AFCALL(ARC_AFF(c, arc_xhash_increment),
 	   VINDEX(AV(obj), FIX2INT(AV(i))), AV(ehs),
 	   AV(visithash));
     WV(length, __arc_add2(c, AV(length), AFCRV));
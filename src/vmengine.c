@@ -19,6 +19,7 @@
 #include "arcueid.h"
 #include "vmengine.h"
 #include "arith.h"
+#include "builtins.h"
 
 #ifdef HAVE_ALLOCA_H
 # include <alloca.h>
@@ -139,7 +140,7 @@ int __arc_vmtrace = 0;
 static void printobj(arc *c, value obj)
 {
   CPUSH(c->tracethread, obj);
-  SVALR(c->tracethread, arc_mkaff(c, arc_write, CNIL));
+  SVALR(c->tracethread, ARC_AFF(c, arc_write));
   TARGC(c->tracethread) = 1;
   __arc_thr_trampoline(c, c->tracethread, TR_FNAPP);
   TSP(c->tracethread) = TSTOP(c->tracethread);
@@ -148,7 +149,7 @@ static void printobj(arc *c, value obj)
 static void printstr(arc *c, value obj)
 {
   CPUSH(c->tracethread, obj);
-  SVALR(c->tracethread, arc_mkaff(c, arc_disp, CNIL));
+  SVALR(c->tracethread, ARC_AFF(c, arc_disp));
   TARGC(c->tracethread) = 1;
   __arc_thr_trampoline(c, c->tracethread, TR_FNAPP);
   TSP(c->tracethread) = TSTOP(c->tracethread);
@@ -194,6 +195,44 @@ void __arc_init_tracing(arc *c)
 
 #endif
 
+/* Push the arguments kept by an envl instruction for the rest
+   parameter at index idx of the environment at depth onto the stack,
+   returning how many there are.  A chunk change while pushing them
+   may move the environment to the heap, so it is looked up anew for
+   each. */
+static int spread_rest(arc *c, value thr, int depth, int idx)
+{
+  int n, i;
+
+  n = FIX2INT(__arc_getenv(c, thr, depth, idx));
+  for (i=1; i<=n; i++)
+    CPUSH(thr, __arc_getenv(c, thr, depth, idx + i));
+  return(n);
+}
+
+/* Once apply has been redefined, an iapplyr must call what apply now
+   is instead, with the function applied, the nargs arguments pushed
+   and the rest parameter made into a list, returning how many
+   arguments that makes. */
+static int redef_apply(arc *c, value thr, int nargs, int depth, int idx)
+{
+  value fn, xs, rest;
+  int n, i;
+
+  fn = TVALR(thr);
+  for (xs = CNIL, i=0; i<nargs; i++)
+    xs = cons(c, CPOP(thr), xs);
+  n = FIX2INT(__arc_getenv(c, thr, depth, idx));
+  for (rest = CNIL, i=n; i>0; i--)
+    rest = cons(c, __arc_getenv(c, thr, depth, idx + i), rest);
+  CPUSH(thr, fn);
+  for (; xs; xs = cdr(xs))
+    CPUSH(thr, car(xs));
+  CPUSH(thr, rest);
+  SVALR(thr, arc_gbind(c, ARC_BUILTIN(c, S_APPLY)));
+  return(nargs + 2);
+}
+
 /* instruction decoding macros */
 #ifdef HAVE_THREADED_INTERPRETER
 /* threaded interpreter */
@@ -219,6 +258,24 @@ void __arc_init_tracing(arc *c)
 #define NEXT break
 #endif
 
+/* Type feedback for the arithmetic instructions.  The generic iadd,
+   isub and imul rewrite themselves into versions specialised for the
+   operand types they have just seen, if these are both fixnums or
+   both flonums, which do the arithmetic without any type dispatch.
+   A specialised instruction given operands of any other type, or
+   whose result would overflow a fixnum, rewrites itself back into
+   the generic instruction and runs that instead. */
+#define FEEDBACK(arg1, arg2, fxinst, flinst)				\
+  if (FIXNUM_P(arg1) && FIXNUM_P(arg2))					\
+    *(TIPP(thr)-1) = INT2FIX(fxinst);					\
+  else if (TYPE(arg1) == T_FLONUM && TYPE(arg2) == T_FLONUM)		\
+    *(TIPP(thr)-1) = INT2FIX(flinst)
+
+#define DESPECIALISE(inst) {						\
+    *(--TIPP(thr)) = INT2FIX(inst);					\
+    NEXT;								\
+  }
+
 /* The actual virtual machine engine.  Fits into the trampoline just
    like a normal function. */
 int __arc_vmengine(arc *c, value thr)
@@ -390,11 +447,82 @@ int __arc_vmengine(arc *c, value thr)
 	}
       }
       NEXT;
+    INST(ienvl):
+      {
+	int minenv, dsenv, optenv, nargs, i;
+
+	minenv = FIX2INT(*TIPP(thr)++);
+	dsenv = FIX2INT(*TIPP(thr)++);
+	optenv = FIX2INT(*TIPP(thr)++);
+	nargs = minenv + optenv;
+	if (TARGC(thr) < minenv) {
+	  arc_err_cstrfmt(c, "too few arguments, at least %d required, %d passed", minenv, TARGC(thr));
+	} else if (TARGC(thr) <= nargs) {
+	  __arc_mkenv(c, thr, TARGC(thr), nargs - TARGC(thr) + dsenv + 1);
+	  __arc_putenv(c, thr, 0, nargs + dsenv, INT2FIX(0));
+	} else {
+	  /* Like envr, except that the extra arguments are not made
+	     into a list.  They stay in the environment, moved past the
+	     destructuring binds and the rest parameter, which is given
+	     their count.  The compiler only does this if the rest
+	     parameter is never used except by iapplyr. */
+	  __arc_mkenv(c, thr, TARGC(thr), dsenv + 1);
+	  for (i=TARGC(thr)-1; i>=nargs; i--)
+	    __arc_putenv(c, thr, 0, i + dsenv + 1, __arc_getenv(c, thr, 0, i));
+	  for (i=nargs; i<nargs + dsenv; i++)
+	    __arc_putenv(c, thr, 0, i, CUNBOUND);
+	  __arc_putenv(c, thr, 0, nargs + dsenv, INT2FIX(TARGC(thr) - nargs));
+	}
+      }
+      NEXT;
+    INST(iapplyr):
+      {
+	int nargs = FIX2INT(*TIPP(thr)++);
+	int depth = FIX2INT(*TIPP(thr)++);
+	int idx = FIX2INT(*TIPP(thr)++);
+
+	if (c->applyredef)
+	  TARGC(thr) = redef_apply(c, thr, nargs, depth, idx);
+	else
+	  TARGC(thr) = nargs + spread_rest(c, thr, depth, idx);
+	if (TYPE(TVALR(thr)) == T_CLOS) {
+	  __arc_clos_enter(thr, TVALR(thr));
+	  NEXT;
+	}
+	return(TR_FNAPP);
+      }
+      NEXT;
+    INST(itapplyr):
+      {
+	int nargs = FIX2INT(*TIPP(thr)++);
+	int depth = FIX2INT(*TIPP(thr)++);
+	int idx = FIX2INT(*TIPP(thr)++);
+
+	/* as iapplyr, but as a tail call, like menv and apply */
+	if (c->applyredef)
+	  nargs = redef_apply(c, thr, nargs, depth, idx);
+	else
+	  nargs += spread_rest(c, thr, depth, idx);
+	__arc_menv(c, thr, nargs);
+	TARGC(thr) = nargs;
+	if (TYPE(TVALR(thr)) == T_CLOS) {
+	  __arc_clos_enter(thr, TVALR(thr));
+	  NEXT;
+	}
+	return(TR_FNAPP);
+      }
+      NEXT;
     INST(iapply):
       {
 	/* Set up the argc based on the call.  Everything else required
 	   for function application has already been set up beforehand */
 	TARGC(thr) = FIX2INT(*TIPP(thr)++);
+	/* Calls from one closure to another, by far the most common, are
+	   done right here without going back to the trampoline. */
+	if (TYPE(TVALR(thr)) == T_CLOS) {
+	  __arc_clos_enter(thr, TVALR(thr));
+	  NEXT;
+	}
 	return(TR_FNAPP);
       }
       NEXT;
@@ -412,6 +540,35 @@ int __arc_vmengine(arc *c, value thr)
 	TIPP(thr) += itarget-2;
       }
       NEXT;
+    INST(ijself):
+      {
+	int itarget = FIX2INT(*TIPP(thr)++);
+	int nargs = FIX2INT(*TIPP(thr)++), i;
+
+	/* A tail call of the function being run by itself needs no new
+	   environment: if its environment is still on the stack, where
+	   nothing else can refer to it, the arguments can just replace
+	   the ones it has, and it can start over from the top of its
+	   body.  Otherwise, the call is done as usual. */
+	if (TVALR(thr) == TFUNR(thr) && (nargs == 0 || ENV_P(TENVR(thr)))) {
+	  for (i=nargs-1; i>=0; i--)
+	    __arc_putenv0(c, thr, i, CPOP(thr));
+	  TSP(thr) = TSFN(thr);
+	  TIPP(thr) += itarget-3;
+	}
+      }
+      NEXT;
+    INST(ijinl):
+      {
+	int itarget = FIX2INT(*TIPP(thr)++);
+
+	/* Code inlined from a global function that has since been
+	   redefined has to be skipped in favour of an ordinary call. */
+	if (NIL_P(car(CODE_LITERAL(CLOS_CODE(TFUNR(thr)),
+				   FIX2INT(*TIPP(thr)++)))))
+	  TIPP(thr) += itarget-3;
+      }
+      NEXT;
     INST(ijt):
       {
 	int itarget = FIX2INT(*TIPP(thr)++);
@@ -459,18 +616,145 @@ int __arc_vmengine(arc *c, value thr)
 	  CPUSH(thr, arg1);
 	  CPUSH(thr, arg2);
 	  TARGC(thr) = 2;
-	  SVALR(thr, arc_mkaff(c, __arc_add2_string, CNIL));
+	  SVALR(thr, ARC_AFF(c, __arc_add2_string));
 	  return(TR_FNAPP);
 	} else {
 	  SVALR(thr, __arc_add2(c, arg1, arg2));
+	  FEEDBACK(arg1, arg2, iaddfx, iaddfl);
 	}
       }
       NEXT;
     INST(isub):
-      SVALR(thr, __arc_sub2(c, CPOP(thr), TVALR(thr)));
+      {
+	value arg1, arg2;
+
+	arg1 = CPOP(thr);
+	arg2 = TVALR(thr);
+	SVALR(thr, __arc_sub2(c, arg1, arg2));
+	FEEDBACK(arg1, arg2, isubfx, isubfl);
+      }
       NEXT;
     INST(imul):
-      SVALR(thr, __arc_mul2(c, CPOP(thr), TVALR(thr)));
+      {
+	value arg1, arg2;
+
+	arg1 = CPOP(thr);
+	arg2 = TVALR(thr);
+	SVALR(thr, __arc_mul2(c, arg1, arg2));
+	FEEDBACK(arg1, arg2, imulfx, imulfl);
+      }
+      NEXT;
+    INST(iaddfx):
+      {
+	value arg1 = *(TSP(thr)+1), arg2 = TVALR(thr);
+	long res;
+
+	if (!FIXNUM_P(arg1) || !FIXNUM_P(arg2))
+	  DESPECIALISE(iadd);
+	res = FIX2INT(arg1) + FIX2INT(arg2);
+	if (ABS(res) > FIXNUM_MAX)
+	  DESPECIALISE(iadd);
+	TSP(thr)++;
+	SVALR(thr, INT2FIX(res));
+      }
+      NEXT;
+    INST(isubfx):
+      {
+	value arg1 = *(TSP(thr)+1), arg2 = TVALR(thr);
+	long res;
+
+	if (!FIXNUM_P(arg1) || !FIXNUM_P(arg2))
+	  DESPECIALISE(isub);
+	res = FIX2INT(arg1) - FIX2INT(arg2);
+	if (ABS(res) > FIXNUM_MAX)
+	  DESPECIALISE(isub);
+	TSP(thr)++;
+	SVALR(thr, INT2FIX(res));
+      }
+      NEXT;
+    INST(imulfx):
+      {
+	value arg1 = *(TSP(thr)+1), arg2 = TVALR(thr);
+
+	if (!FIXNUM_P(arg1) || !FIXNUM_P(arg2)
+	    || !__arc_fixmul_ok(FIX2INT(arg1), FIX2INT(arg2)))
+	  DESPECIALISE(imul);
+	TSP(thr)++;
+	SVALR(thr, INT2FIX(FIX2INT(arg1) * FIX2INT(arg2)));
+      }
+      NEXT;
+    INST(iaddfl):
+      {
+	value arg1 = *(TSP(thr)+1), arg2 = TVALR(thr);
+
+	if (TYPE(arg1) != T_FLONUM || TYPE(arg2) != T_FLONUM)
+	  DESPECIALISE(iadd);
+	TSP(thr)++;
+	SVALR(thr, arc_mkflonum(c, REPFLO(arg1) + REPFLO(arg2)));
+      }
+      NEXT;
+    INST(isubfl):
+      {
+	value arg1 = *(TSP(thr)+1), arg2 = TVALR(thr);
+
+	if (TYPE(arg1) != T_FLONUM || TYPE(arg2) != T_FLONUM)
+	  DESPECIALISE(isub);
+	TSP(thr)++;
+	SVALR(thr, arc_mkflonum(c, REPFLO(arg1) - REPFLO(arg2)));
+      }
+      NEXT;
+    INST(imulfl):
+      {
+	value arg1 = *(TSP(thr)+1), arg2 = TVALR(thr);
+
+	if (TYPE(arg1) != T_FLONUM || TYPE(arg2) != T_FLONUM)
+	  DESPECIALISE(imul);
+	TSP(thr)++;
+	SVALR(thr, arc_mkflonum(c, REPFLO(arg1) * REPFLO(arg2)));
+      }
+      NEXT;
+    INST(iaddi):
+      /* The compiler uses these when the second operand is a fixnum
+	 constant.  Anything but a fixnum sum or difference is left to
+	 the generic instruction. */
+      {
+	value arg2 = *TIPP(thr)++;
+	long res;
+
+	if (FIXNUM_P(TVALR(thr))) {
+	  res = FIX2INT(TVALR(thr)) + FIX2INT(arg2);
+	  if (ABS(res) <= FIXNUM_MAX) {
+	    SVALR(thr, INT2FIX(res));
+	    NEXT;
+	  }
+	}
+	if (TYPE(TVALR(thr)) == T_STRING) {
+	  SCONR(thr, __arc_mkcont(c, thr, TIPP(thr)
+				  - &XVINDEX(CODE_CODE(CLOS_CODE(TFUNR(thr))),
+					     0)));
+	  CPUSH(thr, TVALR(thr));
+	  CPUSH(thr, arg2);
+	  TARGC(thr) = 2;
+	  SVALR(thr, ARC_AFF(c, __arc_add2_string));
+	  return(TR_FNAPP);
+	}
+	SVALR(thr, __arc_add2(c, TVALR(thr), arg2));
+      }
+      NEXT;
+    INST(isubi):
+      {
+	value arg2 = *TIPP(thr)++;
+	long res;
+
+	if (FIXNUM_P(TVALR(thr))) {
+	  res = FIX2INT(TVALR(thr)) - FIX2INT(arg2);
+	  if (ABS(res) <= FIXNUM_MAX) {
+	    SVALR(thr, INT2FIX(res));
+	    NEXT;
+	  }
+	}
+	SVALR(thr, __arc_sub2(c, TVALR(thr), arg2));
+      }
       NEXT;
     INST(idiv):
       SVALR(thr, __arc_div2(c, CPOP(thr), TVALR(thr)));
@@ -511,6 +795,19 @@ int __arc_vmengine(arc *c, value thr)
 	SENVR(thr, __arc_env2heap(c, thr, TENVR(thr)));
       SVALR(thr, arc_mkclos(c, TVALR(thr), TENVR(thr)));
       NEXT;
+    INST(iclsn):
+      /* closure whose code references no variables from enclosing
+	 environments: it never needs them, so leave them on the stack. */
+      SVALR(thr, arc_mkclos(c, TVALR(thr), CNIL));
+      NEXT;
+    INST(iclsf): {
+	/* flat closure, whose environment is just the values of the n
+	   variables it captures, which are on the stack */
+	int n = FIX2INT(*TIPP(thr)++);
+
+	SVALR(thr, arc_mkclos(c, TVALR(thr), __arc_mkflatenv(c, thr, n)));
+      }
+      NEXT;
     INST(iconsr):
       SVALR(thr, cons(c, TVALR(thr), CPOP(thr)));
       NEXT;
@@ -633,7 +930,7 @@ AFFDEF(__arc_reroot)
   AFBEGIN;
   if (TCH(thr) == AV(there))
     ARETURN(CNIL);
-  AFCALL(arc_mkaff(c, __arc_reroot, CNIL), cdr(AV(there)));
+  AFCALL(ARC_AFF(c, __arc_reroot), cdr(AV(there)));
   WV(before, car(car(AV(there))));
   WV(after, cdr(car(AV(there))));
   scar(TCH(thr), cons(c, AV(after), AV(before)));
@@ -667,7 +964,7 @@ static AFFDEF(contwrapper)
     __arc_wb(TBCH(thr), __arc_getenv(c, thr, 1, 4));
     TBCH(thr) = __arc_getenv(c, thr, 1, 4);
   }
-  AFCALL(arc_mkaff(c, __arc_reroot, CNIL), __arc_getenv(c, thr, 1, 3));
+  AFCALL(ARC_AFF(c, __arc_reroot), __arc_getenv(c, thr, 1, 3));
   /* call the continuation in the environment of arc_callcc */
   cont = __arc_getenv(c, thr, 1, 1);
   /* special case -- when ccc is a tail call */
@@ -687,16 +984,13 @@ AFFDEF(arc_callcc)
   /* First move the continuations to the heap if needed */
   SCONR(thr, __arc_cont2heap(c, thr, TCONR(thr)));
   WV(tcr, TCONR(thr));
-  WV(tch, TCH(thr));
+  WV(tch, __arc_thread_here(c, thr));
   WV(tbch, TBCH(thr));
   WV(cthr, thr);
-  /* Save the environment of this call/cc invocation so contwrapper
-     can have access to it later */
-  SENVR(thr, __arc_env2heap(c, thr, TENVR(thr)));
-  /* This use of mkaff2 effectively makes contwrapper a nested
+  /* This use of arc_mkaff_nested effectively makes contwrapper a nested
      function that has access to the environment of arc_callcc.  It
      needs the values of tcr and tch above. */
-  WV(func, arc_mkaff2(c, contwrapper, CNIL, TENVR(thr)));
+  WV(func, arc_mkaff_nested(c, contwrapper, CNIL, thr));
   /* Instead of passing the continuation directly, we pass it the
      contwrapper function, which takes care of calling reroot
      before restoring the continuation. */
@@ -705,19 +999,63 @@ AFFDEF(arc_callcc)
 }
 AFFEND
 
+/* The escape continuation passed by arc_callec.  Its parent
+   environment is the environment of the arc_callec invocation that
+   made it. */
+static AFFDEF(ecwrapper)
+{
+  AARG(arg);
+  AFBEGIN;
+  /* index 2 is the environment of arc_callec itself */
+  if (!__arc_escapable(c, thr, __arc_getenv(c, thr, 1, 2))) {
+    arc_err_cstrfmt(c, "escape continuation invoked outside its extent");
+    ARETURN(CNIL);
+  }
+  /* index 1 is the here of arc_callec */
+  if (TCH(thr) != __arc_getenv(c, thr, 1, 1))
+    AFCALL(ARC_AFF(c, __arc_reroot), __arc_getenv(c, thr, 1, 1));
+  /* Our own environment may be left behind on an abandoned stack
+     chunk by __arc_escape */
+  SVALR(thr, AV(arg));
+  __arc_escape(c, thr, __arc_getenv(c, thr, 1, 2));
+  return(TR_RC);
+  AFEND;
+}
+AFFEND
+
+/* call/ec: an escape-only call/cc.  The continuation passed to the
+   thunk may only be used to return from this call/ec, and only while
+   it has not yet returned, but making it does not require moving any
+   continuations to the heap. */
+AFFDEF(arc_callec)
+{
+  AARG(thunk);
+  AVAR(here, self);
+  AFBEGIN;
+  WV(here, __arc_thread_here(c, thr));
+  /* The environment identifies the continuation made by the AFCALL
+     below, so it has to be on the heap where it cannot move. */
+  SENVR(thr, __arc_env2heap(c, thr, TENVR(thr)));
+  WV(self, TENVR(thr));
+  AFCALL(AV(thunk), arc_mkaff_nested(c, ecwrapper, CNIL, thr));
+  ARETURN(AFCRV);
+  AFEND;
+}
+AFFEND
+
 AFFDEF(arc_dynamic_wind)
 {
   AARG(before, during, after);
   AVAR(here, ret);
   AFBEGIN;
 
-  WV(here, TCH(thr));
-  AFCALL(arc_mkaff(c, __arc_reroot, CNIL),
+  WV(here, __arc_thread_here(c, thr));
+  AFCALL(ARC_AFF(c, __arc_reroot),
 	 cons(c, cons(c, AV(before), AV(after)), AV(here)));
   AFCALL2(AV(during), CNIL);
   WV(ret, AFCRV);
   /* execute the after clauses if the during thunk returns normally */
-  AFCALL(arc_mkaff(c, __arc_reroot, CNIL), AV(here));
+  AFCALL(ARC_AFF(c, __arc_reroot), AV(here));
   ARETURN(AV(ret));
   AFEND;
 }
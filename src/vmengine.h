@@ -31,11 +31,17 @@ enum vminst {
   ildi=68,
   ildg=69,
   istg=70,
+  iclsf=71,
   ilde=135,
   iste=136,
   icont=137,
+  ijself=138,
+  ijinl=139,
   ienv=202,
   ienvr=203,
+  ienvl=204,
+  iapplyr=205,
+  itapplyr=206,
   iapply=76,
   iret=13,
   ijmp=78,
@@ -48,6 +54,14 @@ enum vminst {
   iadd=21,
   isub=22,
   imul=23,
+  iaddfx=41,
+  isubfx=42,
+  imulfx=43,
+  iaddfl=44,
+  isubfl=45,
+  imulfl=46,
+  iaddi=82,
+  isubi=83,
   idiv=24,
   icons=25,
   icar=26,
@@ -58,6 +72,7 @@ enum vminst {
   idup=34,
   icls=35,
   iconsr=36,
+  iclsn=37,
   imenv=101,
   idcar=38,
   idcdr=39,
@@ -66,26 +81,32 @@ enum vminst {
   iste0=106
 };
 
+/* A code object is a vector holding its vmcode, its source information,
+   the (args . body) of the fn it was compiled from if the compiler may
+   inline it, or nil, and then its literals. */
 #define CODE_CODE(c) (VINDEX((c), 0))
 #define CODE_SRC(c) (VINDEX((c), 1))
-#define CODE_LITERAL(c, idx) (VINDEX((c), 2+(idx)))
+#define CODE_INLINE(c) (VINDEX((c), 2))
+#define CODE_LITERAL(c, idx) (VINDEX((c), 3+(idx)))
 
-#define XCODE_LITERAL(c, idx) (XVINDEX((c), 2+(idx)))
+#define XCODE_LITERAL(c, idx) (XVINDEX((c), 3+(idx)))
 
 #define SCODE_CODE(c, val) (SVINDEX((c), 0, val))
 #define SCODE_SRC(c, val) (SVINDEX((c), 1, val))
-#define SCODE_LITERAL(c, idx, val) (SVINDEX((c), 2+(idx), val))
+#define SCODE_INLINE(c, val) (SVINDEX((c), 2, val))
+#define SCODE_LITERAL(c, idx, val) (SVINDEX((c), 3+(idx), val))
 
 #define CLOS_CODE(cl) (car(cl))
 #define CLOS_ENV(cl) (cdr(cl))
 
-/* The source information is a hash table, whose keys are code offsets
-   into the function and whose values are line numbers.  The following
-   special negative indexes are used for metadata. */
-/* File name of the compiled file */
-#define SRC_FILENAME (-1)
-/* Function name */
-#define SRC_FUNCNAME (-2)
+/* The source information is a vector holding the name of the
+   function, the name of the file it was compiled from, and then its
+   line number table.  The line number table is a sorted list of pairs
+   of code offsets and line numbers, with a pair only where the line
+   number changes.  It is nil if there is no source information at all. */
+#define SRC_FUNCNAME 0
+#define SRC_FILENAME 1
+#define SRC_LINES 2
 
 extern void arc_emit(arc *c, value cctx, int inst, value fl);
 extern void arc_emit1(arc *c, value cctx, int inst, value arg,
@@ -100,7 +121,7 @@ extern value arc_code_setsrc(arc *c, value code, value src);
 extern value arc_code_setname(arc *c, value code, value name);
 extern value arc_cctx2code(arc *c, value cctx);
 extern value arc_mkcctx(arc *c);
-extern value arc_cctx_mksrc(arc *c, value cctx);
+extern value arc_cctx_mksrc(arc *c, value cctx, value file);
 extern value __arc_code_lineno(arc *c, value fun, value *ipptr);
 
 enum threadstate {
@@ -225,7 +246,18 @@ static inline value SCONR(value t, value nv)
 #define TCH(t) (((struct vmthread_t *)REP(t))->conthere)
 #define TBCH(t) (((struct vmthread_t *)REP(t))->baseconthere)
 
-extern inline void __arc_stackcheck(value thr);
+/* The continuation mark table, return value channel and here of a
+   thread are only made when first needed, so that threads are cheap to
+   create. */
+extern value __arc_thread_cmarks(arc *c, value thr);
+extern value __arc_thread_rvchan(arc *c, value thr);
+extern value __arc_thread_here(arc *c, value thr);
+
+extern void __arc_stackcheck(value thr);
+extern void __arc_stackreserve(arc *c, value thr, int n);
+extern void __arc_stackswitch(value thr, value chunk);
+extern value __arc_stackunderflow(arc *c, value thr, value seg);
+extern void __arc_stackrelease(arc *c, value thr);
 
 #define CPUSH(thr, val) do {						\
     assert(TSP(thr) >= TSBASE(thr));					\
@@ -235,8 +267,10 @@ extern inline void __arc_stackcheck(value thr);
   } while (0)
 
 #define CPOP(thr) (*(++TSP(thr)))
-/* Default thread stack size */
+/* Default thread stack chunk size */
 #define TSTKSIZE 16384
+/* Size of the first stack chunk of a new thread */
+#define TSTKINIT 256
 
 /* A code generation context (cctx) is a vector with the following
    items as indexes:
@@ -245,6 +279,33 @@ extern inline void __arc_stackcheck(value thr);
    1. A vmcode object.
    2. A pointer into the literal vector (usually a fixnum)
    3. A vector of literals
+   4. The source information being built, laid out just like that of
+      a code object, except that its first element is the number of
+      elements in use instead of the function name.  Nil if no line
+      numbers are being recorded.
+   5. The outermost environment frame referenced by the code, counted
+      from the outermost frame of the compiler's environment, or nil
+      if the code references no local variables at all.  This is
+      used by the compiler to tell whether or not a closure needs to
+      capture its enclosing environment.
+   6. If the function being compiled takes only ordinary arguments
+      and is being assigned to a variable, ((name . frame) nargs
+      . offset), where name is the variable, frame the compiler frame
+      binding it (nil if it is global), nargs the number of arguments
+      and offset the start of the body of the function, where a tail
+      call through the variable can jump to.  Nil otherwise.
+   7. The list of the names of the global functions whose bodies are
+      being inlined, innermost first, so that they are not inlined
+      into themselves.
+   8. A hash table giving the index of each literal that is a symbol,
+      string, character or non-fixnum number, so that the compiler
+      need not look through all the literals for it.  Nil until the
+      first such literal is added.
+   9. What the compiler found out about the outermost fn being
+      compiled before compiling it, i.e. which variables are ever
+      assigned, which fns reference which variables from outside
+      them, and the expansions of the macros in it (see scan_fn in
+      compiler.c).  Nil if there is no such fn.
 
    The following macros are intended to manage the data
    structure, and to generate code and literals for the
@@ -256,13 +317,29 @@ extern inline void __arc_stackcheck(value thr);
 #define CCTX_LPTR(cctx) (VINDEX(cctx, 2))
 #define CCTX_LITS(cctx) (VINDEX(cctx, 3))
 #define CCTX_SRC(cctx) (VINDEX(cctx, 4))
-#define CCTX_SIZE 5
+#define CCTX_FRMIN(cctx) (VINDEX(cctx, 5))
+#define CCTX_SELF(cctx) (VINDEX(cctx, 6))
+#define CCTX_INLINING(cctx) (VINDEX(cctx, 7))
+#define CCTX_LITIDX(cctx) (VINDEX(cctx, 8))
+#define CCTX_SCAN(cctx) (VINDEX(cctx, 9))
+#define CCTX_SIZE 10
 
 #define SCCTX_VCPTR(cctx, val) (SVINDEX(cctx, 0, val))
 #define SCCTX_VCODE(cctx, val) (SVINDEX(cctx, 1, val))
 #define SCCTX_LPTR(cctx, val) (SVINDEX(cctx, 2, val))
 #define SCCTX_LITS(cctx, val) (SVINDEX(cctx, 3, val))
 #define SCCTX_SRC(cctx, val) (SVINDEX(cctx, 4, val))
+#define SCCTX_FRMIN(cctx, val) (SVINDEX(cctx, 5, val))
+#define SCCTX_SELF(cctx, val) (SVINDEX(cctx, 6, val))
+#define SCCTX_INLINING(cctx, val) (SVINDEX(cctx, 7, val))
+#define SCCTX_LITIDX(cctx, val) (SVINDEX(cctx, 8, val))
+#define SCCTX_SCAN(cctx, val) (SVINDEX(cctx, 9, val))
+
+/* Tell whether a literal is entered into the literal index */
+#define LITIDX_P(lit) (SYMBOL_P(lit) || TYPE(lit) == T_STRING		\
+		       || TYPE(lit) == T_CHAR || TYPE(lit) == T_FLONUM	\
+		       || TYPE(lit) == T_BIGNUM || TYPE(lit) == T_RATIONAL \
+		       || TYPE(lit) == T_COMPLEX)
 
 /* Continuations are vectors with the following items as indexes:
 
@@ -272,6 +349,13 @@ extern inline void __arc_stackcheck(value thr);
    3. Argument count
    4. Old value of continuation register
    5. Vector of saved stack values
+
+   A continuation whose offset is nil is a stack segment boundary,
+   created when a thread's stack chunk overflows and the thread
+   continues on a fresh chunk.  Its saved stack is the full stack
+   chunk that overflowed, and its old continuation register is the
+   stack-based continuation in that chunk which is to be restored when
+   control returns through it.
  */
 #define CONT_OFS(cont) (XVINDEX(cont, 0))
 #define CONT_FUN(cont) (XVINDEX(cont, 1))
@@ -282,6 +366,8 @@ extern inline void __arc_stackcheck(value thr);
 
 #define CONT_SIZE 6
 
+#define CONT_SEGMENT_P(cont) (NIL_P(CONT_OFS(cont)))
+
 extern void arc_jmpoffset(arc *c, value cctx, int jmpinst, int destoffset);
 
 extern void __arc_thr_trampoline(arc *c, value thr, enum tr_states_t result);
@@ -291,11 +377,29 @@ extern int __arc_vmengine(arc *c, value thr);
 
 extern void __arc_clos_env2heap(arc *c, value thr, value clos);
 
+/* Set up the registers of thr so that the closure clos begins to
+   execute, with its arguments on the stack. */
+static inline void __arc_clos_enter(value thr, value clos)
+{
+  TIPP(thr) = &XVINDEX(CODE_CODE(CLOS_CODE(clos)), 0);
+  SENVR(thr, CLOS_ENV(clos));
+  SFUNR(thr, clos);
+  /* A function that takes no arguments never creates an environment,
+     so mark the start of its stack here as well.  The arguments are
+     counted as part of its stack until an environment is made out of
+     them, so that they move along if the stack chunk fills up. */
+  TSFN(thr) = TSP(thr) + TARGC(thr);
+}
+
 extern value __arc_env2heap(arc *c, value thr, value env);
+extern value __arc_mkflatenv(arc *c, value thr, int n);
+extern value __arc_envfwd(arc *c, value thr, value env);
 extern void __arc_menv(arc *c, value thr, int n);
 
-extern void __arc_update_cont_envs(arc *c, value thr, value oldenv, value nenv);
 extern value __arc_cont2heap(arc *c, value thr, value cont);
+extern value __arc_mkcontseg(arc *c, value chunk, value cont);
+extern int __arc_escapable(arc *c, value thr, value env);
+extern int __arc_escape(arc *c, value thr, value env);
 
 /* Closures */
 extern value arc_mkclos(arc *c, value code, value env);
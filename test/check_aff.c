@@ -53,6 +53,33 @@ AFFDEF(doubler)
 }
 AFFEND
 
+AFFDEF(leaf_subtractor)
+{
+  AARG(a, b);
+  AFLBEGIN;
+  ARETURN(INT2FIX(FIX2INT(AV(a)) - FIX2INT(AV(b))));
+  AFEND;
+}
+AFFEND
+
+static value *leaf_sp;
+
+AFFDEF(leaf_twice)
+{
+  AARG(a, b);
+  AVAR(x);
+  AFBEGIN;
+  AFCALL(ARC_AFF(c, leaf_subtractor), AV(a), AV(b));
+  WV(x, AFCRV);
+  /* by now the leaf is known, and this call is made directly */
+  leaf_sp = TSP(thr);
+  AFCALL(ARC_AFF(c, leaf_subtractor), AV(x), AV(b));
+  fail_unless(TSP(thr) == leaf_sp);
+  ARETURN(cons(c, AV(x), AFCRV));
+  AFEND;
+}
+AFFEND
+
 START_TEST(test_aff_simple)
 {
   value thr;
@@ -93,6 +120,42 @@ START_TEST(test_aff_doubler)
 }
 END_TEST
 
+START_TEST(test_aff_shared)
+{
+  value thr;
+
+  /* the same AFF is had for the same function every time */
+  fail_unless(ARC_AFF(c, subtractor) == ARC_AFF(c, subtractor));
+  fail_unless(ARC_AFF(c, subtractor) != ARC_AFF(c, doubler));
+
+  thr = arc_mkthread(c);
+  SVALR(thr, ARC_AFF(c, subtractor));
+  CPUSH(thr, INT2FIX(3));
+  CPUSH(thr, INT2FIX(2));
+  TARGC(thr) = 2;
+  __arc_thr_trampoline(c, thr, TR_FNAPP);
+  fail_unless(TVALR(thr) == INT2FIX(1));
+}
+END_TEST
+
+START_TEST(test_aff_leaf)
+{
+  value thr;
+  int i;
+
+  thr = arc_mkthread(c);
+  for (i=0; i<2; i++) {
+    SVALR(thr, ARC_AFF(c, leaf_twice));
+    CPUSH(thr, INT2FIX(10));
+    CPUSH(thr, INT2FIX(3));
+    TARGC(thr) = 2;
+    __arc_thr_trampoline(c, thr, TR_FNAPP);
+    fail_unless(car(TVALR(thr)) == INT2FIX(7));
+    fail_unless(cdr(TVALR(thr)) == INT2FIX(4));
+  }
+}
+END_TEST
+
 int main(void)
 {
   int number_failed;
@@ -106,6 +169,8 @@ int main(void)
   tcase_add_test(tc_aff, test_aff_simple);
   tcase_add_test(tc_aff, test_aff_subtractor);
   tcase_add_test(tc_aff, test_aff_doubler);
+  tcase_add_test(tc_aff, test_aff_shared);
+  tcase_add_test(tc_aff, test_aff_leaf);
 
   suite_add_tcase(s, tc_aff);
   sr = srunner_create(s);
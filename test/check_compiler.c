@@ -75,6 +75,20 @@ AFFEND
 
 #define COMPILE(str) XCALL(compile_something, arc_mkstringc(c, str))
 
+/* Tell whether the code object code contains the instruction instr */
+static int has_instr(value code, int instr)
+{
+  value vcode = CODE_CODE(code);
+  int i;
+
+  /* the top two bits of an opcode give the number of its operands */
+  for (i=0; i<VECLEN(vcode); i += 1 + (FIX2INT(VINDEX(vcode, i)) >> 6)) {
+    if (VINDEX(vcode, i) == INT2FIX(instr))
+      return(1);
+  }
+  return(0);
+}
+
 START_TEST(test_compile_nil)
 {
   value thr, cctx, clos, code;
@@ -445,6 +459,62 @@ START_TEST(test_compile_fn_basic)
 }
 END_TEST
 
+START_TEST(test_compile_fn_noenv)
+{
+  value thr, cctx, clos, code, ret;
+
+  thr = arc_mkthread(c);
+
+  /* a fn that references no variables from outside it makes a
+     closure with no environment */
+  TEST("(fn (x) (+ x 1))");
+  fail_unless(has_instr(code, iclsn) && !has_instr(code, icls));
+  fail_unless(NIL_P(CLOS_ENV(ret)));
+
+  TEST("((fn (y) (fn (x) x)) 1)");
+  fail_unless(NIL_P(CLOS_ENV(ret)));
+
+  /* but one that does needs the environment */
+  TEST("((fn (y) (fn (x) (+ x y))) 1)");
+  fail_unless(!NIL_P(CLOS_ENV(ret)));
+}
+END_TEST
+
+START_TEST(test_compile_fn_flat)
+{
+  value thr, cctx, clos, code, ret;
+
+  thr = arc_mkthread(c);
+
+  /* a fn that captures variables never assigned is a flat closure
+     holding only their values */
+  TEST("(fn (a y) (fn (x) (+ x y)))");
+  fail_unless(has_instr(CLOS_CODE(ret), iclsf)
+	      && !has_instr(CLOS_CODE(ret), icls));
+  TEST("((fn (a y) (fn (x) (+ x y))) 1 2)");
+  fail_unless(VECLEN(CLOS_ENV(ret)) == 2);
+  fail_unless(NIL_P(VINDEX(CLOS_ENV(ret), 0)));
+  fail_unless(VINDEX(CLOS_ENV(ret), 1) == INT2FIX(2));
+
+  /* and so are the fns between it and the variable */
+  TEST("(fn (y) (fn (z) (fn (x) y)))");
+  fail_unless(has_instr(code, iclsn));
+  fail_unless(has_instr(CLOS_CODE(ret), iclsf));
+  fail_unless(has_instr(CODE_LITERAL(CLOS_CODE(ret), 0), iclsf));
+
+  TEST("((((fn (y) (fn (z) (fn (x) (cons x (cons y z))))) 1) 2) 3)");
+  fail_unless(car(ret) == INT2FIX(3));
+  fail_unless(cadr(ret) == INT2FIX(1));
+  fail_unless(cddr(ret) == INT2FIX(2));
+
+  /* a fn that captures a variable that is assigned anywhere shares
+     the environment */
+  TEST("(fn (y) (fn () y) (assign y 2))");
+  fail_unless(has_instr(CLOS_CODE(ret), icls)
+	      && !has_instr(CLOS_CODE(ret), iclsf));
+}
+END_TEST
+
 START_TEST(test_compile_fn_oarg)
 {
   value thr, cctx, clos, code, ret;
@@ -566,6 +636,56 @@ START_TEST(test_compile_fn_dsb)
 }
 END_TEST
 
+START_TEST(test_compile_fn_lazyrest)
+{
+  value thr, cctx, clos, code, ret;
+
+  thr = arc_mkthread(c);
+
+  /* a rest parameter only passed on to apply is not made into a list */
+  TEST("(fn (a . rest) (apply + a 1 rest))");
+  fail_unless(VINDEX(CODE_CODE(CLOS_CODE(ret)), 0) == INT2FIX(ienvl));
+
+  TEST("((fn (a . rest) (apply + a 1 rest)) 2)");
+  fail_unless(ret == INT2FIX(3));
+
+  TEST("((fn (a . rest) (apply + a 1 rest)) 2 3 4)");
+  fail_unless(ret == INT2FIX(10));
+
+  TEST("((fn args ((fn () (apply + args)))) 1 2 3)");
+  fail_unless(ret == INT2FIX(6));
+
+  /* but it is if it is used in any other way */
+  TEST("(fn args (apply + args) (car args))");
+  fail_unless(VINDEX(CODE_CODE(CLOS_CODE(ret)), 0) == INT2FIX(ienvr));
+
+  TEST("((fn args (assign args (cdr args)) (apply + args)) 1 2 3)");
+  fail_unless(ret == INT2FIX(5));
+
+  /* or might be, once macros are expanded or apply is rebound */
+  TEST("(assign usesargs (annotate 'mac (fn () 'args)))");
+  TEST("((fn args (apply + args) (usesargs)) 1 2)");
+  fail_unless(CONS_P(ret) && car(ret) == INT2FIX(1));
+
+  TEST("(fn args ((fn (apply) (apply + args)) list))");
+  fail_unless(VINDEX(CODE_CODE(CLOS_CODE(ret)), 0) == INT2FIX(ienvr));
+
+  /* code that forwarded a rest parameter to apply calls whatever
+     apply has been redefined as */
+  TEST("(assign fwd5 (fn args (apply list args)))");
+  fail_unless(VINDEX(CODE_CODE(CLOS_CODE(ret)), 0) == INT2FIX(ienvl));
+  TEST("(assign fwd6 (fn args (car (apply list 1 args))))");
+  TEST("(assign apply (fn (f . xs) xs))");
+  TEST("(fwd5 1 2)");
+  fail_unless(CONS_P(ret) && NIL_P(cdr(ret)) && CONS_P(car(ret))
+	      && car(car(ret)) == INT2FIX(1));
+  TEST("(fwd6 2 3)");
+  fail_unless(ret == INT2FIX(1));
+  TEST("(fn args (apply list args))");
+  fail_unless(VINDEX(CODE_CODE(CLOS_CODE(ret)), 0) == INT2FIX(ienvr));
+}
+END_TEST
+
 START_TEST(test_compile_quote)
 {
   value thr, cctx, clos, code, ret;
@@ -604,6 +724,14 @@ START_TEST(test_compile_qquote)
   fail_unless(cadr(cddr(ret)) == INT2FIX(3));
   fail_unless(car(cddr(cddr(ret))) == INT2FIX(4));
   fail_unless(NIL_P(cdr(cddr(cddr(ret)))));
+
+  /* constant parts of a template are shared between evaluations */
+  TEST("((fn (f) (is (car (cdr (f 1))) (car (cdr (f 2))))) (fn (a) `(,a (b c))))");
+  fail_unless(ret == CTRUE);
+
+  /* a list spliced in at the end is not copied */
+  TEST("((fn (b) (is (cdr `(0 ,@b)) b)) '(1 2))");
+  fail_unless(ret == CTRUE);
 }
 END_TEST
 
@@ -706,6 +834,121 @@ START_TEST(test_compile_inline_div)
 }
 END_TEST
 
+START_TEST(test_compile_fold)
+{
+  value thr, cctx, clos, code, ret;
+
+  thr = arc_mkthread(c);
+  /* folded into an ildi and an iret */
+  TEST("(+ 1 (* 2 3) (- 4))");
+  fail_unless(ret == INT2FIX(3));
+  fail_unless(CCTX_VCPTR(cctx) == INT2FIX(3));
+
+  TEST("(if (< 1 2 3) 4 (car 5))");
+  fail_unless(ret == INT2FIX(4));
+  fail_unless(CCTX_VCPTR(cctx) == INT2FIX(3));
+
+  TEST("(if (is 1 2) 4 (> 2 1) 5)");
+  fail_unless(ret == INT2FIX(5));
+  fail_unless(CCTX_VCPTR(cctx) == INT2FIX(3));
+
+  /* division by zero is left for run time */
+  COMPILE("(/ 1 0)");
+  cctx = TVALR(thr);
+  fail_unless(CCTX_VCPTR(cctx) > INT2FIX(3));
+
+  arc_declare(c, ARC_BUILTIN(c, S_OPTIMIZE), CNIL);
+  TEST("(+ 1 (* 2 3) (- 4))");
+  fail_unless(ret == INT2FIX(3));
+  fail_unless(CCTX_VCPTR(cctx) > INT2FIX(3));
+  arc_declare(c, ARC_BUILTIN(c, S_OPTIMIZE), CTRUE);
+}
+END_TEST
+
+START_TEST(test_compile_selftail)
+{
+  value thr, cctx, clos, code, ret;
+
+  thr = arc_mkthread(c);
+  /* self tail calls from both arms of an if */
+  TEST("((fn (f) (assign f (fn (n a) (if (> n 0) (f (- n 1) (+ a 2)) (is n -1) a (f -1 (+ a 1))))) (f 1000 0)) nil)");
+  fail_unless(ret == INT2FIX(2001));
+
+  /* a self tail call from a closure that captured its environment */
+  TEST("((fn (f) (assign f (fn (n a) (if (is n 0) (a) (f (- n 1) (fn () n))))) (f 10 nil)) nil)");
+  fail_unless(ret == INT2FIX(1));
+
+  /* only calls through the variable the fn is assigned to are
+     treated as self calls */
+  TEST("(assign selftail1 (fn (n) (if (is n 0) 'done (selftail1 (- n 1)))))");
+  fail_unless(has_instr(CLOS_CODE(ret), ijself));
+  TEST("(assign selftail2 (fn (n) (selftail1 n)))");
+  fail_unless(!has_instr(CLOS_CODE(ret), ijself));
+  TEST("(assign selftail3 (fn (selftail3) (selftail3 1)))");
+  fail_unless(!has_instr(CLOS_CODE(ret), ijself));
+  TEST("((fn (f) (f 1)) (fn (n) n))");
+  fail_unless(!has_instr(code, ijself));
+}
+END_TEST
+
+START_TEST(test_compile_literals)
+{
+  value thr, cctx;
+
+  thr = arc_mkthread(c);
+  /* each literal is stored only once */
+  COMPILE("(list \"a\" 'b 1.5 #\\c \"a\" 'b 1.5 #\\c list)");
+  cctx = TVALR(thr);
+  fail_unless(CCTX_LPTR(cctx) == INT2FIX(5));
+}
+END_TEST
+
+START_TEST(test_compile_inline_globals)
+{
+  value thr, cctx, clos, code, ret, oclos, cell;
+
+  thr = arc_mkthread(c);
+  TEST("(assign mynot (fn (x) (is x nil)))");
+  arc_declare(c, ARC_BUILTIN(c, S_INLINE_GLOBALS), CTRUE);
+
+  /* the body of mynot is inlined, behind a guard */
+  TEST("(mynot nil)");
+  fail_unless(VINDEX(CCTX_VCODE(cctx), 0) == INT2FIX(ijinl));
+  fail_unless(ret == CTRUE);
+  oclos = clos;
+
+  TEST("((fn (y) (mynot y)) 1)");
+  fail_unless(NIL_P(ret));
+
+  /* a local variable shadowing a free variable of the body */
+  TEST("((fn (is) (mynot 1)) (fn (x y) 2))");
+  fail_unless(NIL_P(ret));
+
+  /* redefining some other global leaves the inlined code alone */
+  cell = CODE_LITERAL(CLOS_CODE(oclos),
+		      FIX2INT(VINDEX(CODE_CODE(CLOS_CODE(oclos)), 2)));
+  TEST("(assign mynot2 (fn (x) (is x 1)))");
+  fail_unless(car(cell) == CTRUE);
+
+  /* code that inlined mynot calls its new definition */
+  TEST("(assign mynot (fn (x) 5))");
+  fail_unless(NIL_P(car(cell)));
+  XCALL0(oclos);
+  fail_unless(TVALR(thr) == INT2FIX(5));
+
+  /* only the functions named are inlined if a list is declared */
+  arc_declare(c, ARC_BUILTIN(c, S_INLINE_GLOBALS),
+	      arc_intern_cstr(c, "mynot2"));
+  TEST("(mynot2 1)");
+  fail_unless(VINDEX(CCTX_VCODE(cctx), 0) == INT2FIX(ijinl));
+  fail_unless(ret == CTRUE);
+  TEST("(mynot 1)");
+  fail_unless(VINDEX(CCTX_VCODE(cctx), 0) != INT2FIX(ijinl));
+  fail_unless(ret == INT2FIX(5));
+  arc_declare(c, ARC_BUILTIN(c, S_INLINE_GLOBALS), CNIL);
+}
+END_TEST
+
 START_TEST(test_compile_macro)
 {
   value thr, cctx, clos, code, ret;
@@ -740,6 +983,38 @@ START_TEST(test_compile_macro)
 }
 END_TEST
 
+START_TEST(test_compile_pure_macros)
+{
+  value thr, cctx, clos, code, ret;
+
+  thr = arc_mkthread(c);
+  TEST("(assign nexp 0)");
+  TEST("(assign incr (annotate 'mac (fn (x) (assign nexp (+ nexp 1)) `(+ ,x 1))))");
+  arc_declare(c, ARC_BUILTIN(c, S_PURE_MACROS), arc_intern_cstr(c, "incr"));
+
+  /* equal forms are expanded only once */
+  TEST("(incr 1)");
+  fail_unless(ret == INT2FIX(2));
+  TEST("(incr 1)");
+  fail_unless(ret == INT2FIX(2));
+  TEST("nexp");
+  fail_unless(ret == INT2FIX(1));
+  TEST("(fn () (incr \"a\"))");
+  TEST("(incr 2)");
+  fail_unless(ret == INT2FIX(3));
+  TEST("nexp");
+  fail_unless(ret == INT2FIX(3));
+
+  /* redefining the macro forgets its expansions */
+  TEST("(assign incr (annotate 'mac (fn (x) (assign nexp (+ nexp 1)) `(- ,x 1))))");
+  TEST("(incr 1)");
+  fail_unless(ret == INT2FIX(0));
+  TEST("nexp");
+  fail_unless(ret == INT2FIX(4));
+  arc_declare(c, ARC_BUILTIN(c, S_PURE_MACROS), CNIL);
+}
+END_TEST
+
 static void errhandler(arc *c, value thr, value str)
 {
   fprintf(stderr, "Error\n");
@@ -747,6 +1022,31 @@ static void errhandler(arc *c, value thr, value str)
   abort();
 }
 
+START_TEST(test_compile_source)
+{
+  value cctx, code, ret, file = arc_mkstringc(c, "foo.arc");
+
+  /* no source vector is kept without any line numbers */
+  cctx = arc_mkcctx(c);
+  arc_cctx_mksrc(c, cctx, file);
+  arc_emit(c, cctx, inil, CNIL);
+  arc_emit(c, cctx, iret, CNIL);
+  code = arc_cctx2code(c, cctx);
+  fail_unless(NIL_P(CODE_SRC(code)));
+
+  cctx = arc_mkcctx(c);
+  arc_cctx_mksrc(c, cctx, file);
+  arc_emit(c, cctx, inil, INT2FIX(3));
+  arc_emit(c, cctx, iret, INT2FIX(4));
+  code = arc_cctx2code(c, cctx);
+  fail_if(NIL_P(CODE_SRC(code)));
+  ret = __arc_code_lineno(c, arc_mkclos(c, code, CNIL),
+			  &XVINDEX(CODE_CODE(code), 1));
+  fail_unless(car(ret) == file);
+  fail_unless(cdr(ret) == INT2FIX(4));
+}
+END_TEST
+
 int main(void)
 {
   int number_failed;
@@ -779,8 +1079,11 @@ int main(void)
   tcase_add_test(tc_compiler, test_compile_if_compound);
   tcase_add_test(tc_compiler, test_compile_apply);
   tcase_add_test(tc_compiler, test_compile_fn_basic);
+  tcase_add_test(tc_compiler, test_compile_fn_noenv);
+  tcase_add_test(tc_compiler, test_compile_fn_flat);
   tcase_add_test(tc_compiler, test_compile_fn_oarg);
   tcase_add_test(tc_compiler, test_compile_fn_dsb);
+  tcase_add_test(tc_compiler, test_compile_fn_lazyrest);
   tcase_add_test(tc_compiler, test_compile_quote);
   tcase_add_test(tc_compiler, test_compile_qquote);
   tcase_add_test(tc_compiler, test_compile_assign);
@@ -791,7 +1094,13 @@ int main(void)
   tcase_add_test(tc_compiler, test_compile_inline_times);
   tcase_add_test(tc_compiler, test_compile_inline_minus);
   tcase_add_test(tc_compiler, test_compile_inline_div);
+  tcase_add_test(tc_compiler, test_compile_fold);
+  tcase_add_test(tc_compiler, test_compile_selftail);
+  tcase_add_test(tc_compiler, test_compile_literals);
+  tcase_add_test(tc_compiler, test_compile_inline_globals);
   tcase_add_test(tc_compiler, test_compile_macro);
+  tcase_add_test(tc_compiler, test_compile_pure_macros);
+  tcase_add_test(tc_compiler, test_compile_source);
 
   suite_add_tcase(s, tc_compiler);
   sr = srunner_create(s);
@@ -185,6 +185,39 @@ START_TEST(test_heap_env)
 }
 END_TEST
 
+START_TEST(test_env_forward)
+{
+  value thr, env, henv;
+
+  thr = arc_mkthread(c);
+  SFUNR(thr, arc_gbind_cstr(c, "car"));
+  CPUSH(thr, INT2FIX(1));
+  CPUSH(thr, INT2FIX(2));
+  CPUSH(thr, INT2FIX(3));
+  __arc_mkenv(c, thr, 3, 0);
+  env = TENVR(thr);
+  SCONR(thr, __arc_mkcont(c, thr, 0));
+
+  CPUSH(thr, INT2FIX(4));
+  CPUSH(thr, INT2FIX(5));
+  __arc_mkenv(c, thr, 2, 0);
+  henv = __arc_env2heap(c, thr, TENVR(thr));
+  fail_unless(TYPE(henv) == T_VECTOR);
+  SENVR(thr, henv);
+
+  /* the stack environment saved by the continuation forwards to its
+     heap copy, so changes made through either are seen by both */
+  fail_unless(TYPE(__arc_envfwd(c, thr, env)) == T_VECTOR);
+  __arc_putenv(c, thr, 1, 0, INT2FIX(10));
+
+  arc_restorecont(c, thr, TCONR(thr));
+  fail_unless(TENVR(thr) == __arc_envfwd(c, thr, env));
+  fail_unless(__arc_getenv(c, thr, 0, 0) == INT2FIX(10));
+  fail_unless(__arc_getenv(c, thr, 0, 1) == INT2FIX(2));
+  fail_unless(__arc_getenv(c, thr, 0, 2) == INT2FIX(3));
+}
+END_TEST
+
 int main(void)
 {
   int number_failed;
@@ -198,6 +231,7 @@ int main(void)
   tcase_add_test(tc_env, test_env_simple);
   tcase_add_test(tc_env, test_menv);
   tcase_add_test(tc_env, test_heap_env);
+  tcase_add_test(tc_env, test_env_forward);
 
   suite_add_tcase(s, tc_env);
   sr = srunner_create(s);
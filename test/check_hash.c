@@ -189,6 +189,156 @@ START_TEST(test_hash_expansion)
 }
 END_TEST
 
+START_TEST(test_hash_delete)
+{
+  value hash, thr;
+  int i;
+
+  thr = arc_mkthread(c);
+  hash = arc_mkhash(c, 2);
+  for (i=0; i<1024; i++)
+    arc_hash_insert(c, hash, INT2FIX(i), INT2FIX(i+1));
+  /* remove the even keys, half of them through the general interface */
+  for (i=0; i<1024; i+=4) {
+    fail_unless(arc_hash_delete(c, hash, INT2FIX(i)) == INT2FIX(i+1));
+    XCALL(arc_xhash_delete, hash, INT2FIX(i+2));
+    fail_unless(TVALR(thr) == INT2FIX(i+3));
+  }
+  fail_unless(arc_hash_length(c, hash) == 512);
+  for (i=0; i<1024; i++) {
+    if (i % 2 == 0)
+      fail_unless(arc_hash_lookup(c, hash, INT2FIX(i)) == CUNBOUND);
+    else
+      fail_unless(arc_hash_lookup(c, hash, INT2FIX(i)) == INT2FIX(i+1));
+  }
+  /* deleted entries can be used again */
+  for (i=0; i<1024; i+=2) {
+    XCALL(arc_xhash_insert, hash, INT2FIX(i), INT2FIX(-i));
+    fail_unless(arc_hash_lookup(c, hash, INT2FIX(i)) == INT2FIX(-i));
+  }
+  fail_unless(arc_hash_length(c, hash) == 1024);
+}
+END_TEST
+
+START_TEST(test_hash_churn)
+{
+  value hash;
+  int i, j;
+
+  /* A few live keys among very many that come and go.  The deleted
+     entries must not fill the table up. */
+  hash = arc_mkhash(c, 4);
+  for (i=0; i<100000; i++) {
+    arc_hash_insert(c, hash, INT2FIX(i), INT2FIX(i+1));
+    if (i >= 8)
+      fail_unless(arc_hash_delete(c, hash, INT2FIX(i-8)) == INT2FIX(i-7));
+  }
+  fail_unless(arc_hash_length(c, hash) == 8);
+  for (i=100000-8; i<100000; i++)
+    fail_unless(arc_hash_lookup(c, hash, INT2FIX(i)) == INT2FIX(i+1));
+
+  /* grow a table, then empty most of it so it shrinks */
+  hash = arc_mkhash(c, 2);
+  for (i=0; i<EXPANSION_LIMIT; i++)
+    arc_hash_insert(c, hash, INT2FIX(i), INT2FIX(i+1));
+  for (i=0; i<EXPANSION_LIMIT; i+=64)
+    for (j=i+1; j<i+64; j++)
+      arc_hash_delete(c, hash, INT2FIX(j));
+  arc_hash_insert(c, hash, INT2FIX(-1), INT2FIX(0));
+  fail_unless(arc_hash_length(c, hash) == EXPANSION_LIMIT/64 + 1);
+  for (i=0; i<EXPANSION_LIMIT; i++) {
+    if (i % 64 == 0)
+      fail_unless(arc_hash_lookup(c, hash, INT2FIX(i)) == INT2FIX(i+1));
+    else
+      fail_unless(arc_hash_lookup(c, hash, INT2FIX(i)) == CUNBOUND);
+  }
+  fail_unless(arc_hash_lookup(c, hash, INT2FIX(-1)) == INT2FIX(0));
+}
+END_TEST
+
+#define OMAP_KEYS 5000
+
+START_TEST(test_omap)
+{
+  value omap, list;
+  int i, k;
+
+  omap = arc_mkomap(c);
+  fail_unless(NIL_P(arc_omap_nth(c, omap, 0)));
+  /* insert the keys in scrambled order */
+  for (i=0; i<OMAP_KEYS; i++) {
+    k = (i * 7919) % OMAP_KEYS;
+    arc_omap_insert(c, omap, INT2FIX(k), INT2FIX(k+1));
+  }
+  arc_omap_insert(c, omap, INT2FIX(42), INT2FIX(0));
+  fail_unless(arc_omap_length(c, omap) == OMAP_KEYS);
+  fail_unless(arc_omap_lookup(c, omap, INT2FIX(42)) == INT2FIX(0));
+  fail_unless(arc_omap_lookup(c, omap, INT2FIX(OMAP_KEYS)) == CUNBOUND);
+  for (i=0; i<OMAP_KEYS; i+=7) {
+    fail_unless(arc_omap_rank(c, omap, INT2FIX(i)) == i);
+    fail_unless(car(arc_omap_nth(c, omap, i)) == INT2FIX(i));
+  }
+  list = arc_omap_range(c, omap, INT2FIX(100), INT2FIX(110));
+  for (i=100; i<110; i++, list = cdr(list))
+    fail_unless(car(car(list)) == INT2FIX(i));
+  fail_unless(NIL_P(list));
+
+  /* delete the odd keys, again in scrambled order */
+  for (i=0; i<OMAP_KEYS; i++) {
+    k = (i * 7919) % OMAP_KEYS;
+    if (k % 2 == 1)
+      fail_unless(arc_omap_delete(c, omap, INT2FIX(k)) == INT2FIX(k+1));
+  }
+  fail_unless(arc_omap_delete(c, omap, INT2FIX(1)) == CUNBOUND);
+  fail_unless(arc_omap_length(c, omap) == OMAP_KEYS/2);
+  for (i=0; i<OMAP_KEYS/2; i++) {
+    fail_unless(car(arc_omap_nth(c, omap, i)) == INT2FIX(2*i));
+    fail_unless(arc_omap_rank(c, omap, INT2FIX(2*i+1)) == i+1);
+  }
+  list = arc_omap_range(c, omap, CNIL, INT2FIX(7));
+  fail_unless(arc_list_length(c, list) == INT2FIX(4));
+
+  /* keys of different kinds order by kind */
+  arc_omap_insert(c, omap, arc_mkstringc(c, "a"), CTRUE);
+  arc_omap_insert(c, omap, arc_intern_cstr(c, "a"), CTRUE);
+  fail_unless(TYPE(car(arc_omap_nth(c, omap, OMAP_KEYS/2))) == T_STRING);
+  fail_unless(TYPE(car(arc_omap_nth(c, omap, OMAP_KEYS/2+1))) == T_SYMBOL);
+
+  for (i=0; i<OMAP_KEYS; i+=2)
+    arc_omap_delete(c, omap, INT2FIX(i));
+  fail_unless(arc_omap_length(c, omap) == 2);
+}
+END_TEST
+
+START_TEST(test_omap_iso)
+{
+  value m1, m2, hash, thr;
+  int i;
+
+  thr = arc_mkthread(c);
+  m1 = arc_mkomap(c);
+  m2 = arc_mkomap(c);
+  /* the same contents, inserted in opposite orders */
+  for (i=0; i<100; i++) {
+    arc_omap_insert(c, m1, INT2FIX(i), arc_mkstringc(c, "x"));
+    arc_omap_insert(c, m2, INT2FIX(99-i), arc_mkstringc(c, "x"));
+  }
+  XCALL(arc_iso, m1, m2);
+  fail_unless(TVALR(thr) == CTRUE);
+
+  hash = arc_mkhash(c, 8);
+  XCALL(arc_xhash_insert, hash, m1, INT2FIX(24));
+  XCALL(arc_xhash_lookup, hash, m2);
+  fail_unless(TVALR(thr) == INT2FIX(24));
+
+  arc_omap_insert(c, m2, INT2FIX(50), arc_mkstringc(c, "y"));
+  XCALL(arc_iso, m1, m2);
+  fail_unless(NIL_P(TVALR(thr)));
+  XCALL(arc_xhash_lookup, hash, m2);
+  fail_unless(TVALR(thr) == CUNBOUND);
+}
+END_TEST
+
 int main(void)
 {
   int number_failed;
@@ -204,6 +354,10 @@ int main(void)
   tcase_add_test(tc_hash, test_hash_vector_keys);
   tcase_add_test(tc_hash, test_hash_hash_keys);
   tcase_add_test(tc_hash, test_hash_expansion);
+  tcase_add_test(tc_hash, test_hash_delete);
+  tcase_add_test(tc_hash, test_hash_churn);
+  tcase_add_test(tc_hash, test_omap);
+  tcase_add_test(tc_hash, test_omap_iso);
 
   suite_add_tcase(s, tc_hash);
   sr = srunner_create(s);
@@ -0,0 +1,179 @@
+/* 
+  Copyright (C) 2013 Rafael R. Sevilla
+
+  This file is part of Arcueid
+
+  Arcueid is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <setjmp.h>
+#include "../src/arcueid.h"
+#include "../src/vmengine.h"
+#include "../src/compiler.h"
+#include "../src/io.h"
+
+/* The test module, as libtool builds it */
+#define TESTMOD ".libs/testmod.so"
+
+arc *c, cc;
+jmp_buf errbuf;
+char modpath[4096];
+
+#define QUANTA 1048576
+
+#define CPUSH_(val) CPUSH(c->curthread, val)
+
+#define XCALL0(clos) do {				\
+    TQUANTA(c->curthread) = QUANTA;			\
+    SVALR(c->curthread, clos);				\
+    TARGC(c->curthread) = 0;				\
+    __arc_thr_trampoline(c, c->curthread, TR_FNAPP);	\
+  } while (0)
+
+#define XCALL(fname, ...) do {				\
+    SVALR(c->curthread, arc_mkaff(c, fname, CNIL));	\
+    TARGC(c->curthread) = NARGS(__VA_ARGS__);		\
+    FOR_EACH(CPUSH_, __VA_ARGS__);			\
+    __arc_thr_trampoline(c, c->curthread, TR_FNAPP);	\
+  } while (0)
+
+AFFDEF(compile_something)
+{
+  AARG(something);
+  value sexpr;
+  AVAR(sio);
+  AFBEGIN;
+  TQUANTA(thr) = QUANTA;
+  WV(sio, arc_instring(c, AV(something), CNIL));
+  AFCALL(arc_mkaff(c, arc_sread, CNIL), AV(sio), CNIL);
+  sexpr = AFCRV;
+  AFTCALL(arc_mkaff(c, arc_compile, CNIL), sexpr, arc_mkcctx(c), CNIL, CTRUE);
+  AFEND;
+}
+AFFEND
+
+#define COMPILE(str) XCALL(compile_something, arc_mkstringc(c, str))
+
+#define TEST(sexpr)				\
+  COMPILE(sexpr);				\
+  cctx = TVALR(c->curthread);			\
+  code = arc_cctx2code(c, cctx);		\
+  clos = arc_mkclos(c, code, CNIL);		\
+  XCALL0(clos);					\
+  ret = TVALR(c->curthread)
+
+static void errhandler(arc *c, value thr, value str)
+{
+  longjmp(errbuf, 1);
+}
+
+static value load_testmod(void)
+{
+  value ret, cctx, code, clos;
+  char expr[4200];
+
+  snprintf(expr, sizeof(expr), "(load-native \"%s\")", modpath);
+  TEST(expr);
+  return(ret);
+}
+
+START_TEST(test_load_native)
+{
+  value ret, cctx, code, clos;
+
+  fail_unless(load_testmod() == arc_intern_cstr(c, "testmod"));
+  fail_unless(c->modules != NULL);
+  TEST("(testmod-add 1 2)");
+  fail_unless(ret == INT2FIX(3));
+}
+END_TEST
+
+START_TEST(test_load_native_loadpath)
+{
+  value ret, cctx, code, clos;
+
+  TEST("(assign loadpath* '(\".libs\"))");
+  TEST("(load-native \"testmod.so\")");
+  fail_unless(ret == arc_intern_cstr(c, "testmod"));
+  TEST("(testmod-add 2 3)");
+  fail_unless(ret == INT2FIX(5));
+}
+END_TEST
+
+START_TEST(test_load_native_notfound)
+{
+  value ret, cctx, code, clos;
+  struct arc_module *modules = c->modules;
+
+  if (setjmp(errbuf) == 1) {
+    fail_unless(c->modules == modules);
+    return;
+  }
+  TEST("(assign loadpath* '(\".libs\"))");
+  TEST("(load-native \"nosuchmodule.so\")");
+  fail("load-native of a missing module did not raise an error");
+}
+END_TEST
+
+START_TEST(test_unload_native)
+{
+  load_testmod();
+  fail_unless(c->modules != NULL);
+  arc_deinit(c);
+  fail_unless(c->modules == NULL);
+#ifdef RTLD_NOLOAD
+  /* The module is no longer mapped */
+  fail_unless(dlopen(modpath, RTLD_NOW | RTLD_NOLOAD) == NULL);
+#endif
+}
+END_TEST
+
+int main(void)
+{
+  int number_failed;
+  Suite *s = suite_create("native modules");
+  TCase *tc_native = tcase_create("native modules");
+  SRunner *sr;
+
+  if (getcwd(modpath, sizeof(modpath) - sizeof(TESTMOD) - 1) == NULL)
+    return(EXIT_FAILURE);
+  strcat(modpath, "/" TESTMOD);
+
+  c = &cc;
+  c->errhandler = errhandler;
+  if (setjmp(errbuf) != 0) {
+    printf("unhandled error received\n");
+    abort();
+  }
+  arc_init(c);
+  c->curthread = arc_mkthread(c);
+
+  tcase_add_test(tc_native, test_load_native);
+  tcase_add_test(tc_native, test_load_native_loadpath);
+  tcase_add_test(tc_native, test_load_native_notfound);
+  /* last, as it tears down the interpreter */
+  tcase_add_test(tc_native, test_unload_native);
+
+  suite_add_tcase(s, tc_native);
+  sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return((number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
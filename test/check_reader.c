@@ -346,6 +346,26 @@ START_TEST(test_read_symbol)
   XCALL(arc_sread, sio, CNIL);
   fail_unless(TYPE(TVALR(thr)) == T_SYMBOL);
   fail_unless(TVALR(thr) == arc_intern_cstr(c, "foo"));
+
+  /* symbols that begin the way numbers do */
+  sio = arc_instring(c, arc_mkstringc(c, "-foo"), CNIL);
+  XCALL(arc_sread, sio, CNIL);
+  fail_unless(TVALR(thr) == arc_intern(c, arc_mkstringc(c, "-foo")));
+
+  /* a symbol longer than the reader's token buffer */
+  sio = arc_instring(c, arc_mkstringc(c, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz"), CNIL);
+  XCALL(arc_sread, sio, CNIL);
+  fail_unless(TVALR(thr) == arc_intern(c, arc_mkstringc(c, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz")));
+
+  /* interning from runes finds the same symbols */
+  sio = arc_instring(c, arc_mkstringc(c, "\u03bb\u03bc"), CNIL);
+  XCALL(arc_sread, sio, CNIL);
+  {
+    Rune name[] = { 0x3bb, 0x3bc };
+
+    fail_unless(TVALR(thr) == arc_intern_runes(c, name, 2));
+    fail_unless(TVALR(thr) == arc_intern_cstr(c, "\u03bb\u03bc"));
+  }
 }
 END_TEST
 
@@ -22,6 +22,7 @@
 #include <math.h>
 #include <stdio.h>
 #include "../src/arcueid.h"
+#include "../src/hash.h"
 #include "../config.h"
 
 #ifdef HAVE_ALLOCA_H
@@ -86,6 +87,112 @@ START_TEST(test_compare_strings)
 }
 END_TEST
 
+START_TEST(test_hash_strings)
+{
+  value str1, str2;
+
+  str1 = arc_mkstringc(c, "abcde");
+  str2 = arc_mkstringc(c, "abcdf");
+  fail_unless(arc_hash(c, str1) != arc_hash(c, str2));
+  fail_unless(arc_is2(c, str1, str2) == CNIL);
+  /* changing a string changes its hash */
+  arc_strsetindex(c, str2, 4, 'e');
+  fail_unless(arc_hash(c, str1) == arc_hash(c, str2));
+  fail_unless(arc_is2(c, str1, str2) == CTRUE);
+  fail_unless(arc_hash(c, arc_mkstringc(c, "")) == arc_hash(c, arc_mkstringc(c, "")));
+}
+END_TEST
+
+START_TEST(test_wide_strings)
+{
+  value str1, str2, str3;
+  Rune runes[] = { 'a', 0xe9, 0x3bb };
+  char buf[16];
+
+  /* Latin-1 and wider runes are kept whatever the string holds */
+  str1 = arc_mkstringc(c, "a\xc3\xa9" "b");
+  fail_unless(arc_strlen(c, str1) == 3);
+  fail_unless(arc_strindex(c, str1, 1) == 0xe9);
+  fail_unless(FIX2INT(arc_strutflen(c, str1)) == 4);
+
+  /* putting a wide rune into a narrow string widens it */
+  str2 = arc_mkstringc(c, "abc");
+  arc_strsetindex(c, str2, 1, 0xe9);
+  arc_strsetindex(c, str2, 2, 0x3bb);
+  fail_unless(arc_strindex(c, str2, 0) == 'a');
+  fail_unless(arc_strindex(c, str2, 1) == 0xe9);
+  fail_unless(arc_strindex(c, str2, 2) == 0x3bb);
+  str3 = arc_mkstring(c, runes, 3);
+  fail_unless(arc_is2(c, str2, str3) == CTRUE);
+  fail_unless(arc_hash(c, str2) == arc_hash(c, str3));
+  fail_unless(arc_strcmp(c, str2, str3) == 0);
+  arc_str2cstr(c, str2, buf);
+  fail_unless(strcmp(buf, "a\xc3\xa9\xce\xbb") == 0);
+
+  /* a wide string equals a narrow one with the same runes */
+  arc_strsetindex(c, str2, 2, 'b');
+  fail_unless(arc_is2(c, str1, str2) == CTRUE);
+  fail_unless(arc_hash(c, str1) == arc_hash(c, str2));
+  fail_unless(arc_is2(c, arc_strcat(c, str1, str3),
+		      arc_strcat(c, str2, str3)) == CTRUE);
+  fail_unless(arc_strindex(c, arc_substr(c, str3, 1, 3), 1) == 0x3bb);
+}
+END_TEST
+
+START_TEST(test_slices)
+{
+  value str, sl1, sl2, sl3;
+  char buf[64];
+
+  str = arc_mkstringc(c, "the quick brown fox jumps over the lazy dog");
+  sl1 = arc_substr(c, str, 4, 25);
+  arc_str2cstr(c, sl1, buf);
+  fail_unless(strcmp(buf, "quick brown fox jumps") == 0);
+  fail_unless(arc_is2(c, sl1, arc_mkstringc(c, "quick brown fox jumps"))
+	      == CTRUE);
+  fail_unless(arc_hash(c, sl1)
+	      == arc_hash(c, arc_mkstringc(c, "quick brown fox jumps")));
+  /* a slice of a slice */
+  sl2 = arc_substr(c, sl1, 2, 21);
+  fail_unless(arc_strindex(c, sl2, 0) == 'i');
+  fail_unless(arc_strindex(c, sl2, 19) == 0);
+
+  /* changing the string does not change its slices, nor the reverse */
+  arc_strsetindex(c, str, 10, 'B');
+  fail_unless(arc_strindex(c, str, 10) == 'B');
+  fail_unless(arc_strindex(c, sl1, 6) == 'b');
+  fail_unless(arc_strindex(c, sl2, 4) == 'b');
+  arc_strsetindex(c, sl1, 0, 'Q');
+  fail_unless(arc_strindex(c, sl1, 0) == 'Q');
+  fail_unless(arc_strindex(c, str, 4) == 'q');
+  fail_unless(arc_strindex(c, sl2, 0) == 'i');
+  arc_strsetindex(c, sl2, 5, 0x3bb);
+  arc_str2cstr(c, sl2, buf);
+  fail_unless(strcmp(buf, "ick b\xce\xbbown fox jumps") == 0);
+  arc_str2cstr(c, sl1, buf);
+  fail_unless(strcmp(buf, "Quick brown fox jumps") == 0);
+
+  /* a slice of a string that has been changed since */
+  sl3 = arc_substr(c, str, 4, 25);
+  arc_str2cstr(c, sl3, buf);
+  fail_unless(strcmp(buf, "quick Brown fox jumps") == 0);
+  fail_unless(arc_strcmp(c, sl1, sl3) < 0);
+
+  /* narrow runes put into a slice of a wide string */
+  str = arc_mkstringc(c, "\xce\xbb" "abcdefghijklmnopqrstuvwxyz");
+  sl1 = arc_substr(c, str, 3, 20);
+  sl2 = arc_substr(c, str, 4, 24);
+  arc_strsetindex(c, sl1, 0, 'X');
+  arc_strsetindex(c, sl2, 1, 0xe9);
+  arc_str2cstr(c, sl1, buf);
+  fail_unless(strcmp(buf, "Xdefghijklmnopqrs") == 0);
+  arc_str2cstr(c, sl2, buf);
+  fail_unless(strcmp(buf, "d\xc3\xa9" "fghijklmnopqrstuvw") == 0);
+  arc_str2cstr(c, str, buf);
+  fail_unless(strcmp(buf, "\xce\xbb" "abcdefghijklmnopqrstuvwxyz") == 0);
+}
+END_TEST
+
 int main(void)
 {
   int number_failed;
@@ -100,6 +207,9 @@ int main(void)
 
   tcase_add_test(tc_str, test_make_strings);
   tcase_add_test(tc_str, test_compare_strings);
+  tcase_add_test(tc_str, test_hash_strings);
+  tcase_add_test(tc_str, test_wide_strings);
+  tcase_add_test(tc_str, test_slices);
 
   suite_add_tcase(s, tc_str);
   sr = srunner_create(s);
@@ -540,6 +540,78 @@ START_TEST(test_mul)
 }
 END_TEST
 
+START_TEST(test_add_feedback)
+{
+  value cctx, code, clos;
+  value thr;
+
+  /* (+ (car x) 3) for x in the environment */
+  cctx = arc_mkcctx(c);
+  arc_emit1(c, cctx, ilde0, INT2FIX(0), CNIL);
+  arc_emit(c, cctx, icar, CNIL);
+  arc_emit(c, cctx, ipush, CNIL);
+  arc_emit1(c, cctx, ildi, INT2FIX(3), CNIL);
+  arc_emit(c, cctx, iadd, CNIL);
+  arc_emit(c, cctx, ihlt, CNIL);
+  code = arc_cctx2code(c, cctx);
+  thr = arc_mkthread(c);
+  clos = arc_mkclos(c, code, arc_mkvector(c, 2));
+  SVINDEX(CLOS_ENV(clos), 1, cons(c, INT2FIX(2), CNIL));
+
+  /* fixnums make the add specialise itself */
+  XCALL0(clos);
+  fail_unless(TVALR(thr) == INT2FIX(5));
+  fail_unless(VINDEX(CODE_CODE(code), 6) == INT2FIX(iaddfx));
+  XCALL0(clos);
+  fail_unless(TVALR(thr) == INT2FIX(5));
+
+  /* and anything else makes it generic again */
+  SVINDEX(CLOS_ENV(clos), 1, cons(c, arc_mkflonum(c, 0.5), CNIL));
+  XCALL0(clos);
+  fail_unless(TYPE(TVALR(thr)) == T_FLONUM);
+  fail_unless(REPFLO(TVALR(thr)) == 3.5);
+  fail_unless(VINDEX(CODE_CODE(code), 6) == INT2FIX(iadd));
+
+  /* as does overflowing a fixnum */
+  SVINDEX(CLOS_ENV(clos), 1, cons(c, INT2FIX(FIXNUM_MAX), CNIL));
+  XCALL0(clos);
+  XCALL0(clos);
+  fail_unless(TYPE(TVALR(thr)) == T_BIGNUM);
+}
+END_TEST
+
+START_TEST(test_lineno)
+{
+  value cctx, code, clos, file, ln;
+
+  file = arc_mkstringc(c, "foo.arc");
+  cctx = arc_mkcctx(c);
+  arc_cctx_mksrc(c, cctx, file);
+  arc_emit1(c, cctx, ildi, INT2FIX(2), INT2FIX(10));
+  arc_emit(c, cctx, ipush, INT2FIX(10));
+  arc_emit1(c, cctx, ildi, INT2FIX(3), INT2FIX(11));
+  arc_emit(c, cctx, iadd, INT2FIX(12));
+  arc_emit(c, cctx, ihlt, CUNBOUND);
+  code = arc_cctx2code(c, cctx);
+  clos = arc_mkclos(c, code, CNIL);
+
+  /* only the changes of line are kept */
+  fail_unless(VECLEN(CODE_SRC(code)) == SRC_LINES + 6);
+
+  ln = __arc_code_lineno(c, clos, &XVINDEX(CODE_CODE(code), 0));
+  fail_unless(car(ln) == file);
+  fail_unless(cdr(ln) == INT2FIX(10));
+  ln = __arc_code_lineno(c, clos, &XVINDEX(CODE_CODE(code), 2));
+  fail_unless(cdr(ln) == INT2FIX(10));
+  ln = __arc_code_lineno(c, clos, &XVINDEX(CODE_CODE(code), 4));
+  fail_unless(cdr(ln) == INT2FIX(11));
+  ln = __arc_code_lineno(c, clos, &XVINDEX(CODE_CODE(code), 5));
+  fail_unless(cdr(ln) == INT2FIX(12));
+  ln = __arc_code_lineno(c, clos, &XVINDEX(CODE_CODE(code), 6));
+  fail_unless(cdr(ln) == INT2FIX(12));
+}
+END_TEST
+
 START_TEST(test_div)
 {
   value cctx, code, clos;
@@ -847,6 +919,86 @@ START_TEST(test_funarg)
 }
 END_TEST
 
+/* A closure created with clsn does not capture the environment it
+   was created in.  This is the equivalent of:
+
+   (fn (a) ((fn (b) (+ b 1)) a))
+*/
+START_TEST(test_clsn)
+{
+  value cctx, c1, code, clos, thr;
+  int lptr;
+
+  cctx = arc_mkcctx(c);
+  arc_emit3(c, cctx, ienv, INT2FIX(1), INT2FIX(0), INT2FIX(0), CNIL);
+  arc_emit1(c, cctx, ilde0, INT2FIX(0), CNIL); /* b */
+  arc_emit(c, cctx, ipush, CNIL);
+  arc_emit1(c, cctx, ildi, INT2FIX(1), CNIL);
+  arc_emit(c, cctx, iadd, CNIL);
+  arc_emit(c, cctx, iret, CNIL);
+  c1 = arc_cctx2code(c, cctx);
+
+  cctx = arc_mkcctx(c);
+  lptr = arc_literal(c, cctx, c1);
+  arc_emit3(c, cctx, ienv, INT2FIX(1), INT2FIX(0), INT2FIX(0), CNIL);
+  arc_emit1(c, cctx, ilde0, INT2FIX(0), CNIL); /* a */
+  arc_emit(c, cctx, ipush, CNIL);
+  arc_emit1(c, cctx, ildl, INT2FIX(lptr), CNIL);
+  arc_emit(c, cctx, iclsn, CNIL);
+  arc_emit1(c, cctx, imenv, INT2FIX(1), CNIL);
+  arc_emit1(c, cctx, iapply, INT2FIX(1), CNIL);
+
+  code = arc_cctx2code(c, cctx);
+  clos = arc_mkclos(c, code, CNIL);
+  thr = arc_mkthread(c);
+  XCALL(clos, INT2FIX(41));
+  fail_unless(TVALR(thr) == INT2FIX(42));
+  fail_unless(NIL_P(CLOS_ENV(TFUNR(thr))));
+}
+END_TEST
+
+/* A closure created with clsf has an environment holding only the
+   values it captures.  This is the equivalent of:
+
+   (fn (a) ((fn (b) (+ b a)) 1))
+*/
+START_TEST(test_clsf)
+{
+  value cctx, c1, code, clos, thr, env;
+  int lptr;
+
+  cctx = arc_mkcctx(c);
+  arc_emit3(c, cctx, ienv, INT2FIX(1), INT2FIX(0), INT2FIX(0), CNIL);
+  arc_emit1(c, cctx, ilde0, INT2FIX(0), CNIL); /* b */
+  arc_emit(c, cctx, ipush, CNIL);
+  arc_emit2(c, cctx, ilde, INT2FIX(1), INT2FIX(0), CNIL); /* a */
+  arc_emit(c, cctx, iadd, CNIL);
+  arc_emit(c, cctx, iret, CNIL);
+  c1 = arc_cctx2code(c, cctx);
+
+  cctx = arc_mkcctx(c);
+  lptr = arc_literal(c, cctx, c1);
+  arc_emit3(c, cctx, ienv, INT2FIX(1), INT2FIX(0), INT2FIX(0), CNIL);
+  arc_emit1(c, cctx, ildi, INT2FIX(1), CNIL);
+  arc_emit(c, cctx, ipush, CNIL);
+  arc_emit1(c, cctx, ilde0, INT2FIX(0), CNIL); /* a */
+  arc_emit(c, cctx, ipush, CNIL);
+  arc_emit1(c, cctx, ildl, INT2FIX(lptr), CNIL);
+  arc_emit1(c, cctx, iclsf, INT2FIX(1), CNIL);
+  arc_emit1(c, cctx, imenv, INT2FIX(1), CNIL);
+  arc_emit1(c, cctx, iapply, INT2FIX(1), CNIL);
+
+  code = arc_cctx2code(c, cctx);
+  clos = arc_mkclos(c, code, CNIL);
+  thr = arc_mkthread(c);
+  XCALL(clos, INT2FIX(41));
+  fail_unless(TVALR(thr) == INT2FIX(42));
+  env = CLOS_ENV(TFUNR(thr));
+  fail_unless(TYPE(env) == T_VECTOR && VECLEN(env) == 2);
+  fail_unless(NIL_P(VINDEX(env, 0)) && VINDEX(env, 1) == INT2FIX(41));
+}
+END_TEST
+
 static value mycont;
 
 /* The following two functions are essentially the same as the following:
@@ -931,6 +1083,110 @@ START_TEST(test_stackresize)
 }
 END_TEST
 
+/* (afn (n) (if (is n 0) 0 (+ n (self (- n 1))))), with every call
+   saving a continuation on the stack */
+AFFDEF(sumto)
+{
+  AARG(n);
+  AFBEGIN;
+  if (AV(n) == INT2FIX(0))
+    ARETURN(INT2FIX(0));
+  AFCALL(arc_mkaff(c, sumto, CNIL), INT2FIX(FIX2INT(AV(n)) - 1));
+  ARETURN(INT2FIX(FIX2INT(AV(n)) + FIX2INT(AFCRV)));
+  AFEND;
+}
+AFFEND
+
+START_TEST(test_stacksegment)
+{
+  value thr, chunk;
+  int oldstksize = c->stksize;
+
+  /* Small enough that nearly every call needs a new stack chunk */
+  c->stksize = 16;
+  thr = arc_mkthread(c);
+  chunk = TSTACK(thr);
+  SVALR(thr, arc_mkaff(c, sumto, CNIL));
+  CPUSH(thr, INT2FIX(1000));
+  TARGC(thr) = 1;
+  __arc_thr_trampoline(c, thr, TR_FNAPP);
+  fail_unless(TVALR(thr) == INT2FIX(500500));
+  fail_unless(TSTACK(thr) == chunk);
+
+  /* Capturing a continuation across stack chunks */
+  mycont = CNIL;
+  thr = arc_mkthread(c);
+  SVALR(thr, arc_mkaff(c, ccctest, CNIL));
+  CPUSH(thr, INT2FIX(30));
+  TARGC(thr) = 1;
+  __arc_thr_trampoline(c, thr, TR_FNAPP);
+  fail_unless(TVALR(thr) == INT2FIX(19));
+
+  thr = arc_mkthread(c);
+  SVALR(thr, mycont);
+  CPUSH(thr, INT2FIX(4));
+  TARGC(thr) = 1;
+  __arc_thr_trampoline(c, thr, TR_FNAPP);
+  fail_unless(TVALR(thr) == INT2FIX(16));
+  c->stksize = oldstksize;
+}
+END_TEST
+
+START_TEST(test_stkpool)
+{
+  value thr, chunk, big;
+
+  /* A released chunk is handed to the next new thread */
+  thr = arc_mkthread(c);
+  chunk = TSTACK(thr);
+  fail_unless(VECLEN(chunk) == TSTKINIT);
+  __arc_stackrelease(c, thr);
+  thr = arc_mkthread(c);
+  fail_unless(TSTACK(thr) == chunk);
+
+  /* but a bigger chunk is not */
+  __arc_stackreserve(c, thr, TSTKINIT*2);
+  big = TSTACK(thr);
+  fail_unless(VECLEN(big) > TSTKINIT);
+  __arc_stackrelease(c, thr);
+  thr = arc_mkthread(c);
+  fail_unless(TSTACK(thr) != big);
+  fail_unless(VECLEN(TSTACK(thr)) == TSTKINIT);
+
+  /* and goes back to a thread that needs one that big */
+  __arc_stackreserve(c, thr, TSTKINIT*2);
+  fail_unless(TSTACK(thr) == big);
+}
+END_TEST
+
+START_TEST(test_thread_lazy)
+{
+  value thr, oldthr = c->curthread, cm;
+
+  thr = arc_mkthread(c);
+  fail_unless(NIL_P(TCM(thr)));
+  fail_unless(TRVCH(thr) == CUNBOUND);
+  fail_unless(NIL_P(TCH(thr)));
+  fail_unless(NIL_P(TBCH(thr)));
+
+  /* Looking up a continuation mark does not make the table */
+  c->curthread = thr;
+  fail_unless(NIL_P(arc_cmark(c, INT2FIX(1))));
+  fail_unless(NIL_P(TCM(thr)));
+  arc_scmark(c, INT2FIX(1), INT2FIX(2));
+  cm = TCM(thr);
+  fail_unless(TYPE(cm) == T_TABLE);
+  fail_unless(arc_cmark(c, INT2FIX(1)) == INT2FIX(2));
+  fail_unless(__arc_thread_cmarks(c, thr) == cm);
+  c->curthread = oldthr;
+
+  fail_unless(TYPE(__arc_thread_rvchan(c, thr)) == T_CHAN);
+  fail_unless(__arc_thread_rvchan(c, thr) == TRVCH(thr));
+  fail_unless(CONS_P(__arc_thread_here(c, thr)));
+  fail_unless(TBCH(thr) == TCH(thr));
+}
+END_TEST
+
 int main(void)
 {
   int number_failed;
@@ -961,6 +1217,8 @@ int main(void)
   tcase_add_test(tc_vm, test_add);
   tcase_add_test(tc_vm, test_sub);
   tcase_add_test(tc_vm, test_mul);
+  tcase_add_test(tc_vm, test_add_feedback);
+  tcase_add_test(tc_vm, test_lineno);
   tcase_add_test(tc_vm, test_div);
   tcase_add_test(tc_vm, test_cons);
   tcase_add_test(tc_vm, test_car);
@@ -971,8 +1229,13 @@ int main(void)
   tcase_add_test(tc_vm, test_imenv);
 
   tcase_add_test(tc_vm, test_funarg);
+  tcase_add_test(tc_vm, test_clsn);
+  tcase_add_test(tc_vm, test_clsf);
   tcase_add_test(tc_vm, test_callcc);
   tcase_add_test(tc_vm, test_stackresize);
+  tcase_add_test(tc_vm, test_stacksegment);
+  tcase_add_test(tc_vm, test_stkpool);
+  tcase_add_test(tc_vm, test_thread_lazy);
 
   suite_add_tcase(s, tc_vm);
   sr = srunner_create(s);
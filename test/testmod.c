@@ -0,0 +1,33 @@
+/* 
+  Copyright (C) 2013 Rafael R. Sevilla
+
+  This file is part of Arcueid
+
+  Arcueid is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+/* A native module for check_native */
+#include "../src/arcueid.h"
+
+static value testmod_add(arc *c, value x, value y)
+{
+  return(INT2FIX(FIX2INT(x) + FIX2INT(y)));
+}
+
+value arc_module_init(arc *c)
+{
+  arc_bindcstr(c, "testmod-add",
+	       arc_mkccode(c, 2, testmod_add,
+			   arc_intern_cstr(c, "testmod-add")));
+  return(arc_intern_cstr(c, "testmod"));
+}